@@ -615,6 +615,15 @@ const globalPrefs: Field[] = [
     ),
     "3.6",
   ),
+  setExpert(
+    mkField(
+      "MapLargeFiles",
+      Bool,
+      false,
+      "if true, large documents on local disks are read through a memory mapping, which is faster. " +
+        "While such a document is open, other programs (e.g. pdflatex) can't rewrite it",
+    ),
+  ),
   setExpert(
     mkField(
       "MainWindowBackground",
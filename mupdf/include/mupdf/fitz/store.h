@@ -391,6 +391,20 @@ int fz_store_scavenge_external(fz_context *ctx, size_t size, int *phase);
 */
 int fz_shrink_store(fz_context *ctx, unsigned int percent);
 
+/**
+	SumatraPDF: returns the total size of the objects in the store.
+*/
+size_t fz_store_size(fz_context *ctx);
+
+/**
+	SumatraPDF: evict least recently used items from the store until
+	the total size of the objects in the store is at most size.
+
+	Returns non zero if we managed to free enough memory, zero
+	otherwise.
+*/
+int fz_shrink_store_to(fz_context *ctx, size_t size);
+
 /**
 	Callback function called by fz_filter_store on every item within
 	the store.
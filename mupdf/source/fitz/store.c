@@ -1008,6 +1008,40 @@ fz_shrink_store(fz_context *ctx, unsigned int percent)
 	return success;
 }
 
+/* SumatraPDF: for sharing a memory budget between documents */
+size_t
+fz_store_size(fz_context *ctx)
+{
+	size_t size;
+	fz_store *store = ctx->store;
+
+	if (store == NULL)
+		return 0;
+
+	fz_lock(ctx, FZ_LOCK_ALLOC);
+	size = store->size;
+	fz_unlock(ctx, FZ_LOCK_ALLOC);
+	return size;
+}
+
+/* SumatraPDF: for sharing a memory budget between documents */
+int
+fz_shrink_store_to(fz_context *ctx, size_t size)
+{
+	int success;
+	fz_store *store = ctx->store;
+
+	if (store == NULL)
+		return 0;
+
+	fz_lock(ctx, FZ_LOCK_ALLOC);
+	if (store->size > size)
+		scavenge(ctx, store->size - size);
+	success = (store->size <= size) ? 1 : 0;
+	fz_unlock(ctx, FZ_LOCK_ALLOC);
+	return success;
+}
+
 void fz_filter_store(fz_context *ctx, fz_store_filter_fn *fn, void *arg, const fz_store_type *type)
 {
 	fz_store *store;
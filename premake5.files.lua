@@ -868,6 +868,7 @@ function utils_files()
     "ApiHook.*",
     "Archive.*",
     "AvifReader.*",
+    "Base64.*",
     "BaseUtil.*",
     "BitReader.*",
     "BuildConfig.h",
@@ -876,14 +877,17 @@ function utils_files()
     "ByteWriter.*",
     "CmdLineArgsIter.*",
     "ColorUtil.*",
+    "CpuUtil.*",
     "CryptoUtil.*",
     "CssParser.*",
     "DbgHelpDyn.*",
+    "DecodedImage.*",
     "Dict.*",
     "DirIter.*",
     "Dpi.*",
     "FileUtil.*",
     "FileWatcher.*",
+    "FuzzyMatch.*",
     "FzImgReader.*",
     "GdiPlusUtil.*",
     "GeomUtil.*",
@@ -1281,16 +1285,20 @@ end
 
 function test_util_files()
   files_in_dir("src/utils", {
+    "Base64.*",
     "BaseUtil.*",
     "BitManip.*",
     "ByteOrderDecoder.*",
     "CmdLineArgsIter.*",
     "ColorUtil.*",
+    "CpuUtil.*",
     "CryptoUtil.*",
     "CssParser.*",
+    "DecodedImage.*",
     "Dict.*",
     "Dpi.*",
     "FileUtil.*",
+    "FuzzyMatch.*",
     "GeomUtil.*",
     "HtmlParserLookup.*",
     "HtmlPrettyPrint.*",
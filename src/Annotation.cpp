@@ -1063,7 +1063,8 @@ Annotation* EngineMupdfCreateAnnotation(EngineBase* engine, int pageNo, PointF p
     EngineMupdf* epdf = AsEngineMupdf(engine);
     fz_context* ctx = epdf->Ctx();
 
-    auto pageInfo = epdf->GetFzPageInfo(pageNo, true);
+    auto pageInfo = epdf->GetFzPageInfo(pageNo, true, nullptr, true);
+    ScopedPinFzPage pin(epdf, pageInfo);
     pdf_annot* annot = nullptr;
     auto typ = args->annotType;
     auto col = args->col;
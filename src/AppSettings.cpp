@@ -212,6 +212,8 @@ bool LoadSettings() {
         gprefs->defaultImageZoomFloat = ZoomFromString(gprefs->defaultImageZoom, 0);
     }
 
+    gMupdfUseMappedFiles = gprefs->mapLargeFiles;
+
     int weekDiff = GetWeekCount() - gprefs->openCountWeek;
     gprefs->openCountWeek = GetWeekCount();
     if (weekDiff > 0) {
@@ -1457,6 +1457,7 @@ static bool DrawDocument(MainWindow* win, HDC hdc, RECT* rcArea) {
         return false;
     }
     DisplayModel* dm = win->AsFixed();
+    dm->RelayoutIfPageSizesChanged();
     // logf("DrawDocument RenderCache:\n");
 
     bool isImage = dm->GetEngine()->IsImageCollection();
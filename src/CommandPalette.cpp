@@ -6,6 +6,7 @@
 #include "utils/Dpi.h"
 #include "utils/UITask.h"
 #include "utils/FileUtil.h"
+#include "utils/FuzzyMatch.h"
 
 #include "wingui/UIModels.h"
 #include "wingui/Layout.h"
@@ -195,10 +196,28 @@ struct ItemDataCP {
     i32 cmdId = 0;
     WindowTab* tab = nullptr;
     const char* filePath = nullptr;
+    // added to match score, favors recently and frequently opened files
+    int rankBonus = 0;
 };
 
 using StrVecCP = StrVecWithData<ItemDataCP>;
 
+// lower-cased strings of a list and which of them matched the last query.
+// if the query is extended, only those have to be checked again
+struct SearchCP {
+    StrVec lower;
+    Vec<int> matches;
+    char* query = nullptr;
+
+    SearchCP() = default;
+    ~SearchCP() { str::Free(query); }
+    void Reset() {
+        lower.Reset();
+        matches.Reset();
+        str::FreePtr(&query);
+    }
+};
+
 struct ListBoxModelCP : ListBoxModel {
     StrVecCP strings;
 
@@ -218,6 +237,9 @@ struct CommandPaletteWnd : Wnd {
     StrVecCP tabs;
     StrVecCP fileHistory;
     StrVecCP commands;
+    SearchCP tabsSearch;
+    SearchCP fileHistorySearch;
+    SearchCP commandsSearch;
     ListBox* listBox = nullptr;
     Static* staticInfo = nullptr;
 
@@ -728,11 +750,15 @@ void CommandPaletteWnd::CollectStrings(MainWindow* mainWin) {
     // append paths of files from history, excluding
     // already appended (from opened files)
     fileHistory.Reset();
+    int recency = 0;
     for (FileState* fs : *gGlobalPrefs->fileStates) {
         char* s = fs->filePath;
         s = ConvertPathForDisplayTemp(s);
         ItemDataCP data;
         data.filePath = fs->filePath;
+        // history is most recent first. worth about one matched character
+        data.rankBonus = std::max(16 - recency, 0) + std::clamp(fs->openCount, 0, 16);
+        recency++;
         fileHistory.Append(s, data);
     }
 
@@ -773,6 +799,10 @@ void CommandPaletteWnd::CollectStrings(MainWindow* mainWin) {
     for (int i = 0; i < n; i++) {
         commands.AppendFrom(&tempCommands, i);
     }
+
+    tabsSearch.Reset();
+    fileHistorySearch.Reset();
+    commandsSearch.Reset();
 }
 
 static void EditSetTextAndFocus(Edit* e, const char* s) {
@@ -990,18 +1020,6 @@ bool CommandPaletteWnd::PreTranslateMessage(MSG& msg) {
     return false;
 }
 
-// all words must be present in str, ignoring the case
-static bool FilterMatches(const char* str, const StrVec& words) {
-    int nWords = words.Size();
-    for (int i = 0; i < nWords; i++) {
-        auto word = words.At(i);
-        if (!str::ContainsI(str, word)) {
-            return false;
-        }
-    }
-    return true;
-}
-
 static void SplitFilterToWords(const char* filter, StrVec& words) {
     char* s = str::DupTemp(filter);
     char* wordStart = s;
@@ -1022,14 +1040,61 @@ static void SplitFilterToWords(const char* filter, StrVec& words) {
     }
 }
 
-static void FilterStrings(StrVecCP& strs, const StrVec& words, StrVecCP& matchedOut) {
+struct MatchCP {
+    int idx;
+    int score;
+};
+
+// all words must fuzzy match, best matches first
+// words and query must be lower-cased
+static void FilterStrings(StrVecCP& strs, SearchCP& search, const char* query, const StrVec& words,
+                          StrVecCP& matchedOut) {
     int n = strs.Size();
-    for (int i = 0; i < n; i++) {
-        const char* s = strs.At(i);
-        if (!FilterMatches(s, words)) {
-            continue;
+    if (search.lower.Size() != n) {
+        search.Reset();
+        for (int i = 0; i < n; i++) {
+            StrSpan s = strs.AtSpan(i);
+            search.lower.Append(fuzzy::ToLowerTemp(s.CStr(), s.Size()), s.Size());
         }
-        matchedOut.AppendFrom(&strs, i);
+    }
+
+    // every word of a longer query is the same or longer, so it can only
+    // match a subset of what the shorter query matched
+    bool refine = search.query && str::StartsWith(query, search.query);
+    int nCandidates = refine ? search.matches.Size() : n;
+    int nWords = words.Size();
+    Vec<MatchCP> matched;
+    for (int i = 0; i < nCandidates; i++) {
+        int idx = refine ? search.matches[i] : i;
+        StrSpan s = strs.AtSpan(idx);
+        const char* sLower = search.lower.At(idx);
+        int total = 0;
+        bool isMatch = true;
+        for (int w = 0; w < nWords && isMatch; w++) {
+            StrSpan word = words.AtSpan(w);
+            int score = 0;
+            isMatch = fuzzy::Match(s.CStr(), sLower, s.Size(), word.CStr(), word.Size(), &score);
+            total += score;
+        }
+        if (isMatch) {
+            total += strs.AtData(idx)->rankBonus;
+            matched.Append({idx, total});
+        }
+    }
+
+    search.matches.Reset();
+    for (MatchCP& m : matched) {
+        search.matches.Append(m.idx);
+    }
+    str::ReplaceWithCopy(&search.query, query);
+
+    // without a query keep the original order e.g. tabs in mru order
+    if (nWords > 0) {
+        std::stable_sort(matched.begin(), matched.end(),
+                         [](const MatchCP& m1, const MatchCP& m2) { return m1.score > m2.score; });
+    }
+    for (MatchCP& m : matched) {
+        matchedOut.AppendFrom(&strs, m.idx);
     }
 }
 
@@ -1059,17 +1124,18 @@ void CommandPaletteWnd::FilterStringsForQuery(const char* filter, StrVecCP& stri
     }
 
     // split filter into words once
+    filter = fuzzy::ToLowerTemp(filter);
     filterWords.Reset();
     SplitFilterToWords(filter, filterWords);
 
     if (searchTabs) {
-        FilterStrings(tabs, filterWords, strings);
+        FilterStrings(tabs, tabsSearch, filter, filterWords, strings);
     }
     if (searchHistory) {
-        FilterStrings(fileHistory, filterWords, strings);
+        FilterStrings(fileHistory, fileHistorySearch, filter, filterWords, strings);
     }
     if (searchCommands) {
-        FilterStrings(commands, filterWords, strings);
+        FilterStrings(commands, commandsSearch, filter, filterWords, strings);
     }
 }
 
@@ -1232,24 +1298,32 @@ void CommandPaletteWnd::DrawListBoxItem(ListBox::DrawItemEvent* ev) {
         fmt |= isRtl ? (DT_RIGHT | DT_RTLREADING) : DT_LEFT;
         DrawTextW(hdc, itemTextW, -1, &rc, fmt);
     } else {
-        // find all match ranges in itemText
+        // find all matched chars in itemText
         int textLen = str::Leni(itemText);
+        TempStr textLower = fuzzy::ToLowerTemp(itemText, textLen);
         // marks which chars are part of a match
         u8* highlighted = AllocArrayTemp<u8>(textLen);
+        u8* matchedPos = AllocArrayTemp<u8>(textLen);
         const StrVec& words = filterWords;
         for (int w = 0; w < nWords; w++) {
-            const char* word = words.At(w);
-            int wordLen = str::Leni(word);
-            if (wordLen == 0) {
+            StrSpan word = words.AtSpan(w);
+            int score;
+            if (!fuzzy::Match(itemText, textLower, textLen, word.CStr(), word.Size(), &score, matchedPos)) {
                 continue;
             }
-            const char* p = itemText;
-            while ((p = str::FindI(p, word)) != nullptr) {
-                int off = (int)(p - itemText);
-                for (int k = 0; k < wordLen && off + k < textLen; k++) {
-                    highlighted[off + k] = 1;
-                }
-                p += wordLen;
+            for (int k = 0; k < textLen; k++) {
+                highlighted[k] |= matchedPos[k];
+            }
+        }
+        // ranges are converted to WCHAR offsets so they must cover whole utf-8 sequences
+        for (int k = 1; k < textLen; k++) {
+            if (((u8)itemText[k] & 0xc0) == 0x80) {
+                highlighted[k] |= highlighted[k - 1];
+            }
+        }
+        for (int k = textLen - 1; k > 0; k--) {
+            if (((u8)itemText[k] & 0xc0) == 0x80) {
+                highlighted[k - 1] |= highlighted[k];
             }
         }
 
@@ -8,6 +8,7 @@
 #include <eh.h>
 
 #include "utils/WinDynCalls.h"
+#include "utils/CpuUtil.h"
 #include "utils/DbgHelpDyn.h"
 #include "utils/FileUtil.h"
 #include "utils/HttpUtil.h"
@@ -145,9 +146,7 @@ static char* BuildCrashInfoText(const char* condStr, const char* fileLine, bool
     }
 
     s.Append("\n-------- Log -----------------\n\n");
-    if (gLogBuf) {
-        s.Append(gLogBuf->LendData());
-    } else {
+    if (!AppendLogForCrashReport(s)) {
         s.Append("(no log - crashed before initializing logging)\n");
     }
 
@@ -357,6 +357,7 @@ DisplayModel::DisplayModel(EngineBase* engine, DocControllerCallback* cb) : DocC
     textCache = new DocumentTextCache(engine);
     textSelection = new TextSelection(engine, textCache);
     textSearch = new TextSearch(engine, textCache);
+    engine->onMediaboxesChanged = MkFunc0(DisplayModel::MediaboxesChangedAsync, this);
 }
 
 DisplayModel::~DisplayModel() {
@@ -370,6 +371,8 @@ DisplayModel::~DisplayModel() {
     delete textSearch;
     delete textSelection;
     delete textCache;
+    // background threads of the engine might still use it
+    engine->onMediaboxesChanged = {};
     SafeEngineRelease(&engine);
     free(pagesInfo);
 }
@@ -383,6 +386,9 @@ RectF DisplayModel::PageMediaBox(int pageNo) const {
     if (pi->state == PageInfoState::Error) {
         return RectF();
     }
+    // provisional sizes are asked for again until the engine knows the real size.
+    // the engine sets the real size before clearing provisional, so ask in this order
+    bool provisional = engine->IsPageMediaboxProvisional(pageNo);
     pi->_mediaBox = engine->PageMediabox(pageNo);
     if (pi->_mediaBox.IsEmpty()) {
         float fileDPI = engine->GetFileDPI();
@@ -392,12 +398,40 @@ RectF DisplayModel::PageMediaBox(int pageNo) const {
             pi->_mediaBox = RectF(0, 0, 8.5 * fileDPI, 11 * fileDPI);
         }
         pi->state = PageInfoState::Error;
+    } else if (provisional) {
+        pi->state = PageInfoState::Provisional;
     } else {
         pi->state = PageInfoState::Known;
     }
     return pi->_mediaBox;
 }
 
+static void MediaboxesChangedOnUIThread(DisplayModel* dm) {
+    if (!IsDisplayModelValid(dm)) {
+        return;
+    }
+    // re-layouts before painting, see RelayoutIfPageSizesChanged()
+    dm->RepaintDisplay();
+}
+
+// called by the engine, usually on a background thread
+void DisplayModel::MediaboxesChangedAsync(DisplayModel* dm) {
+    auto fn = MkFunc0(MediaboxesChangedOnUIThread, dm);
+    uitask::Post(fn, "MediaboxesChanged");
+}
+
+// engine might have replaced provisional page sizes with real ones
+void DisplayModel::RelayoutIfPageSizesChanged() {
+    int ver = AtomicIntGet(&engine->mediaboxesVersion);
+    if (ver == mediaboxesVersion || !pagesInfo) {
+        return;
+    }
+    mediaboxesVersion = ver;
+    ScrollState state = GetScrollState();
+    Relayout(zoomVirtual, rotation);
+    SetScrollState(state);
+}
+
 PageInfo* DisplayModel::GetPageInfo(int pageNo) const {
     if (!ValidPageNo(pageNo)) {
         return nullptr;
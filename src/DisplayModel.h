@@ -142,6 +142,8 @@ struct DisplayModel : DocController {
     int GetRotation() const;
     float GetZoomReal(int pageNo) const;
     void Relayout(float zoomVirtual, int rotation);
+    void RelayoutIfPageSizesChanged();
+    static void MediaboxesChangedAsync(DisplayModel* dm);
 
     Rect GetViewPort() const;
     bool IsHScrollbarVisible() const;
@@ -220,6 +222,8 @@ struct DisplayModel : DocController {
 
     /* an array of PageInfo, len of array is pageCount */
     PageInfo* pagesInfo = nullptr;
+    /* engine->mediaboxesVersion at the time of last layout */
+    int mediaboxesVersion = 0;
 
     DisplayMode displayMode{DisplayMode::Automatic};
     /* In non-continuous mode is the first page from a file that we're
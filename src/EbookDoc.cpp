@@ -4,11 +4,13 @@
 #include "utils/BaseUtil.h"
 #include "utils/ScopedWin.h"
 #include "utils/Archive.h"
+#include "utils/Base64.h"
 #include "utils/FileUtil.h"
 #include "utils/GuessFileType.h"
 #include "utils/GdiPlusUtil.h"
 #include "utils/HtmlParserLookup.h"
 #include "utils/HtmlPullParser.h"
+#include "utils/ThreadUtil.h"
 #include "utils/TrivialHtmlParser.h"
 #include "utils/WinUtil.h"
 
@@ -154,63 +156,6 @@ char* NormalizeURL(const char* url, const char* base) {
     return norm;
 }
 
-inline char decode64(char c) {
-    if ('A' <= c && c <= 'Z') {
-        return c - 'A';
-    }
-    if ('a' <= c && c <= 'z') {
-        return c - 'a' + 26;
-    }
-    if ('0' <= c && c <= '9') {
-        return c - '0' + 52;
-    }
-    if ('+' == c) {
-        return 62;
-    }
-    if ('/' == c) {
-        return 63;
-    }
-    return -1;
-}
-
-static ByteSlice Base64Decode(const ByteSlice& data) {
-    size_t sLen = data.size();
-    u8* s = data.data();
-    u8* end = data.data() + sLen;
-    u8* result = AllocArray<u8>(sLen * 3 / 4);
-    u8* curr = result;
-    u8 c = 0;
-    int step = 0;
-    for (; s < end && *s != '='; s++) {
-        char n = decode64(*s);
-        if (-1 == n) {
-            if (str::IsWs((char)*s)) {
-                continue;
-            }
-            free(result);
-            return {};
-        }
-        switch (step++ % 4) {
-            case 0:
-                c = n;
-                break;
-            case 1:
-                *curr++ = (c << 2) | (n >> 4);
-                c = n & 0xF;
-                break;
-            case 2:
-                *curr++ = (c << 4) | (n >> 2);
-                c = n & 0x3;
-                break;
-            case 3:
-                *curr++ = (c << 6) | (n >> 0);
-                break;
-        }
-    }
-    size_t size = curr - result;
-    return {(u8*)result, size};
-}
-
 static inline void AppendChar(str::Str& htmlData, char c) {
     switch (c) {
         case '&':
@@ -237,7 +182,7 @@ static ByteSlice DecodeDataURI(const char* url) {
     const char* data = comma + 1;
     if (comma - url >= 12 && str::EqN(comma - 7, ";base64", 7)) {
         ByteSlice d{(u8*)data, str::Len(data)};
-        return Base64Decode(d);
+        return base64::Decode(d);
     }
     return {(u8*)str::Dup(data), str::Len(data)};
 }
@@ -298,6 +243,199 @@ static bool isImageMediaType(const char* mediatype) {
     return str::Eq(mediatype, "image/png") || str::Eq(mediatype, "image/jpeg") || str::Eq(mediatype, "image/gif");
 }
 
+// html files of the spine are extracted and converted to utf-8 on worker
+// threads while Load() appends them to htmlData in spine order
+struct EpubSpineItem {
+    const char* path = nullptr;
+    size_t fileId = (size_t)-1;
+    // index of an earlier item for the same file
+    int sameAs = -1;
+    // utf-8, set by the thread that extracted it
+    char* html = nullptr;
+    AtomicBool isReady = 0;
+};
+
+struct EpubSpineLoader {
+    MultiFormatArchive* zip = nullptr;
+    EpubSpineItem* items = nullptr;
+    // signaled every time an item becomes ready
+    HANDLE hItemReady = nullptr;
+};
+
+struct EpubSpineWorker {
+    EpubSpineLoader* loader = nullptr;
+    int start = 0;
+    int end = 0;
+    bool isOwnThread = false;
+};
+
+constexpr int kEpubMaxLoadThreads = 4;
+constexpr int kEpubMinItemsPerThread = 8;
+
+static void MarkSpineItemReady(EpubSpineLoader* loader, EpubSpineItem* item) {
+    AtomicBoolSet(&item->isReady, true);
+    SetEvent(loader->hItemReady);
+}
+
+struct EpubSpineExtract {
+    EpubSpineWorker* w = nullptr;
+    Vec<int> itemIdxs;
+    ByteSlice* data = nullptr;
+};
+
+// called by GetFilesDataById() as soon as a file has been extracted
+// so that appending can start before the whole range of a worker is done
+static void SpineItemExtracted(EpubSpineExtract* e, int i) {
+    EpubSpineLoader* loader = e->w->loader;
+    EpubSpineItem* item = &loader->items[e->itemIdxs[i]];
+    ByteSlice html = e->data[i];
+    if (html) {
+        TempStr decoded = DecodeTextToUtf8Temp(html, true);
+        if (decoded) {
+            item->html = str::Dup(decoded);
+        }
+        html.Free();
+    }
+    MarkSpineItemReady(loader, item);
+    // can't reset when running on the thread that calls Load()
+    // because it still uses temp strings
+    if (e->w->isOwnThread) {
+        ResetTempAllocator();
+    }
+}
+
+static void ExtractSpineItems(EpubSpineWorker* w) {
+    EpubSpineLoader* loader = w->loader;
+    EpubSpineExtract e;
+    e.w = w;
+    Vec<size_t> fileIds;
+    for (int i = w->start; i < w->end; i++) {
+        EpubSpineItem* item = &loader->items[i];
+        if (item->sameAs >= 0 || item->fileId == (size_t)-1) {
+            MarkSpineItemReady(loader, item);
+            continue;
+        }
+        fileIds.Append(item->fileId);
+        e.itemIdxs.Append(i);
+    }
+    if (fileIds.IsEmpty()) {
+        return;
+    }
+    e.data = AllocArray<ByteSlice>(fileIds.Size());
+    if (!e.data) {
+        for (int idx : e.itemIdxs) {
+            MarkSpineItemReady(loader, &loader->items[idx]);
+        }
+        return;
+    }
+    loader->zip->GetFilesDataById(fileIds, e.data, MkFunc1(SpineItemExtracted, &e));
+    free(e.data);
+}
+
+static void ExtractSpineItemsThread(EpubSpineWorker* w) {
+    ExtractSpineItems(w);
+    delete w;
+}
+
+static int EpubLoadThreadCount(int nItems) {
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    int n = (int)si.dwNumberOfProcessors;
+    n = std::min(n, kEpubMaxLoadThreads);
+    n = std::min(n, nItems / kEpubMinItemsPerThread);
+    return std::max(n, 1);
+}
+
+static void AppendSpineHtml(MultiFormatArchive* zip, const StrVec& paths, str::Str& htmlData) {
+    int n = paths.Size();
+    if (n == 0) {
+        return;
+    }
+
+    auto items = new EpubSpineItem[n];
+    // for each file in the archive, index of the first spine item referencing it
+    Vec<int> firstItemForFile;
+    int nFiles = zip->GetFileInfos().Size();
+    for (int i = 0; i < nFiles; i++) {
+        firstItemForFile.Append(-1);
+    }
+    for (int i = 0; i < n; i++) {
+        EpubSpineItem* item = &items[i];
+        item->path = paths.At(i);
+        item->fileId = zip->GetFileId(item->path);
+        if (item->fileId == (size_t)-1 || item->fileId >= (size_t)nFiles) {
+            item->fileId = (size_t)-1;
+            continue;
+        }
+        int first = firstItemForFile[item->fileId];
+        if (first >= 0) {
+            item->sameAs = first;
+        } else {
+            firstItemForFile[item->fileId] = i;
+        }
+    }
+
+    EpubSpineLoader loader;
+    loader.zip = zip;
+    loader.items = items;
+    loader.hItemReady = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+
+    // the calling thread extracts the first range, others are extracted in parallel
+    int nThreads = EpubLoadThreadCount(n);
+    int perThread = (n + nThreads - 1) / nThreads;
+    Vec<HANDLE> threads;
+    EpubSpineWorker first;
+    first.loader = &loader;
+    first.start = 0;
+    first.end = std::min(n, perThread);
+    for (int t = 1; t < nThreads; t++) {
+        auto w = new EpubSpineWorker();
+        w->loader = &loader;
+        w->start = t * perThread;
+        w->end = std::min(n, w->start + perThread);
+        w->isOwnThread = true;
+        HANDLE h = StartThread(MkFunc0(ExtractSpineItemsThread, w), "EpubLoadThread");
+        if (h) {
+            threads.Append(h);
+            continue;
+        }
+        w->isOwnThread = false;
+        ExtractSpineItems(w);
+        delete w;
+    }
+    ExtractSpineItems(&first);
+
+    for (int i = 0; i < n; i++) {
+        EpubSpineItem* item = &items[i];
+        while (!AtomicBoolGet(&item->isReady)) {
+            WaitForSingleObject(loader.hItemReady, INFINITE);
+        }
+        const char* html = item->sameAs >= 0 ? items[item->sameAs].html : item->html;
+        if (!html) {
+            continue;
+        }
+        // insert explicit page-breaks between sections including
+        // an anchor with the file name at the top (for internal links)
+        TempStr path = str::DupTemp(item->path);
+        ReportIf(str::FindChar(path, '"'));
+        str::TransCharsInPlace(path, "\"", "'");
+        htmlData.AppendFmt("<pagebreak page_path=\"%s\" page_marker />", path);
+        htmlData.Append(html);
+    }
+
+    if (threads.Size() > 0) {
+        WaitForMultipleObjects((DWORD)threads.Size(), threads.LendData(), TRUE, INFINITE);
+    }
+    for (HANDLE h : threads) {
+        CloseHandle(h);
+    }
+    CloseHandle(loader.hItemReady);
+    for (int i = 0; i < n; i++) {
+        str::Free(items[i].html);
+    }
+    delete[] items;
+}
+
 bool EpubDoc::Load() {
     if (!zip) {
         return false;
@@ -426,6 +564,7 @@ bool EpubDoc::Load() {
         isRtlDoc = str::EqI(readingDir, L"rtl");
     }
 
+    StrVec spinePaths;
     for (node = node->down; node; node = node->next) {
         if (!node->NameIsNS("itemref", EPUB_OPF_NS)) {
             continue;
@@ -438,22 +577,9 @@ bool EpubDoc::Load() {
         auto idx = idList.Find(idref);
         const char* fname = pathList.At(idx);
         char* fullPath = str::JoinTemp(contentPath, fname);
-        ByteSlice html = zip->GetFileDataByName(fullPath);
-        if (!html) {
-            continue;
-        }
-        TempStr decoded = DecodeTextToUtf8Temp(html, true);
-        html.Free();
-        if (!decoded) {
-            continue;
-        }
-        // insert explicit page-breaks between sections including
-        // an anchor with the file name at the top (for internal links)
-        ReportIf(str::FindChar(fullPath, '"'));
-        str::TransCharsInPlace(fullPath, "\"", "'");
-        htmlData.AppendFmt("<pagebreak page_path=\"%s\" page_marker />", fullPath);
-        htmlData.Append(decoded);
+        spinePaths.Append(fullPath);
     }
+    AppendSpineHtml(zip, spinePaths, htmlData);
 
     return htmlData.size() > 0;
 }
@@ -766,9 +892,12 @@ EpubDoc* EpubDoc::CreateFromStream(IStream* stream) {
 const char* FB2_MAIN_NS = "http://www.gribuser.ru/xml/fictionbook/2.0";
 const char* FB2_XLINK_NS = "http://www.w3.org/1999/xlink";
 
-Fb2Doc::Fb2Doc(const char* fileName) : fileName(str::Dup(fileName)) {}
+Fb2Doc::Fb2Doc(const char* fileName) : fileName(str::Dup(fileName)) {
+    InitializeCriticalSection(&imagesAccess);
+}
 
 Fb2Doc::Fb2Doc(IStream* stream) : stream(stream) {
+    InitializeCriticalSection(&imagesAccess);
     stream->AddRef();
 }
 
@@ -777,6 +906,7 @@ Fb2Doc::~Fb2Doc() {
         str::Free(img.base);
         str::Free(img.fileName);
     }
+    DeleteCriticalSection(&imagesAccess);
     if (stream) {
         stream->Release();
     }
@@ -848,13 +978,29 @@ bool Fb2Doc::Load() {
     if (data.empty()) {
         return false;
     }
-    TempStr tmp = DecodeTextToUtf8Temp(data, true);
-    data.Free();
-    if (!tmp) {
-        return false;
+    // <binary> elements are decoded straight from the parsed text so we
+    // keep it. Text that already is utf-8 is used without another copy
+    const char* s = (const char*)data.data();
+    bool isUtf8 = str::StartsWith(s, UTF8_BOM);
+    if (!isUtf8 && !str::StartsWith(s, UTF16_BOM) && !str::StartsWith(s, UTF16BE_BOM)) {
+        isUtf8 = CP_ACP == GetCodepageFromPI(s) && IsValidUtf8(s);
+    }
+    if (isUtf8) {
+        text.Set(s);
+    } else {
+        TempStr tmp = DecodeTextToUtf8Temp(s, true);
+        data.Free();
+        if (!tmp) {
+            return false;
+        }
+        text.Set(str::Dup(tmp));
+    }
+    s = text.Get();
+    if (str::StartsWith(s, UTF8_BOM)) {
+        s += 3;
     }
 
-    ByteSlice data2(tmp);
+    ByteSlice data2(s);
 
     HtmlPullParser parser(data2);
     HtmlToken* tok;
@@ -969,14 +1115,17 @@ void Fb2Doc::ExtractImage(HtmlPullParser* parser, HtmlToken* tok) {
         return;
     }
 
-    ImageData data;
-    data.base = Base64Decode({(u8*)tok->s, tok->sLen});
-    if (data.base.empty()) {
+    // most images are only needed once the page showing them is laid out
+    // so we only remember where the encoded data is in text
+    ByteSlice encoded = ByteSlice((u8*)tok->s, tok->sLen);
+    if (encoded.empty()) {
         return;
     }
+    ImageData data;
     data.fileName = str::Join("#", id);
     data.fileId = images.size();
     images.Append(data);
+    imagesBase64.Append(encoded);
 }
 
 ByteSlice Fb2Doc::GetXmlData() const {
@@ -985,9 +1134,20 @@ ByteSlice Fb2Doc::GetXmlData() const {
 
 ByteSlice* Fb2Doc::GetImageData(const char* fileName) const {
     for (size_t i = 0; i < images.size(); i++) {
-        if (str::Eq(images.at(i).fileName, fileName)) {
-            return &images.at(i).base;
+        ImageData& img = images.at(i);
+        if (!str::Eq(img.fileName, fileName)) {
+            continue;
+        }
+        ScopedCritSec scope((CRITICAL_SECTION*)&imagesAccess);
+        ByteSlice& encoded = imagesBase64.at(i);
+        if (img.base.empty() && !encoded.empty()) {
+            img.base = base64::Decode(encoded);
+            encoded = {};
+        }
+        if (img.base.empty()) {
+            continue;
         }
+        return &img.base;
     }
     return nullptr;
 }
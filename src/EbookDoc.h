@@ -67,8 +67,16 @@ class Fb2Doc {
     AutoFreeStr fileName;
     IStream* stream = nullptr;
 
+    // utf-8 text of the whole file
+    AutoFree text;
     str::Str xmlData;
+    // <binary> elements are only base64-decoded when first requested.
+    // images[i].base is empty until then and imagesBase64[i] points to
+    // the still encoded data in text
     Vec<ImageData> images;
+    Vec<ByteSlice> imagesBase64;
+    // images are decoded on demand, possibly from multiple threads
+    CRITICAL_SECTION imagesAccess;
     AutoFree coverImage;
     Props props;
     bool isZipped = false;
@@ -60,6 +60,11 @@ Annotation* EngineMupdfGetAnnotationAtPos(EngineBase*, int pageNo, PointF pos, A
 ByteSlice EngineMupdfLoadAttachment(EngineBase*, int attachmentNo);
 TempStr EngineMupdfGetPdfInfo(const char* path);
 TempStr EngineMupdfGetPdfOutline(const char* path);
+TempStr GetMupdfStoreStatsTemp();
+extern int gMupdfThrottleReadKBps;
+extern bool gMupdfUseMappedFiles;
+extern char* gMupdfDocCacheDir;
+void CompactMupdfDocCache(const StrVec& keepPaths);
 
 /* EnginePs.cpp */
 
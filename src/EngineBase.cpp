@@ -209,9 +209,80 @@ TocTree::TocTree(TocItem* root) {
 }
 
 TocTree::~TocTree() {
+    delete items;
+    delete pageIndex;
     delete root;
 }
 
+void TocTree::BuildIndex() {
+    if (!items) {
+        items = new Vec<TocItem*>();
+    }
+    items->Reset();
+    if (root) {
+        // pre-order, same as VisitTreeModelItems(): root and its descendants
+        // (but not root's siblings). explicit stack because outlines can be deep
+        Vec<TocItem*> stack;
+        stack.Append(root);
+        while (stack.size() > 0) {
+            TocItem* ti = stack.Pop();
+            ti->treeIdx = (int)items->size();
+            items->Append(ti);
+            // the root's siblings are not part of the tree
+            if (ti != root && ti->next) {
+                stack.Append(ti->next);
+            }
+            if (ti->child) {
+                stack.Append(ti->child);
+            }
+        }
+    }
+    BuildPageIndex();
+}
+
+// builds pageIndex from items
+void TocTree::BuildPageIndex() {
+    if (!pageIndex) {
+        pageIndex = new Vec<TocPageIndexEntry>();
+    }
+    pageIndex->Reset();
+    for (TocItem* ti : *items) {
+        if (ti->pageNo >= 1) {
+            pageIndex->Append({ti->pageNo, ti});
+        }
+    }
+    // stable so that items with the same page stay in tree order
+    std::stable_sort(pageIndex->begin(), pageIndex->end(),
+                     [](const TocPageIndexEntry& e1, const TocPageIndexEntry& e2) { return e1.pageNo < e2.pageNo; });
+}
+
+int TocTree::ItemsCount() {
+    if (!items) {
+        BuildIndex();
+    }
+    return (int)items->size();
+}
+
+// the item closest to (at or before) pageNo. Of the items at the exact page
+// the first one in tree order wins, otherwise the last one for the closest
+// preceding page. Falls back to root if no item is before pageNo.
+TocItem* TocTree::ItemForPageNo(int pageNo) {
+    if (!items) {
+        BuildIndex();
+    }
+    auto b = pageIndex->begin();
+    auto e = pageIndex->end();
+    auto first = std::lower_bound(b, e, pageNo, [](const TocPageIndexEntry& el, int n) { return el.pageNo < n; });
+    if (first != e && first->pageNo == pageNo) {
+        return first->item;
+    }
+    if (first == b) {
+        return root;
+    }
+    // last entry of the closest preceding page
+    return (first - 1)->item;
+}
+
 TreeItem TocTree::Root() {
     return (TreeItem)root;
 }
@@ -329,6 +400,15 @@ int EngineBase::PageCount() const {
     return pageCount;
 }
 
+bool EngineBase::IsPageMediaboxProvisional(int) {
+    return false;
+}
+
+void EngineBase::MediaboxesChanged() {
+    AtomicIntInc(&mediaboxesVersion);
+    onMediaboxesChanged.Call();
+}
+
 RectF EngineBase::PageContentBox(int pageNo, RenderTarget) {
     return PageMediabox(pageNo);
 }
@@ -7,6 +7,8 @@ struct fz_link;
 enum class PageInfoState {
     Unknown,
     Known,
+    // size is a guess, the engine will know the real size later
+    Provisional,
     Error,
 };
 
@@ -290,6 +292,9 @@ struct TocItem {
     TocItem* currChild = nullptr;
     int currChildNo = 0;
 
+    // position in TocTree::items, set by TocTree::BuildIndex()
+    int treeIdx = -1;
+
     TocItem() = default;
 
     explicit TocItem(TocItem* parent, const char* title, int pageNo);
@@ -311,13 +316,30 @@ struct TocItem {
     bool PageNumbersMatch() const;
 };
 
+struct TocPageIndexEntry {
+    int pageNo = 0;
+    TocItem* item = nullptr;
+};
+
 struct TocTree : TreeModel {
     TocItem* root = nullptr;
 
+    // built by BuildIndex() on first use, so the tree must not
+    // be modified after that (or BuildIndex() must be called again)
+    // all items in tree order (pre-order, starting with root)
+    Vec<TocItem*>* items = nullptr;
+    // items with pageNo >= 1 sorted by pageNo (ties in tree order)
+    Vec<TocPageIndexEntry>* pageIndex = nullptr;
+
     TocTree() = default;
     explicit TocTree(TocItem* root);
     ~TocTree() override;
 
+    virtual void BuildIndex();
+    void BuildPageIndex();
+    int ItemsCount();
+    TocItem* ItemForPageNo(int pageNo);
+
     // TreeModel
     TreeItem Root() override;
 
@@ -381,6 +403,11 @@ class EngineBase {
     bool hideAnnotations = false;
     bool disableAntiAlias = false;
     int pageCount = -1;
+    // incremented when provisional page sizes were replaced by real ones
+    // (see IsPageMediaboxProvisional() and MediaboxesChanged())
+    AtomicInt mediaboxesVersion = 0;
+    // called after mediaboxesVersion has changed, usually on a background thread
+    Func0 onMediaboxesChanged;
 
     StrVec errors;
 
@@ -399,6 +426,11 @@ class EngineBase {
 
     // the box containing the visible page content (usually RectF(0, 0, pageWidth, pageHeight))
     virtual RectF PageMediabox(int pageNo) = 0;
+    // true if PageMediabox() is a guess (for documents with lots of pages
+    // we only get the size of first pages when loading)
+    virtual bool IsPageMediaboxProvisional(int pageNo);
+    // must be called after replacing provisional page sizes
+    void MediaboxesChanged();
     // the box inside PageMediabox that actually contains any relevant content
     // (used for auto-cropping in Fit Content mode, can be PageMediabox)
     virtual RectF PageContentBox(int pageNo, RenderTarget target = RenderTarget::View);
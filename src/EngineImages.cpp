@@ -1171,7 +1171,7 @@ Bitmap* EngineImageDir::LoadBitmapForPage(int pageNo, bool& deleteAfterUse) {
         return nullptr;
     }
     deleteAfterUse = true;
-    Bitmap* res = BitmapFromData(bmpData);
+    Bitmap* res = BitmapFromDataDecoded(bmpData);
     bmpData.Free();
     return res;
 }
@@ -1574,7 +1574,7 @@ Bitmap* EngineCbx::LoadBitmapForPage(int pageNo, bool& deleteAfterUse) {
         return nullptr;
     }
     deleteAfterUse = true;
-    auto res = BitmapFromData(img);
+    auto res = BitmapFromDataDecoded(img);
     img.Free();
     return res;
 }
@@ -9,6 +9,8 @@ extern "C" {
 
 #include "utils/BaseUtil.h"
 #include "utils/Archive.h"
+#include "utils/CryptoUtil.h"
+#include "utils/DirIter.h"
 #include "utils/ScopedWin.h"
 #include "utils/FileUtil.h"
 #include "utils/GdiPlusUtil.h"
@@ -17,8 +19,10 @@ extern "C" {
 #include "utils/HtmlPullParser.h"
 #include "utils/TrivialHtmlParser.h"
 #include "utils/WinUtil.h"
+#include "utils/WinDynCalls.h"
 #include "utils/ZipUtil.h"
 #include "utils/Timer.h"
+#include "utils/ThreadUtil.h"
 
 #include "wingui/UIModels.h"
 
@@ -403,6 +407,167 @@ static fz_stream* FzOpenIStream(fz_context* ctx, IStream* stream) {
     return stm;
 }
 
+// for benchmarking opening of large files (see "-bench file.pdf slowread")
+// if > 0, documents are read from disk at most this fast, like from a slow network share
+int gMupdfThrottleReadKBps = 0;
+
+struct throttled_file_filter {
+    fz_stream* file;
+    int kbPerSec;
+    u8 buf[64 * 1024];
+};
+
+extern "C" int next_throttled_file(fz_context* ctx, fz_stream* stm, size_t) {
+    throttled_file_filter* state = (throttled_file_filter*)stm->state;
+    size_t n = fz_read(ctx, state->file, state->buf, sizeof(state->buf));
+    ::Sleep((DWORD)((i64)n * 1000 / ((i64)state->kbPerSec * 1024)));
+    stm->rp = state->buf;
+    stm->wp = stm->rp + n;
+    stm->pos += n;
+
+    return n > 0 ? *stm->rp++ : EOF;
+}
+
+extern "C" void seek_throttled_file(fz_context* ctx, fz_stream* stm, i64 offset, int whence) {
+    throttled_file_filter* state = (throttled_file_filter*)stm->state;
+    fz_seek(ctx, state->file, offset, whence);
+    stm->pos = fz_tell(ctx, state->file);
+    stm->rp = stm->wp = state->buf;
+}
+
+extern "C" void drop_throttled_file(fz_context* ctx, void* state_) {
+    throttled_file_filter* state = (throttled_file_filter*)state_;
+    fz_drop_stream(ctx, state->file);
+    fz_free(ctx, state);
+}
+
+// takes ownership of file
+static fz_stream* FzOpenThrottledFile(fz_context* ctx, fz_stream* file, int kbPerSec) {
+    throttled_file_filter* state = nullptr;
+    fz_try(ctx) {
+        state = fz_malloc_struct(ctx, throttled_file_filter);
+    }
+    fz_catch(ctx) {
+        fz_drop_stream(ctx, file);
+        fz_rethrow(ctx);
+    }
+    state->file = file;
+    state->kbPerSec = kbPerSec;
+
+    fz_stream* stm = fz_new_stream(ctx, state, next_throttled_file, drop_throttled_file);
+    stm->seek = seek_throttled_file;
+    return stm;
+}
+
+// large files are memory-mapped so that mupdf reads directly from the mapping
+// instead of a fread() and a copy for every seek to an xref entry or object.
+// Off by default (see MapLargeFiles setting) because while a file is mapped,
+// other programs can't truncate it, which e.g. pdflatex does when re-creating it
+bool gMupdfUseMappedFiles = false;
+
+// mupdf sees a mapped file through windows of this size. When it reads a
+// window to the end (e.g. a big image stream), we ask the OS to read in the
+// next window with one I/O instead of one page fault at a time
+constexpr i64 kMappedFileWindow = 4 * 1024 * 1024;
+
+struct mapped_file_filter {
+    HANDLE hFile;
+    HANDLE hMap;
+    u8* data;
+    i64 size;
+    // end of the window returned by the last read
+    i64 windowEnd;
+};
+
+extern "C" int next_mapped_file(fz_context*, fz_stream* stm, size_t) {
+    mapped_file_filter* state = (mapped_file_filter*)stm->state;
+    i64 pos = stm->pos;
+    i64 end = std::min(pos + kMappedFileWindow, state->size);
+    if (pos >= end) {
+        return EOF;
+    }
+    bool isSequential = (pos == state->windowEnd);
+    if (isSequential && DynPrefetchVirtualMemory) {
+        // WIN32_MEMORY_RANGE_ENTRY
+        struct {
+            void* addr;
+            SIZE_T size;
+        } range{state->data + pos, (SIZE_T)(end - pos)};
+        DynPrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+    }
+    state->windowEnd = end;
+    stm->rp = state->data + pos;
+    stm->wp = state->data + end;
+    stm->pos = end;
+    return *stm->rp++;
+}
+
+extern "C" void seek_mapped_file(fz_context* ctx, fz_stream* stm, i64 offset, int whence) {
+    mapped_file_filter* state = (mapped_file_filter*)stm->state;
+    // fz_seek() has already turned SEEK_CUR into SEEK_SET
+    i64 pos = (whence == SEEK_END) ? state->size + offset : offset;
+    if (pos < 0 || pos > state->size) {
+        fz_throw(ctx, FZ_ERROR_GENERIC, "cannot seek to %lld", (long long)pos);
+    }
+    stm->pos = pos;
+    stm->rp = stm->wp = state->data;
+}
+
+extern "C" void drop_mapped_file(fz_context* ctx, void* state_) {
+    mapped_file_filter* state = (mapped_file_filter*)state_;
+    UnmapViewOfFile(state->data);
+    CloseHandle(state->hMap);
+    CloseHandle(state->hFile);
+    fz_free(ctx, state);
+}
+
+// returns nullptr if the file can't be mapped (e.g. not enough address space
+// in 32-bit builds), the caller should then fall back to fz_open_file_w()
+static fz_stream* FzOpenMappedFile(fz_context* ctx, const char* path) {
+    // reading from a mapping raises an exception instead of returning an error
+    // if e.g. a network share goes away, so only map files on local disks
+    if (!path::IsOnFixedDrive(path)) {
+        return nullptr;
+    }
+    WCHAR* pathW = ToWStrTemp(path);
+    // same sharing as fopen() so that other programs can still write the file
+    DWORD share = FILE_SHARE_READ | FILE_SHARE_WRITE;
+    HANDLE hFile = CreateFileW(pathW, GENERIC_READ, share, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return nullptr;
+    }
+    i64 size = file::GetSize(hFile);
+    HANDLE hMap = nullptr;
+    u8* data = nullptr;
+    if (size > 0) {
+        hMap = CreateFileMappingW(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    }
+    if (hMap) {
+        data = (u8*)MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
+    }
+    auto state = (mapped_file_filter*)fz_calloc_no_throw(ctx, 1, sizeof(mapped_file_filter));
+    if (!data || !state) {
+        fz_free(ctx, state);
+        if (data) {
+            UnmapViewOfFile(data);
+        }
+        if (hMap) {
+            CloseHandle(hMap);
+        }
+        CloseHandle(hFile);
+        return nullptr;
+    }
+    state->hFile = hFile;
+    state->hMap = hMap;
+    state->data = data;
+    state->size = size;
+    state->windowEnd = -1;
+
+    fz_stream* stm = fz_new_stream(ctx, state, next_mapped_file, drop_mapped_file);
+    stm->seek = seek_mapped_file;
+    return stm;
+}
+
 static void* FzMemdup(fz_context* ctx, void* p, size_t size) {
     void* res = fz_malloc_no_throw(ctx, size);
     if (!res) {
@@ -500,13 +665,26 @@ static fz_stream* FzReadMaybeFixPDF(fz_context* ctx, const char* path) {
 }
 
 static fz_stream* FzOpenOrReadFile(fz_context* ctx, const char* path) {
-    fz_stream* stm = FzReadFileIfSmall(ctx, path);
-    if (stm) {
-        return stm;
+    fz_stream* stm = nullptr;
+    // reading into memory would defeat the throttling
+    if (gMupdfThrottleReadKBps <= 0) {
+        stm = FzReadFileIfSmall(ctx, path);
+        if (stm) {
+            return stm;
+        }
     }
+    bool useMapping = gMupdfUseMappedFiles && (gMupdfThrottleReadKBps <= 0);
     WCHAR* pathW = ToWStrTemp(path);
     fz_try(ctx) {
-        stm = fz_open_file_w(ctx, pathW);
+        if (useMapping) {
+            stm = FzOpenMappedFile(ctx, path);
+        }
+        if (!stm) {
+            stm = fz_open_file_w(ctx, pathW);
+        }
+        if (gMupdfThrottleReadKBps > 0) {
+            stm = FzOpenThrottledFile(ctx, stm, gMupdfThrottleReadKBps);
+        }
     }
     fz_catch(ctx) {
         stm = nullptr;
@@ -845,7 +1023,8 @@ static LinkRectList* LinkifyText(const WCHAR* pageText, Rect* coords) {
 }
 
 // try to produce an 8-bit palette for saving some memory
-static RenderedBitmap* TryRenderAsPaletteImage(fz_pixmap* pixmap) {
+// pixmap must be rgb or bgr with alpha
+static RenderedBitmap* TryRenderAsPaletteImage(fz_pixmap* pixmap, bool isBgr) {
     int w = pixmap->w;
     int h = pixmap->h;
     int rows8 = ((w + 3) / 4) * 4;
@@ -866,9 +1045,15 @@ static RenderedBitmap* TryRenderAsPaletteImage(fz_pixmap* pixmap) {
     RGBQUAD c;
     for (int j = 0; j < h; j++) {
         for (int i = 0; i < w; i++) {
-            c.rgbRed = *source++;
-            c.rgbGreen = *source++;
-            c.rgbBlue = *source++;
+            if (isBgr) {
+                c.rgbBlue = *source++;
+                c.rgbGreen = *source++;
+                c.rgbRed = *source++;
+            } else {
+                c.rgbRed = *source++;
+                c.rgbGreen = *source++;
+                c.rgbBlue = *source++;
+            }
             c.rgbReserved = 0;
             source++;
 
@@ -955,7 +1140,7 @@ static fz_pixmap* FzConvertPixmap2(fz_context* ctx, fz_pixmap* pix, fz_colorspac
 
 static RenderedBitmap* NewRenderedFzPixmap(fz_context* ctx, fz_pixmap* pixmap) {
     if (pixmap->n == 4 && fz_colorspace_is_rgb(ctx, pixmap->colorspace)) {
-        RenderedBitmap* res = TryRenderAsPaletteImage(pixmap);
+        RenderedBitmap* res = TryRenderAsPaletteImage(pixmap, false);
         if (res) {
             return res;
         }
@@ -1165,19 +1350,12 @@ static void BuildElementsInfo(FzPageInfo* pageInfo) {
     els.Reverse();
 }
 
-static void FzLinkifyPageText(FzPageInfo* pageInfo, fz_stext_page* stext) {
-    if (!pageInfo || !stext) {
+static void FzLinkifyPageText(FzPageInfo* pageInfo) {
+    if (!pageInfo || !pageInfo->text.text) {
         return;
     }
 
-    Rect* coords;
-    WCHAR* pageText = FzTextPageToStr(stext, &coords);
-    if (!pageText) {
-        return;
-    }
-
-    LinkRectList* list = LinkifyText(pageText, coords);
-    free(pageText);
+    LinkRectList* list = LinkifyText(pageInfo->text.text, pageInfo->text.coords);
 
     for (int i = 0; i < list->links.Size(); i++) {
         fz_rect bbox = list->coords.at(i);
@@ -1201,7 +1379,6 @@ static void FzLinkifyPageText(FzPageInfo* pageInfo, fz_stext_page* stext) {
         pageInfo->autoLinks.Append(pel);
     }
     delete list;
-    free(coords);
 }
 
 static void FzFindImagePositions(fz_context* ctx, int pageNo, Vec<FitzPageImageInfo*>& images, fz_stext_page* stext) {
@@ -1611,9 +1788,58 @@ struct ContextThreadID {
     DWORD threadID = 0;
 };
 
+// all cloned contexts, used to find them for releasing
 static Vec<ContextThreadID>* gPerThreadContexts;
 static CRITICAL_SECTION gPerThreadContextsCs;
 static AtomicInt gEngineCount = 0;
+// unique for each EngineMupdf instance so that a new engine allocated
+// at the address of a deleted one doesn't match stale cache entries
+static AtomicInt gEngineGeneration = 0;
+
+// Ctx() is called very often, so each thread caches its contexts for
+// the last few engines and only goes to gPerThreadContexts on a miss
+struct CachedThreadContext {
+    EngineMupdf* engine = nullptr;
+    int generation = 0;
+    fz_context* ctx = nullptr;
+};
+
+constexpr int kCachedThreadContexts = 8;
+static thread_local CachedThreadContext gCachedThreadContexts[kCachedThreadContexts];
+static thread_local int gCachedThreadContextsNext = 0;
+
+static fz_context* FindCachedThreadContext(EngineMupdf* engine) {
+    for (auto& el : gCachedThreadContexts) {
+        if (el.engine == engine && el.generation == engine->generation) {
+            return el.ctx;
+        }
+    }
+    return nullptr;
+}
+
+static void CacheThreadContext(EngineMupdf* engine, fz_context* ctx) {
+    auto& el = gCachedThreadContexts[gCachedThreadContextsNext];
+    gCachedThreadContextsNext = (gCachedThreadContextsNext + 1) % kCachedThreadContexts;
+    el.engine = engine;
+    el.generation = engine->generation;
+    el.ctx = ctx;
+}
+
+static void RemoveCachedThreadContext(EngineMupdf* engine) {
+    for (auto& el : gCachedThreadContexts) {
+        if (el.engine == engine) {
+            el = {};
+        }
+    }
+}
+
+// all open documents share this budget for mupdf store (cached fonts,
+// images, decoded streams etc.). A single document can use all of it
+i64 gMupdfStoreBudget = 512 * 1024 * 1024;
+
+static Vec<EngineMupdf*>* gOpenEngines;
+static CRITICAL_SECTION gOpenEnginesCs;
+static AtomicInt gStoreUseCounter = 0;
 
 static void InitializeEngineMupdf() {
     auto n = AtomicIntInc(&gEngineCount);
@@ -1621,6 +1847,8 @@ static void InitializeEngineMupdf() {
     ReportIf(gPerThreadContexts);
     InitializeCriticalSection(&gPerThreadContextsCs);
     gPerThreadContexts = new Vec<ContextThreadID>();
+    InitializeCriticalSection(&gOpenEnginesCs);
+    gOpenEngines = new Vec<EngineMupdf*>();
 }
 
 static void DeInitializeEngineMupdf() {
@@ -1630,18 +1858,146 @@ static void DeInitializeEngineMupdf() {
     DeleteCriticalSection(&gPerThreadContextsCs);
     delete gPerThreadContexts;
     gPerThreadContexts = nullptr;
+    DeleteCriticalSection(&gOpenEnginesCs);
+    delete gOpenEngines;
+    gOpenEngines = nullptr;
+}
+
+// store of a document that is busy (e.g. loading or rendering a page)
+// can't be looked at without waiting, so we use its last known size
+static i64 UpdateStoreSize(EngineMupdf* e) {
+    if (!TryEnterCriticalSection(e->ctxAccess)) {
+        return e->storeSize;
+    }
+    e->storeSize = (i64)fz_store_size(e->_ctx);
+    e->storePeakSize = std::max(e->storePeakSize, e->storeSize);
+    LeaveCriticalSection(e->ctxAccess);
+    return e->storeSize;
+}
+
+// like AddRef() but fails for a document that is already being deleted
+static bool TryAddRef(EngineMupdf* e) {
+    LONG rc = e->refCount;
+    while (rc > 0) {
+        LONG prev = InterlockedCompareExchange(&e->refCount, rc + 1, rc);
+        if (prev == rc) {
+            return true;
+        }
+        rc = prev;
+    }
+    return false;
+}
+
+// how often we check if the stores of all documents are over the budget
+constexpr DWORD kTrimMupdfStoresIntervalMs = 1000;
+static AtomicInt gLastTrimMupdfStores = 0;
+
+// each document's store can grow to gMupdfStoreBudget, when the sum of all
+// of them goes over it, we evict from least recently used documents first.
+// Documents that are busy are skipped, we'll get to them next time
+// must be called without holding any of the engine's locks
+static void TrimMupdfStores(EngineMupdf* curr) {
+    curr->lastStoreUse = AtomicIntInc(&gStoreUseCounter);
+
+    DWORD now = GetTickCount();
+    LONG last = AtomicIntGet(&gLastTrimMupdfStores);
+    if (now - (DWORD)last < kTrimMupdfStoresIntervalMs) {
+        return;
+    }
+    // only one thread trims at a time
+    if (InterlockedCompareExchange(&gLastTrimMupdfStores, (LONG)now, last) != last) {
+        return;
+    }
+
+    Vec<EngineMupdf*> engines;
+    {
+        ScopedCritSec cs(&gOpenEnginesCs);
+        for (EngineMupdf* e : *gOpenEngines) {
+            if (TryAddRef(e)) {
+                engines.Append(e);
+            }
+        }
+    }
+
+    i64 total = 0;
+    for (EngineMupdf* e : engines) {
+        total += UpdateStoreSize(e);
+    }
+    i64 totalBefore = total;
+    if (total > gMupdfStoreBudget) {
+        std::sort(engines.begin(), engines.end(),
+                  [](EngineMupdf* a, EngineMupdf* b) { return a->lastStoreUse < b->lastStoreUse; });
+    }
+    for (EngineMupdf* e : engines) {
+        if (total <= gMupdfStoreBudget) {
+            break;
+        }
+        if (!TryEnterCriticalSection(e->ctxAccess)) {
+            continue;
+        }
+        i64 sizeBefore = e->storeSize;
+        i64 newSize = std::max(sizeBefore - (total - gMupdfStoreBudget), (i64)0);
+        // evicting runs drop functions so needs a context for this thread.
+        // A temporary one so that we don't keep a context per thread for
+        // every document
+        fz_context* ctx = fz_clone_context(e->_ctx);
+        if (ctx) {
+            fz_shrink_store_to(ctx, (size_t)newSize);
+            fz_drop_context(ctx);
+        }
+        e->storeSize = (i64)fz_store_size(e->_ctx);
+        LeaveCriticalSection(e->ctxAccess);
+        i64 evicted = sizeBefore - e->storeSize;
+        e->storeEvicted += evicted;
+        total -= evicted;
+    }
+    if (total != totalBefore) {
+        logf("TrimMupdfStores: %d documents, store size %s => %s, budget %s\n", engines.Size(),
+             str::FormatFileSizeTemp(totalBefore), str::FormatFileSizeTemp(total),
+             str::FormatFileSizeTemp(gMupdfStoreBudget));
+    }
+    for (EngineMupdf* e : engines) {
+        e->Release();
+    }
+}
+
+// for diagnostics: mupdf store usage of every open document
+TempStr GetMupdfStoreStatsTemp() {
+    str::Str s;
+    if (!gOpenEngines) {
+        return str::DupTemp("no open documents\n");
+    }
+    ScopedCritSec cs(&gOpenEnginesCs);
+    i64 total = 0;
+    for (EngineMupdf* e : *gOpenEngines) {
+        total += UpdateStoreSize(e);
+        const char* path = e->FilePath() ? e->FilePath() : "(no file)";
+        s.AppendFmt("%s: %s, peak: %s, evicted: %s\n", path, str::FormatFileSizeTemp(e->storeSize),
+                    str::FormatFileSizeTemp(e->storePeakSize), str::FormatFileSizeTemp(e->storeEvicted));
+    }
+    s.AppendFmt("total: %s, budget: %s\n", str::FormatFileSizeTemp(total), str::FormatFileSizeTemp(gMupdfStoreBudget));
+    return str::DupTemp(s.CStr());
 }
 
 fz_context* GetOrClonePerThreadContext(EngineMupdf* engine, fz_context* ctx) {
+    fz_context* res = FindCachedThreadContext(engine);
+    if (res) {
+        return res;
+    }
     DWORD threadID = GetCurrentThreadId();
     {
         ScopedCritSec cs(&gPerThreadContextsCs);
         for (auto& el : *gPerThreadContexts) {
             if (el.engine == engine && el.threadID == threadID) {
-                return el.ctx;
+                res = el.ctx;
+                break;
             }
         }
     }
+    if (res) {
+        CacheThreadContext(engine, res);
+        return res;
+    }
     // clone context without holding gPerThreadContextsCs to avoid deadlock
     // with threads that hold fz_locks (e.g. ctxAccess) and then call Ctx()
     // safe because only current thread can create a context for its own threadID
@@ -1651,12 +2007,14 @@ fz_context* GetOrClonePerThreadContext(EngineMupdf* engine, fz_context* ctx) {
         ContextThreadID el{engine, newCtx, threadID};
         gPerThreadContexts->Append(el);
     }
+    CacheThreadContext(engine, newCtx);
     return newCtx;
 }
 
 void ReleasePerThreadContext(EngineMupdf* engine) {
     DWORD threadID = GetCurrentThreadId();
     fz_context* ctxToDrop = nullptr;
+    RemoveCachedThreadContext(engine);
     {
         ScopedCritSec cs(&gPerThreadContextsCs);
         auto n = gPerThreadContexts->Size();
@@ -1675,8 +2033,11 @@ void ReleasePerThreadContext(EngineMupdf* engine) {
 }
 
 // Release all per-thread contexts for a given engine (called from destructor)
+// entries in other threads' caches become unreachable because no engine
+// will have the same generation
 static void ReleaseAllPerThreadContexts(EngineMupdf* engine) {
     Vec<fz_context*> ctxsToDrop;
+    RemoveCachedThreadContext(engine);
     {
         ScopedCritSec cs(&gPerThreadContextsCs);
         for (int i = (int)gPerThreadContexts->Size() - 1; i >= 0; i--) {
@@ -1694,6 +2055,7 @@ static void ReleaseAllPerThreadContexts(EngineMupdf* engine) {
 
 EngineMupdf::EngineMupdf() {
     InitializeEngineMupdf();
+    generation = AtomicIntInc(&gEngineGeneration);
     kind = kindEngineMupdf;
     defaultExt = str::Dup(".pdf");
     fileDPI = 72.0f;
@@ -1707,11 +2069,14 @@ EngineMupdf::EngineMupdf() {
     fz_locks_ctx.user = this;
     fz_locks_ctx.lock = fz_lock_context_cs;
     fz_locks_ctx.unlock = fz_unlock_context_cs;
-    _ctx = fz_new_context(nullptr, &fz_locks_ctx, FZ_STORE_DEFAULT);
+    _ctx = fz_new_context(nullptr, &fz_locks_ctx, (size_t)gMupdfStoreBudget);
     InstallFitzErrorCallbacks(this, _ctx);
 
     install_load_windows_font_funcs(_ctx);
     fz_register_document_handlers(_ctx);
+
+    ScopedCritSec cs(&gOpenEnginesCs);
+    gOpenEngines->Append(this);
 }
 
 fz_context* EngineMupdf::Ctx() const {
@@ -1719,6 +2084,10 @@ fz_context* EngineMupdf::Ctx() const {
 }
 
 EngineMupdf::~EngineMupdf() {
+    {
+        ScopedCritSec cs(&gOpenEnginesCs);
+        gOpenEngines->Remove(this);
+    }
     EnterCriticalSection(&pagesAccess);
 
     ReleaseAllPerThreadContexts(this);
@@ -1728,6 +2097,7 @@ EngineMupdf::~EngineMupdf() {
         DeleteVecMembers(pi->autoLinks);
         DeleteVecMembers(pi->comments);
         DeleteVecMembers(pi->images);
+        FreePageText(&pi->text);
         if (pi->retainedLinks) {
             fz_drop_link(ctx, pi->retainedLinks);
         }
@@ -1753,6 +2123,7 @@ EngineMupdf::~EngineMupdf() {
 
     delete pageLabels;
     delete tocTree;
+    str::Free(docCachePath);
     DeleteVecMembers(pages);
 
     for (size_t i = 0; i < dimof(mutexes); i++) {
@@ -2271,40 +2642,558 @@ static bool IsLinearizedFile(EngineMupdf* e) {
     return isLinear;
 }
 
-static void FinishNonPDFLoading(EngineMupdf* e) {
-    ScopedCritSec scope(e->ctxAccess);
+// documents with more pages get the size of the first pages when loading
+// and the rest in the background, assuming they're the same until then
+constexpr int kMaxPagesToLoadMediaboxes = 1024;
+constexpr int kPagesForMediaboxGuess = 32;
+
+// page is optional, for non-pdf documents we load the page if not given
+// must be called inside ctxAccess
+static RectF LoadPageMediabox(EngineMupdf* e, fz_context* ctx, int pageIdx, fz_page* page) {
+    fz_rect mbox{};
+    fz_matrix page_ctm{};
+    fz_page* loadedPage = nullptr;
+    fz_var(mbox);
+    fz_var(loadedPage);
+    fz_try(ctx) {
+        if (e->pdfdoc) {
+            // note: don't pdf_drop_obj() this
+            pdf_obj* pageref = pdf_lookup_page_obj(ctx, e->pdfdoc, pageIdx);
+            pdf_page_obj_transform(ctx, pageref, &mbox, &page_ctm);
+            mbox = fz_transform_rect(mbox, page_ctm);
+        } else {
+            if (!page) {
+                loadedPage = fz_load_page(ctx, e->_doc, pageIdx);
+                page = loadedPage;
+            }
+            mbox = fz_bound_page(ctx, page);
+        }
+    }
+    fz_always(ctx) {
+        fz_drop_page(ctx, loadedPage);
+    }
+    fz_catch(ctx) {
+        fz_report_error(ctx);
+        mbox = {};
+    }
+    if (fz_is_empty_rect(mbox)) {
+        logfa("cannot find page size for page %d\n", pageIdx);
+        mbox.x0 = 0;
+        mbox.y0 = 0;
+        mbox.x1 = 612;
+        mbox.y1 = 792;
+    }
+    return ToRectF(mbox);
+}
 
+// must be called outside of ctxAccess
+static void LoadProvisionalMediaboxes(EngineMupdf* e) {
     auto ctx = e->Ctx();
+    auto timeStart = TimeGet();
+    int nLoaded = 0;
+    bool changed = false;
     for (int i = 0; i < e->pageCount; i++) {
-        fz_rect mbox{};
-        fz_matrix page_ctm{};
-        fz_page* page = nullptr;
-        fz_var(page);
-        fz_var(mbox);
-        fz_try(ctx) {
-            page = nullptr;
-            page = fz_load_page(ctx, e->_doc, i);
-            mbox = fz_bound_page(ctx, page);
+        // stop if the document has been closed
+        if (e->refCount == 1) {
+            break;
         }
-        fz_always(ctx) {
-            fz_drop_page(ctx, page);
+        FzPageInfo* pi = e->pages[i];
+        // lock for each page so that we don't block rendering
+        ScopedCritSec scope(e->ctxAccess);
+        // might have been loaded on demand by GetFzPageInfo()
+        if (!pi->mediaboxProvisional) {
+            continue;
+        }
+        RectF mbox = LoadPageMediabox(e, ctx, i, nullptr);
+        changed |= (mbox != pi->mediabox);
+        pi->mediabox = mbox;
+        AtomicBoolSet(&pi->mediaboxProvisional, false);
+        nLoaded++;
+    }
+    if (changed) {
+        e->MediaboxesChanged();
+    }
+    logf("LoadProvisionalMediaboxes: loaded %d page sizes in %.2f ms\n", nLoaded, TimeSinceInMs(timeStart));
+}
+
+static void SaveDocCache(EngineMupdf* e);
+
+static void LoadProvisionalMediaboxesThread(EngineMupdf* e) {
+    LoadProvisionalMediaboxes(e);
+    SaveDocCache(e);
+    ReleasePerThreadContext(e);
+    e->Release();
+}
+
+// pick the most common size among first pages as the guess for the rest
+static RectF GuessPageMediabox(EngineMupdf* e, int nKnown) {
+    RectF res = e->pages[0]->mediabox;
+    int resCount = 0;
+    for (int i = 0; i < nKnown; i++) {
+        RectF mbox = e->pages[i]->mediabox;
+        int count = 0;
+        for (int j = 0; j < nKnown; j++) {
+            if (e->pages[j]->mediabox == mbox) {
+                count++;
+            }
+        }
+        if (count > resCount) {
+            res = mbox;
+            resCount = count;
+        }
+    }
+    return res;
+}
+
+// getting the size of a page is slow (needs the page object for pdf
+// and loading the page for other documents), so for documents with lots
+// of pages we only do the first pages upfront
+// must be called inside ctxAccess
+static void LoadMediaboxes(EngineMupdf* e) {
+    auto ctx = e->Ctx();
+    int pageCount = e->pageCount;
+    int nKnown = pageCount;
+    if (pageCount > kMaxPagesToLoadMediaboxes) {
+        nKnown = kPagesForMediaboxGuess;
+    }
+    for (int i = 0; i < nKnown; i++) {
+        e->pages[i]->mediabox = LoadPageMediabox(e, ctx, i, nullptr);
+    }
+    if (nKnown == pageCount) {
+        return;
+    }
+    RectF guess = GuessPageMediabox(e, nKnown);
+    for (int i = nKnown; i < pageCount; i++) {
+        FzPageInfo* pi = e->pages[i];
+        pi->mediabox = guess;
+        pi->mediaboxProvisional = true;
+    }
+    e->AddRef();
+    RunAsync(MkFunc0(LoadProvisionalMediaboxesThread, e), "LoadMediaboxesThread");
+}
+
+/* Cache of parsed document data.
+
+Getting the size of every page (each page object has to be read from
+all over the file), the outline and page labels of a large pdf document
+takes long and is the same every time the document is opened. If
+gMupdfDocCacheDir is set, we save them to a file in that directory
+named after the document's path and use them when the document is opened
+again, if its quick fingerprint, size and modification time are the same.
+Otherwise the file is replaced, so there's at most one per document.
+CompactMupdfDocCache() removes files of documents no longer in history
+and limits the age and total size of the rest.
+
+A cache file is DocCacheHeader followed by:
+- pageCount mediaboxes (4 floats)
+- pageCount page labels (if kDocCacheHasLabels)
+- outline items (if kDocCacheHasOutline), depth first. Each has title,
+  uri, page, x, y, is open, style (fz_outline flags and r, g, b packed
+  into a u32) and kOutlineHas* flags for what follows it
+Strings are u32 length and utf-8 data, length kDocCacheNullStr for nullptr.
+
+We don't cache password protected documents as that would put
+their content on disk unencrypted.
+*/
+
+char* gMupdfDocCacheDir = nullptr;
+
+// smaller documents load fast enough
+constexpr int kMinPagesForDocCache = 100;
+
+constexpr u32 kDocCacheMagic = 0x43444d53; // "SMDC"
+constexpr u32 kDocCacheVersion = 3;
+constexpr u32 kDocCacheHasLabels = 0x1;
+constexpr u32 kDocCacheHasOutline = 0x2;
+constexpr u32 kDocCacheNullStr = 0xffffffff;
+constexpr u32 kOutlineHasChild = 0x1;
+constexpr u32 kOutlineHasNext = 0x2;
+constexpr int kMaxOutlineDepth = 256;
+// see CompactMupdfDocCache()
+constexpr int kDocCacheMaxAgeDays = 90;
+constexpr i64 kDocCacheMaxSize = 64 * 1024 * 1024;
+
+struct DocCacheHeader {
+    u32 magic;
+    u32 version;
+    i64 fileSize;
+    FILETIME modified;
+    i32 pageCount;
+    u32 flags;
+    u8 fingerprint[16];
+};
+
+static_assert(sizeof(DocCacheHeader) == 48);
+
+struct DocCacheReader {
+    ByteSlice d;
+    size_t off = 0;
+    bool ok = true;
+
+    bool Read(void* dst, size_t n) {
+        if (!ok || d.size() - off < n) {
+            ok = false;
+            memset(dst, 0, n);
+            return false;
+        }
+        memcpy(dst, d.data() + off, n);
+        off += n;
+        return true;
+    }
+    u32 U32() {
+        u32 v;
+        Read(&v, sizeof(v));
+        return v;
+    }
+    float Float() {
+        float v;
+        Read(&v, sizeof(v));
+        return v;
+    }
+    // returns nullptr for nullptr string or if there's not enough data
+    const char* Str(u32* lenOut) {
+        u32 n = U32();
+        *lenOut = 0;
+        if (!ok || n == kDocCacheNullStr) {
+            return nullptr;
+        }
+        if (d.size() - off < n) {
+            ok = false;
+            return nullptr;
+        }
+        const char* s = (const char*)d.data() + off;
+        off += n;
+        *lenOut = n;
+        return s;
+    }
+    char* FzStr(fz_context* ctx) {
+        u32 n;
+        const char* s = Str(&n);
+        if (!s) {
+            return nullptr;
+        }
+        char* res = (char*)fz_malloc(ctx, (size_t)n + 1);
+        memcpy(res, s, n);
+        res[n] = 0;
+        return res;
+    }
+};
+
+static void DocCacheWriteU32(str::Str& s, u32 v) {
+    s.Append((const char*)&v, sizeof(v));
+}
+
+static void DocCacheWriteFloat(str::Str& s, float v) {
+    s.Append((const char*)&v, sizeof(v));
+}
+
+static void DocCacheWriteStr(str::Str& s, const char* v) {
+    if (!v) {
+        DocCacheWriteU32(s, kDocCacheNullStr);
+        return;
+    }
+    u32 n = (u32)str::Len(v);
+    DocCacheWriteU32(s, n);
+    s.Append(v, n);
+}
+
+static void DocCacheWriteOutline(str::Str& s, fz_outline* outline, int depth) {
+    for (; outline; outline = outline->next) {
+        DocCacheWriteStr(s, outline->title);
+        DocCacheWriteStr(s, outline->uri);
+        DocCacheWriteU32(s, (u32)outline->page.chapter);
+        DocCacheWriteU32(s, (u32)outline->page.page);
+        DocCacheWriteFloat(s, outline->x);
+        DocCacheWriteFloat(s, outline->y);
+        DocCacheWriteU32(s, outline->is_open);
+        u32 style = outline->flags | (outline->r << 8) | (outline->g << 16) | ((u32)outline->b << 24);
+        DocCacheWriteU32(s, style);
+        // deeper levels are dropped rather than risk a stack overflow when reading
+        bool hasChild = outline->down && depth < kMaxOutlineDepth;
+        u32 flags = hasChild ? kOutlineHasChild : 0;
+        flags |= outline->next ? kOutlineHasNext : 0;
+        DocCacheWriteU32(s, flags);
+        if (hasChild) {
+            DocCacheWriteOutline(s, outline->down, depth + 1);
+        }
+    }
+}
+
+// items are linked into *dst as soon as they're created so that
+// the caller can free everything read so far if this throws
+static void DocCacheReadOutline(fz_context* ctx, DocCacheReader& r, fz_outline** dst, int depth) {
+    while (r.ok) {
+        fz_outline* item = fz_new_outline(ctx);
+        *dst = item;
+        dst = &item->next;
+        item->title = r.FzStr(ctx);
+        item->uri = r.FzStr(ctx);
+        item->page.chapter = (int)r.U32();
+        item->page.page = (int)r.U32();
+        item->x = r.Float();
+        item->y = r.Float();
+        item->is_open = r.U32() != 0;
+        u32 style = r.U32();
+        item->flags = style & 0x7f;
+        item->r = (style >> 8) & 0xff;
+        item->g = (style >> 16) & 0xff;
+        item->b = (style >> 24) & 0xff;
+        u32 flags = r.U32();
+        if (flags & kOutlineHasChild) {
+            if (depth >= kMaxOutlineDepth) {
+                r.ok = false;
+                return;
+            }
+            DocCacheReadOutline(ctx, r, &item->down, depth + 1);
+        }
+        if (!(flags & kOutlineHasNext)) {
+            return;
+        }
+    }
+}
+
+// md5 of the file size and its first and last 64 kB. Much faster than
+// FzStreamFingerprint() for large files and the end of a pdf file
+// changes with every save
+static bool FzStreamQuickFingerprint(fz_context* ctx, fz_stream* stm, i64 fileSize, u8 digest[16]) {
+    constexpr i64 kPartSize = 64 * 1024;
+    i64 partSize = std::min(kPartSize, fileSize);
+    size_t dataSize = sizeof(fileSize) + 2 * (size_t)partSize;
+    u8* data = AllocArray<u8>(dataSize);
+    memcpy(data, &fileSize, sizeof(fileSize));
+    bool ok = true;
+    fz_try(ctx) {
+        i64 pos = fz_tell(ctx, stm);
+        u8* curr = data + sizeof(fileSize);
+        fz_seek(ctx, stm, 0, SEEK_SET);
+        fz_read(ctx, stm, curr, (size_t)partSize);
+        fz_seek(ctx, stm, fileSize - partSize, SEEK_SET);
+        fz_read(ctx, stm, curr + partSize, (size_t)partSize);
+        fz_seek(ctx, stm, pos, SEEK_SET);
+    }
+    fz_catch(ctx) {
+        fz_report_error(ctx);
+        ok = false;
+    }
+    if (ok) {
+        CalcMD5Digest(data, (int)dataSize, digest);
+    }
+    free(data);
+    return ok;
+}
+
+static TempStr GetDocCachePathTemp(const char* filePath) {
+    u8 digest[16];
+    CalcMD5Digest((u8*)filePath, str::Leni(filePath), digest);
+    AutoFreeStr name = str::MemToHex(digest, dimof(digest));
+    return path::JoinTemp(gMupdfDocCacheDir, str::JoinTemp(name, ".dat"));
+}
+
+// sets page sizes, outline and page labels if they're in the cache
+// must be called inside ctxAccess
+static bool LoadDocCache(EngineMupdf* e) {
+    const char* path = e->FilePath();
+    if (!gMupdfDocCacheDir || !path || !e->pdfdoc || e->isPasswordProtected) {
+        return false;
+    }
+    if (e->pageCount < kMinPagesForDocCache) {
+        return false;
+    }
+    // e.g. a stream embedded in a pdf document
+    i64 fileSize = file::GetSize(path);
+    if (fileSize <= 0) {
+        return false;
+    }
+    auto ctx = e->Ctx();
+    u8 digest[16];
+    if (!FzStreamQuickFingerprint(ctx, e->pdfdoc->file, fileSize, digest)) {
+        return false;
+    }
+    TempStr cachePath = GetDocCachePathTemp(path);
+    // from now on we can save the cache for this document, see SaveDocCache()
+    str::ReplaceWithCopy(&e->docCachePath, cachePath);
+    e->docCacheFileSize = fileSize;
+    e->docCacheModified = file::GetModificationTime(path);
+    memcpy(e->docCacheFingerprint, digest, sizeof(digest));
+
+    ByteSlice d = file::ReadFile(cachePath);
+    if (d.empty()) {
+        return false;
+    }
+    AutoFree freeData(d.data());
+    DocCacheReader r{d};
+    DocCacheHeader hdr;
+    r.Read(&hdr, sizeof(hdr));
+    if (!r.ok || hdr.magic != kDocCacheMagic || hdr.version != kDocCacheVersion) {
+        return false;
+    }
+    bool isSameFile = hdr.fileSize == fileSize && CompareFileTime(&hdr.modified, &e->docCacheModified) == 0;
+    isSameFile = isSameFile && memeq(hdr.fingerprint, digest, sizeof(digest));
+    if (!isSameFile || hdr.pageCount != e->pageCount) {
+        // the document has changed, SaveDocCache() will write a new one
+        file::Delete(cachePath);
+        return false;
+    }
+
+    int pageCount = e->pageCount;
+    Vec<RectF> mediaboxes;
+    for (int i = 0; i < pageCount; i++) {
+        RectF mbox;
+        mbox.x = r.Float();
+        mbox.y = r.Float();
+        mbox.dx = r.Float();
+        mbox.dy = r.Float();
+        mediaboxes.Append(mbox);
+    }
+    StrVec* labels = nullptr;
+    if (hdr.flags & kDocCacheHasLabels) {
+        labels = new StrVec();
+        for (int i = 0; i < pageCount && r.ok; i++) {
+            u32 n;
+            const char* s = r.Str(&n);
+            labels->Append(s ? s : "", (int)n);
+        }
+    }
+    fz_outline* outline = nullptr;
+    if (hdr.flags & kDocCacheHasOutline) {
+        fz_try(ctx) {
+            DocCacheReadOutline(ctx, r, &outline, 0);
         }
         fz_catch(ctx) {
             fz_report_error(ctx);
-            mbox = {};
+            r.ok = false;
         }
-        if (fz_is_empty_rect(mbox)) {
-            fz_warn(ctx, "cannot find page size for page %d", i);
-            mbox.x0 = 0;
-            mbox.y0 = 0;
-            mbox.x1 = 612;
-            mbox.y1 = 792;
+    }
+    if (!r.ok) {
+        logfa("LoadDocCache: '%s' is corrupted\n", cachePath);
+        delete labels;
+        fz_drop_outline(ctx, outline);
+        return false;
+    }
+
+    for (int i = 0; i < pageCount; i++) {
+        e->pages[i]->mediabox = mediaboxes[i];
+    }
+    e->pageLabels = labels;
+    e->hasPageLabels = (labels != nullptr);
+    e->outline = outline;
+
+    // CompactMupdfDocCache() removes files that haven't been used for a while
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    file::SetModificationTime(cachePath, now);
+    return true;
+}
+
+// must be called once all page sizes are known
+static void SaveDocCache(EngineMupdf* e) {
+    if (!e->docCachePath || e->fromDocCache) {
+        return;
+    }
+    for (FzPageInfo* pi : e->pages) {
+        // e.g. the document has been closed before we've loaded all of them
+        if (pi->mediaboxProvisional) {
+            return;
         }
-        FzPageInfo* pageInfo = e->pages.at(i);
-        pageInfo->mediabox = ToRectF(mbox);
-        pageInfo->pageNo = i + 1;
     }
 
+    DocCacheHeader hdr{};
+    hdr.magic = kDocCacheMagic;
+    hdr.version = kDocCacheVersion;
+    hdr.fileSize = e->docCacheFileSize;
+    hdr.modified = e->docCacheModified;
+    hdr.pageCount = e->pageCount;
+    hdr.flags = e->pageLabels ? kDocCacheHasLabels : 0;
+    hdr.flags |= e->outline ? kDocCacheHasOutline : 0;
+    memcpy(hdr.fingerprint, e->docCacheFingerprint, sizeof(hdr.fingerprint));
+
+    str::Str s;
+    s.Append((const char*)&hdr, sizeof(hdr));
+    for (FzPageInfo* pi : e->pages) {
+        RectF mbox = pi->mediabox;
+        DocCacheWriteFloat(s, mbox.x);
+        DocCacheWriteFloat(s, mbox.y);
+        DocCacheWriteFloat(s, mbox.dx);
+        DocCacheWriteFloat(s, mbox.dy);
+    }
+    if (e->pageLabels) {
+        for (char* label : *e->pageLabels) {
+            DocCacheWriteStr(s, label);
+        }
+    }
+    DocCacheWriteOutline(s, e->outline, 0);
+
+    dir::CreateAll(gMupdfDocCacheDir);
+    bool ok = file::WriteFile(e->docCachePath, s.AsByteSlice());
+    if (!ok) {
+        logfa("SaveDocCache: failed to write '%s'\n", e->docCachePath);
+    }
+}
+
+struct DocCacheFile {
+    char* path = nullptr;
+    FILETIME modified{};
+    i64 size = 0;
+};
+
+// like the thumbnail cache, only keeps files of documents in keepPaths
+// (usually file history). Of those, files that haven't been used in
+// kDocCacheMaxAgeDays are removed and, least recently used first, those
+// that don't fit in kDocCacheMaxSize
+void CompactMupdfDocCache(const StrVec& keepPaths) {
+    if (!gMupdfDocCacheDir || !dir::Exists(gMupdfDocCacheDir)) {
+        return;
+    }
+    StrVec keepNames;
+    for (char* path : keepPaths) {
+        keepNames.Append(path::GetBaseNameTemp(GetDocCachePathTemp(path)));
+    }
+
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    int nDeleted = 0;
+    Vec<DocCacheFile> files;
+    DirIter di{gMupdfDocCacheDir};
+    for (DirIterEntry* de : di) {
+        FILETIME modified = de->fd->ftLastWriteTime;
+        bool keep = keepNames.Contains(de->name);
+        keep = keep && FileTimeDiffInSecs(now, modified) <= kDocCacheMaxAgeDays * 24 * 60 * 60;
+        if (!keep) {
+            file::Delete(de->filePath);
+            nDeleted++;
+            continue;
+        }
+        DocCacheFile f;
+        f.path = str::DupTemp(de->filePath);
+        f.modified = modified;
+        f.size = GetFileSize(de->fd);
+        files.Append(f);
+    }
+
+    // most recently used first
+    std::sort(files.begin(), files.end(), [](const DocCacheFile& a, const DocCacheFile& b) {
+        return CompareFileTime(&a.modified, &b.modified) > 0;
+    });
+    i64 totalSize = 0;
+    int nKept = 0;
+    for (DocCacheFile& f : files) {
+        totalSize += f.size;
+        if (totalSize > kDocCacheMaxSize) {
+            file::Delete(f.path);
+            nDeleted++;
+        } else {
+            nKept++;
+        }
+    }
+    logf("CompactMupdfDocCache: kept %d, deleted %d files\n", nKept, nDeleted);
+}
+
+static void FinishNonPDFLoading(EngineMupdf* e) {
+    ScopedCritSec scope(e->ctxAccess);
+
+    auto ctx = e->Ctx();
+    LoadMediaboxes(e);
+
     fz_try(ctx) {
         e->outline = fz_load_outline(ctx, e->_doc);
     }
@@ -2343,6 +3232,7 @@ bool EngineMupdf::FinishLoading() {
 
     for (int i = 0; i < pageCount; i++) {
         auto pi = new FzPageInfo();
+        pi->pageNo = i + 1;
         pages.Append(pi);
     }
     if (!pdfdoc) {
@@ -2350,38 +3240,31 @@ bool EngineMupdf::FinishLoading() {
         return true;
     }
 
+    // TODO: support javascript
+    ReportIf(pdf_js_supported(ctx, pdfdoc));
+
     ScopedCritSec scope(ctxAccess);
 
-    for (int pageNo = 0; pageNo < pageCount; pageNo++) {
-        pdf_obj* pageref = nullptr;
-        fz_rect mbox{};
-        fz_matrix page_ctm{};
-        fz_var(pageref);
-        fz_var(mbox);
-        fz_try(ctx) {
-            // note: don't pdf_drop_obj() this
-            pageref = pdf_lookup_page_obj(ctx, pdfdoc, pageNo);
-            pdf_page_obj_transform(ctx, pageref, &mbox, &page_ctm);
-            mbox = fz_transform_rect(mbox, page_ctm);
-        }
-        fz_catch(ctx) {
-            fz_report_error(ctx);
-            mbox = {};
-        }
-        if (fz_is_empty_rect(mbox)) {
-            logfa("cannot find page size for page %d", pageNo);
-            mbox.x0 = 0;
-            mbox.y0 = 0;
-            mbox.x1 = 612;
-            mbox.y1 = 792;
-        }
-        FzPageInfo* pageInfo = pages[pageNo];
-        pageInfo->mediabox = ToRectF(mbox);
-        pageInfo->pageNo = pageNo + 1;
+    fromDocCache = LoadDocCache(this);
+
+    if (!fromDocCache) {
+        LoadMediaboxes(this);
     }
+    LoadPdfDocumentInfo();
+    SaveDocCache(this);
+    return true;
+}
+
+// loads outline, attachments, document properties and page labels
+// (outline and page labels might've come from the doc cache)
+// must be called inside ctxAccess
+void EngineMupdf::LoadPdfDocumentInfo() {
+    auto ctx = Ctx();
 
     fz_try(ctx) {
-        outline = fz_load_outline(ctx, _doc);
+        if (!fromDocCache) {
+            outline = fz_load_outline(ctx, _doc);
+        }
     }
     fz_catch(ctx) {
         fz_report_error(ctx);
@@ -2449,7 +3332,7 @@ bool EngineMupdf::FinishLoading() {
     fz_var(labels);
     fz_try(ctx) {
         labels = pdf_dict_getp(ctx, pdf_trailer(ctx, pdfdoc), "Root/PageLabels");
-        if (labels) {
+        if (labels && !fromDocCache) {
             pageLabels = BuildPageLabelVec(ctx, labels, PageCount());
         }
     }
@@ -2460,11 +3343,6 @@ bool EngineMupdf::FinishLoading() {
     if (pageLabels) {
         hasPageLabels = true;
     }
-
-    // TODO: support javascript
-    ReportIf(pdf_js_supported(ctx, pdfdoc));
-
-    return true;
 }
 
 static NO_INLINE IPageDestination* DestFromAttachment(EngineMupdf* engine, fz_outline* outline) {
@@ -2654,11 +3532,12 @@ IPageDestination* EngineMupdf::GetNamedDest(const char* name) {
 #endif
 
 // return a page but only if is fully loaded
+// page might be unloaded, links, images and elements are still valid
 FzPageInfo* EngineMupdf::GetFzPageInfoFast(int pageNo) {
     ScopedCritSec scope(&pagesAccess);
     ReportIf(pageNo < 1 || pageNo > pageCount);
     FzPageInfo* pageInfo = pages[pageNo - 1];
-    if (!pageInfo->page || !pageInfo->fullyLoaded) {
+    if (!pageInfo->fullyLoaded) {
         return nullptr;
     }
     return pageInfo;
@@ -2825,11 +3704,96 @@ fz_stext_page* fz_new_stext_page_from_page2(fz_context* ctx, fz_page* page, cons
     return text;
 }
 
+// rough estimate of memory used by fz_page, its text is counted separately
+constexpr i64 kFzPageSizeEstimate = 32 * 1024;
+
+static i64 PageTextSize(PageText* text) {
+    return (i64)text->len * (sizeof(WCHAR) + sizeof(Rect));
+}
+
+// text extracted when fully loading a page is only kept for a few most
+// recently loaded pages because ExtractPageText() is usually called right
+// after (e.g. when searching or selecting text)
+constexpr int kMaxPagesWithText = 4;
+
+// must be called inside pagesAccess
+static void DropPageText(EngineMupdf* e, FzPageInfo* pageInfo) {
+    if (!pageInfo->text.text) {
+        return;
+    }
+    e->loadedPagesSize -= PageTextSize(&pageInfo->text);
+    FreePageText(&pageInfo->text);
+    e->pagesWithText.Remove(pageInfo);
+}
+
+// must be called inside pagesAccess
+static void KeepPageText(EngineMupdf* e, FzPageInfo* pageInfo) {
+    if (!pageInfo->text.text) {
+        return;
+    }
+    e->loadedPagesSize += PageTextSize(&pageInfo->text);
+    e->pagesWithText.Append(pageInfo);
+    while (e->pagesWithText.Size() > kMaxPagesWithText) {
+        DropPageText(e, e->pagesWithText[0]);
+    }
+}
+
+// pdf_annot in Annotation* wrappers belong to pdf_page so we can't unload
+// pages that have them or have been edited
+static bool CanUnloadPage(FzPageInfo* pageInfo, u32 currUse) {
+    if (!pageInfo->page || pageInfo->pinCount > 0 || pageInfo->lastUse == currUse) {
+        return false;
+    }
+    return pageInfo->annotations.Size() == 0 && !pageInfo->annotationsModified;
+}
+
+// drop fz_page of least recently used pages if we have too many loaded
+// links, elements and images are kept because they might be referenced from ui
+// (fz_link borrows pdf_page but only uses it when modifying the link)
+// must be called inside pagesAccess and ctxAccess
+void EngineMupdf::UnloadPagesIfNeeded(fz_context* ctx) {
+    if (nLoadedPages <= maxLoadedPages && loadedPagesSize <= maxLoadedPagesSize) {
+        return;
+    }
+    Vec<FzPageInfo*> toUnload;
+    for (FzPageInfo* pi : pages) {
+        if (CanUnloadPage(pi, pageUseCounter)) {
+            toUnload.Append(pi);
+        }
+    }
+    std::sort(toUnload.begin(), toUnload.end(), [](FzPageInfo* a, FzPageInfo* b) { return a->lastUse < b->lastUse; });
+
+    // go below the limits so that we don't do this on every page load
+    int maxPages = maxLoadedPages - maxLoadedPages / 4;
+    i64 maxSize = maxLoadedPagesSize - maxLoadedPagesSize / 4;
+    int nUnloaded = 0;
+    for (FzPageInfo* pi : toUnload) {
+        if (nLoadedPages <= maxPages && loadedPagesSize <= maxSize) {
+            break;
+        }
+        fz_drop_page(ctx, pi->page);
+        pi->page = nullptr;
+        loadedPagesSize -= kFzPageSizeEstimate;
+        DropPageText(this, pi);
+        nLoadedPages--;
+        nUnloaded++;
+    }
+    logf("EngineMupdf::UnloadPagesIfNeeded: unloaded %d pages, %d loaded\n", nUnloaded, nLoadedPages);
+}
+
+void EngineMupdf::UnpinFzPageInfo(FzPageInfo* pageInfo) {
+    ScopedCritSec scope(&pagesAccess);
+    ReportIf(pageInfo->pinCount <= 0);
+    pageInfo->pinCount--;
+}
+
 // Maybe: handle FZ_ERROR_TRYLATER, which can happen when parsing from network.
 // (I don't think we read from network now).
-// Maybe: when loading fully, cache extracted text in FzPageInfo
-// so that we don't have to re-do fz_new_stext_page_from_page() when doing search
-FzPageInfo* EngineMupdf::GetFzPageInfo(int pageNo, bool loadQuick, fz_cookie* cookie) {
+// when loading fully, we extract text once and use it for auto-detecting links,
+// finding images and keep it for ExtractPageText() (see kMaxPagesWithText)
+// page might have been unloaded by UnloadPagesIfNeeded(), in which case we
+// re-load it. Callers that use page outside of pagesAccess must pin it
+FzPageInfo* EngineMupdf::GetFzPageInfo(int pageNo, bool loadQuick, fz_cookie* cookie, bool pin) {
     auto ctx = Ctx();
     // TODO: minimize time spent under pagesAccess when fully loading
     ScopedCritSec scope(&pagesAccess);
@@ -2840,6 +3804,7 @@ FzPageInfo* EngineMupdf::GetFzPageInfo(int pageNo, bool loadQuick, fz_cookie* co
     }
     int pageIdx = pageNo - 1;
     FzPageInfo* pageInfo = pages[pageIdx];
+    pageInfo->lastUse = ++pageUseCounter;
 
     ScopedCritSec ctxScope(ctxAccess);
     if (!pageInfo->page) {
@@ -2849,12 +3814,29 @@ FzPageInfo* EngineMupdf::GetFzPageInfo(int pageNo, bool loadQuick, fz_cookie* co
         fz_catch(ctx) {
             fz_report_error(ctx);
         }
+        if (pageInfo->page) {
+            nLoadedPages++;
+            loadedPagesSize += kFzPageSizeEstimate;
+            UnloadPagesIfNeeded(ctx);
+        }
+        if (pageInfo->page && pageInfo->mediaboxProvisional) {
+            RectF mbox = LoadPageMediabox(this, ctx, pageIdx, pageInfo->page);
+            bool changed = (mbox != pageInfo->mediabox);
+            pageInfo->mediabox = mbox;
+            AtomicBoolSet(&pageInfo->mediaboxProvisional, false);
+            if (changed) {
+                MediaboxesChanged();
+            }
+        }
     }
 
     fz_page* page = pageInfo->page;
     if (!page) {
         return nullptr;
     }
+    if (pin) {
+        pageInfo->pinCount++;
+    }
 
     // build annotations info on first access
     if (pdfdoc && pageInfo->annotations.Size() == 0) {
@@ -2907,12 +3889,28 @@ FzPageInfo* EngineMupdf::GetFzPageInfo(int pageNo, bool loadQuick, fz_cookie* co
         return pageInfo;
     }
 
-    FzLinkifyPageText(pageInfo, stext);
+    // image blocks are ignored when converting to text
+    PageText& text = pageInfo->text;
+    text.text = FzTextPageToStr(stext, &text.coords);
+    text.len = (int)str::Len(text.text);
+    FzLinkifyPageText(pageInfo);
     FzFindImagePositions(ctx, pageNo, pageInfo->images, stext);
     fz_drop_stext_page(ctx, stext);
+    if (cookie && cookie->abort) {
+        // rendering was aborted so the text is incomplete. ExtractPageText()
+        // must extract it again or search and copy would miss some of it
+        FreePageText(&text);
+    } else {
+        KeepPageText(this, pageInfo);
+    }
     return pageInfo;
 }
 
+// doesn't lock so that ui doesn't wait for render threads. The size might be
+// changed from provisional to real while we read it, which is fine because
+// the ui re-layouts when that happens (see mediaboxesVersion). The real size
+// is set before mediaboxProvisional is cleared, so if IsPageMediaboxProvisional()
+// returned false before calling this, we get the real size
 RectF EngineMupdf::PageMediabox(int pageNo) {
     ReportIf(pageNo < 1 || pageNo > pageCount);
     if (pageNo < 1 || pageNo > pageCount) return {};
@@ -2920,10 +3918,18 @@ RectF EngineMupdf::PageMediabox(int pageNo) {
     return pi->mediabox;
 }
 
+bool EngineMupdf::IsPageMediaboxProvisional(int pageNo) {
+    ReportIf(pageNo < 1 || pageNo > pageCount);
+    if (pageNo < 1 || pageNo > pageCount) return false;
+    FzPageInfo* pi = pages[pageNo - 1];
+    return AtomicBoolGet(&pi->mediaboxProvisional);
+}
+
 RectF EngineMupdf::PageContentBox(int pageNo, RenderTarget target) {
     auto ctx = Ctx();
 
-    FzPageInfo* pageInfo = GetFzPageInfo(pageNo, false);
+    FzPageInfo* pageInfo = GetFzPageInfo(pageNo, false, nullptr, true);
+    ScopedPinFzPage pin(this, pageInfo);
     if (!pageInfo) {
         // maybe should return a dummy size. not sure how this
         // will play with layout. The page should fail to render
@@ -2998,6 +4004,7 @@ RectF EngineMupdf::Transform(const RectF& rect, int pageNo, float zoom, int rota
 }
 
 RenderedBitmap* EngineMupdf::RenderPage(RenderPageArgs& args) {
+    TrimMupdfStores(this);
     auto ctx = Ctx();
     auto pageNo = args.pageNo;
 
@@ -3009,14 +4016,13 @@ RenderedBitmap* EngineMupdf::RenderPage(RenderPageArgs& args) {
         fzcookie = (fz_cookie*)cookie->GetData();
     }
 
-    FzPageInfo* pageInfo = GetFzPageInfo(pageNo, false, fzcookie);
+    FzPageInfo* pageInfo = GetFzPageInfo(pageNo, false, fzcookie, true);
+    ScopedPinFzPage pin(this, pageInfo);
     if (!pageInfo || !pageInfo->page) {
         return nullptr;
     }
     fz_page* page = pageInfo->page;
 
-    ScopedCritSec cs(ctxAccess);
-
     if (disableAntiAlias) {
         fz_set_aa_level(ctx, 0);
     } else {
@@ -3027,26 +4033,6 @@ RenderedBitmap* EngineMupdf::RenderPage(RenderPageArgs& args) {
     auto pageRect = args.pageRect;
     auto zoom = args.zoom;
     auto rotation = args.rotation;
-    fz_rect pRect;
-    if (pageRect) {
-        pRect = ToFzRect(*pageRect);
-    } else {
-        // TODO(port): use pageInfo->mediabox?
-        pRect = fz_bound_page(ctx, page);
-    }
-    fz_matrix ctm = viewctm(page, zoom, rotation);
-    fz_irect bbox = fz_round_rect(fz_transform_rect(pRect, ctm));
-
-    fz_colorspace* csRgb = fz_device_rgb(ctx);
-    fz_irect ibounds = bbox;
-
-    fz_pixmap* pix = nullptr;
-    fz_device* dev = nullptr;
-    RenderedBitmap* bitmap = nullptr;
-
-    fz_var(dev);
-    fz_var(pix);
-    fz_var(bitmap);
 
     const char* usage = "View";
     switch (args.target) {
@@ -3055,60 +4041,99 @@ RenderedBitmap* EngineMupdf::RenderPage(RenderPageArgs& args) {
             break;
     }
 
-    pdf_page* pdfpage = nullptr;
-    fz_var(pdfpage);
-    if (pdfdoc) {
+    // interpreting the page needs exclusive access to the document, so we
+    // only record it into a display list under ctxAccess. Rasterizing the
+    // list doesn't touch the document and runs without the lock, so render
+    // threads can draw pages of the same document at the same time
+    fz_rect pRect;
+    fz_matrix ctm;
+    fz_display_list* list = nullptr;
+    fz_device* dev = nullptr;
+    fz_var(list);
+    fz_var(dev);
+    {
+        ScopedCritSec cs(ctxAccess);
+        if (pageRect) {
+            pRect = ToFzRect(*pageRect);
+        } else {
+            // TODO(port): use pageInfo->mediabox?
+            pRect = fz_bound_page(ctx, page);
+        }
+        ctm = viewctm(page, zoom, rotation);
+
         fz_try(ctx) {
-            pdfpage = pdf_page_from_fz_page(ctx, page);
-            pix = fz_new_pixmap_with_bbox(ctx, csRgb, ibounds, nullptr, 1);
-            fz_clear_pixmap_with_value(ctx, pix, 0xff);
-            // TODO: in printing different style. old code use pdf_run_page_with_usage(), with usage ="View"
-            // or "Print". "Export" is not used
-            dev = fz_new_draw_device(ctx, ctm, pix);
-            if (hideAnnotations) {
-                pdf_run_page_contents_with_usage(ctx, pdfpage, dev, fz_identity, usage, fzcookie);
-                pdf_run_page_widgets_with_usage(ctx, pdfpage, dev, fz_identity, usage, fzcookie);
+            list = fz_new_display_list(ctx, fz_bound_page(ctx, page));
+            dev = fz_new_list_device(ctx, list);
+            if (pdfdoc) {
+                // TODO: in printing different style. old code use pdf_run_page_with_usage(), with usage ="View"
+                // or "Print". "Export" is not used
+                pdf_page* pdfpage = pdf_page_from_fz_page(ctx, page);
+                if (hideAnnotations) {
+                    pdf_run_page_contents_with_usage(ctx, pdfpage, dev, fz_identity, usage, fzcookie);
+                    pdf_run_page_widgets_with_usage(ctx, pdfpage, dev, fz_identity, usage, fzcookie);
+                } else {
+                    pdf_run_page_with_usage(ctx, pdfpage, dev, fz_identity, usage, fzcookie);
+                }
             } else {
-                pdf_run_page_with_usage(ctx, pdfpage, dev, fz_identity, usage, fzcookie);
+                fz_run_page_contents(ctx, page, dev, fz_identity, fzcookie);
             }
-            bitmap = NewRenderedFzPixmap(ctx, pix);
             fz_close_device(ctx, dev);
         }
         fz_always(ctx) {
-            if (dev) {
-                fz_drop_device(ctx, dev);
-            }
-            fz_drop_pixmap(ctx, pix);
-        }
-        fz_catch(ctx) {
-            fz_report_error(ctx);
-            delete bitmap;
-            return nullptr;
-        }
-    } else {
-        fz_try(ctx) {
-            pix = fz_new_pixmap_with_bbox(ctx, csRgb, ibounds, nullptr, 1);
-            // TODO: to have uniform background needs to set custom css
-            // background-color and clear pixmap with the same color
-            fz_clear_pixmap_with_value(ctx, pix, 0xff);
-            // fz_clear_pixmap(ctx, pix);
-            // fz_fill_pixmap_with_color(ctx, pix, )
-            dev = fz_new_draw_device(ctx, ctm, pix);
-            fz_run_page_contents(ctx, page, dev, fz_identity, NULL);
-            fz_close_device(ctx, dev);
             fz_drop_device(ctx, dev);
-            bitmap = NewRenderedFzPixmap(ctx, pix);
-        }
-        fz_always(ctx) {
-            fz_drop_pixmap(ctx, pix);
+            dev = nullptr;
         }
         fz_catch(ctx) {
             fz_report_error(ctx);
-            delete bitmap;
+            fz_drop_display_list(ctx, list);
             return nullptr;
         }
     }
 
+    fz_irect ibounds = fz_round_rect(fz_transform_rect(pRect, ctm));
+    Size size{ibounds.x1 - ibounds.x0, ibounds.y1 - ibounds.y0};
+
+    // mupdf draws directly into the pixels of the resulting bitmap (BGRA is
+    // a GDI compatible format) so there's no need for an intermediate rgb
+    // pixmap that has to be converted and copied. The bitmap comes from a
+    // pool of recently freed bitmaps, which is cheaper than allocating
+    u8* bits = nullptr;
+    RenderedBitmap* bitmap = NewPooledRenderedBitmap(size, &bits);
+    if (!bitmap) {
+        fz_drop_display_list(ctx, list);
+        return nullptr;
+    }
+
+    fz_colorspace* csBgr = fz_device_bgr(ctx);
+    fz_pixmap* pix = nullptr;
+    RenderedBitmap* paletteBitmap = nullptr;
+    fz_var(pix);
+    fz_var(paletteBitmap);
+    fz_try(ctx) {
+        pix = fz_new_pixmap_with_bbox_and_data(ctx, csBgr, ibounds, nullptr, 1, bits);
+        // TODO: for non-pdf documents, to have uniform background needs to set
+        // custom css background-color and clear pixmap with the same color
+        fz_clear_pixmap_with_value(ctx, pix, 0xff);
+        dev = fz_new_draw_device(ctx, ctm, pix);
+        fz_run_display_list(ctx, list, dev, fz_identity, pRect, fzcookie);
+        fz_close_device(ctx, dev);
+        paletteBitmap = TryRenderAsPaletteImage(pix, true);
+    }
+    fz_always(ctx) {
+        fz_drop_device(ctx, dev);
+        fz_drop_pixmap(ctx, pix);
+        fz_drop_display_list(ctx, list);
+    }
+    fz_catch(ctx) {
+        fz_report_error(ctx);
+        delete bitmap;
+        return nullptr;
+    }
+    if (paletteBitmap) {
+        // uses 4x less memory, the bgra bitmap goes back to the pool
+        delete bitmap;
+        return paletteBitmap;
+    }
     return bitmap;
 }
 
@@ -3232,8 +4257,9 @@ fz_matrix EngineMupdf::viewctm(fz_page* page, float zoom, int rotation) const {
 RenderedBitmap* EngineMupdf::GetPageImage(int pageNo, RectF rect, int imageIdx) {
     auto ctx = Ctx();
 
-    FzPageInfo* pageInfo = GetFzPageInfo(pageNo, false);
-    if (!pageInfo->page) {
+    FzPageInfo* pageInfo = GetFzPageInfo(pageNo, false, nullptr, true);
+    ScopedPinFzPage pin(this, pageInfo);
+    if (!pageInfo || !pageInfo->page) {
         return nullptr;
     }
     const auto& images = pageInfo->images;
@@ -3276,12 +4302,26 @@ RenderedBitmap* EngineMupdf::GetPageImage(int pageNo, RectF rect, int imageIdx)
 }
 
 PageText EngineMupdf::ExtractPageText(int pageNo) {
+    TrimMupdfStores(this);
     auto ctx = Ctx();
 
-    FzPageInfo* pageInfo = GetFzPageInfo(pageNo, true);
+    FzPageInfo* pageInfo = GetFzPageInfo(pageNo, true, nullptr, true);
+    ScopedPinFzPage pin(this, pageInfo);
     if (!pageInfo) {
         return {};
     }
+    {
+        // if the page was recently fully loaded, take over its text.
+        // only the first caller gets it, we expect the caller to cache it
+        ScopedCritSec pagesScope(&pagesAccess);
+        if (pageInfo->text.text) {
+            PageText res = pageInfo->text;
+            loadedPagesSize -= PageTextSize(&res);
+            pageInfo->text = {};
+            pagesWithText.Remove(pageInfo);
+            return res;
+        }
+    }
 
     ScopedCritSec scope(ctxAccess);
 
@@ -3337,7 +4377,8 @@ TempStr EngineMupdf::ExtractFontListTemp() {
     // collect all fonts from all page objects
     int nPages = PageCount();
     for (int i = 1; i <= nPages; i++) {
-        auto pageInfo = GetFzPageInfo(i, false);
+        auto pageInfo = GetFzPageInfo(i, false, nullptr, true);
+        ScopedPinFzPage pin(this, pageInfo);
         if (!pageInfo) {
             continue;
         }
@@ -3760,7 +4801,7 @@ bool EngineMupdf::HasClipOptimizations(int pageNo) {
     }
 
     FzPageInfo* pageInfo = GetFzPageInfoFast(pageNo);
-    if (!pageInfo || !pageInfo->page) {
+    if (!pageInfo) {
         return false;
     }
 
@@ -4054,6 +5095,7 @@ NO_INLINE void MarkNotificationAsModified(EngineMupdf* e, Annotation* annot, Ann
     // on change we assume Annotation* lives inside EngineMupdf
     ScopedCritSec scope(&e->pagesAccess);
     FzPageInfo* pageInfo = e->pages[pageIdx];
+    pageInfo->annotationsModified = true;
 
     if (change == AnnotationChange::Remove) {
         int sizeBefore = pageInfo->annotations.Size();
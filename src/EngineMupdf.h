@@ -29,11 +29,26 @@ struct FzPageInfo {
     bool elementsNeedRebuilding = true;
 
     RectF mediabox{};
+    // for documents with lots of pages we guess the size of most pages when
+    // loading, the real size is loaded in the background or when the page is loaded
+    // cleared after setting the real mediabox, the ui reads it without a lock
+    AtomicBool mediaboxProvisional = 0;
     Vec<FitzPageImageInfo*> images;
 
+    // text extracted when fully loading, until ExtractPageText() hands it
+    // over to the caller. Only kept for a few pages, see EngineMupdf::pagesWithText
+    PageText text;
+
     // if false, only loaded page (fast)
     // if true, loaded expensive info (extracted text etc.)
     bool fullyLoaded = false;
+
+    // for unloading least recently used pages, see EngineMupdf::UnloadPagesIfNeeded()
+    u32 lastUse = 0;
+    // > 0 while a caller uses page outside of pagesAccess, it can't be unloaded
+    int pinCount = 0;
+    // pdf_annot in annotations are owned by page, edited pages are never unloaded
+    bool annotationsModified = false;
 };
 
 class EngineMupdf : public EngineBase {
@@ -43,6 +58,7 @@ class EngineMupdf : public EngineBase {
     EngineBase* Clone() override;
 
     RectF PageMediabox(int pageNo) override;
+    bool IsPageMediaboxProvisional(int pageNo) override;
     RectF PageContentBox(int pageNo, RenderTarget target = RenderTarget::View) override;
 
     RenderedBitmap* RenderPage(RenderPageArgs& args) override;
@@ -81,6 +97,14 @@ class EngineMupdf : public EngineBase {
     CRITICAL_SECTION mutexes[FZ_LOCK_MAX];
 
     fz_context* _ctx = nullptr;
+    // identifies this instance in per-thread context cache, see Ctx()
+    int generation = 0;
+    // for sharing gMupdfStoreBudget between documents, see TrimMupdfStores()
+    int lastStoreUse = 0;
+    i64 storeSize = 0;
+    i64 storePeakSize = 0;
+    // how much was evicted from our store because of other documents
+    i64 storeEvicted = 0;
     fz_locks_context fz_locks_ctx;
     int displayDPI{96};
     fz_document* _doc = nullptr;
@@ -91,8 +115,27 @@ class EngineMupdf : public EngineBase {
     pdf_obj* pdfInfo = nullptr;
     StrVec* pageLabels = nullptr;
 
+    // see LoadDocCache(), docCachePath is nullptr if we don't cache this document
+    char* docCachePath = nullptr;
+    i64 docCacheFileSize = 0;
+    FILETIME docCacheModified{};
+    u8 docCacheFingerprint[16]{};
+    // page sizes, outline and page labels came from the cache
+    bool fromDocCache = false;
+
     TocTree* tocTree = nullptr;
 
+    // fz_page is dropped for least recently used pages when we go over
+    // either limit. Links, elements and mediabox are kept, text and page
+    // are re-created on next access
+    int maxLoadedPages = 256;
+    i64 maxLoadedPagesSize = 64 * 1024 * 1024;
+    int nLoadedPages = 0;
+    i64 loadedPagesSize = 0;
+    u32 pageUseCounter = 0;
+    // pages that still have their text, oldest first
+    Vec<FzPageInfo*> pagesWithText;
+
     // used to track "dirty" state of annotations. not perfect because if we add and delete
     // the same annotation, we should be back to 0
     bool modifiedAnnotations = false;
@@ -103,11 +146,15 @@ class EngineMupdf : public EngineBase {
     // bool Load(fz_stream* stm, PasswordUI* pwdUI = nullptr);
     bool LoadFromStream(fz_stream* stm, const char* nameHing, PasswordUI* pwdUI = nullptr);
     bool FinishLoading();
+    void LoadPdfDocumentInfo();
     RenderedBitmap* GetPageImage(int pageNo, RectF rect, int imageIdx);
 
     FzPageInfo* GetFzPageInfoCanFail(int pageNo);
     FzPageInfo* GetFzPageInfoFast(int pageNo);
-    FzPageInfo* GetFzPageInfo(int pageNo, bool loadQuick, fz_cookie* cookie = nullptr);
+    // if pin is true, the caller must UnpinFzPageInfo() (see ScopedPinFzPage)
+    FzPageInfo* GetFzPageInfo(int pageNo, bool loadQuick, fz_cookie* cookie = nullptr, bool pin = false);
+    void UnpinFzPageInfo(FzPageInfo* pageInfo);
+    void UnloadPagesIfNeeded(fz_context* ctx);
     fz_matrix viewctm(int pageNo, float zoom, int rotation);
     fz_matrix viewctm(fz_page* page, float zoom, int rotation) const;
     TocItem* BuildTocTree(TocItem* parent, fz_outline* outline, int& idCounter, bool isAttachment);
@@ -116,6 +163,20 @@ class EngineMupdf : public EngineBase {
     ByteSlice LoadStreamFromPDFFile(const char* filePath);
 };
 
+// un-pins a page returned by GetFzPageInfo(..., pin = true) when going out of scope
+struct ScopedPinFzPage {
+    EngineMupdf* engine = nullptr;
+    FzPageInfo* pageInfo = nullptr;
+    ScopedPinFzPage(EngineMupdf* e, FzPageInfo* pi) : engine(e), pageInfo(pi) {}
+    ~ScopedPinFzPage() {
+        if (pageInfo) {
+            engine->UnpinFzPageInfo(pageInfo);
+        }
+    }
+};
+
+extern i64 gMupdfStoreBudget;
+
 EngineMupdf* AsEngineMupdf(EngineBase* engine);
 
 fz_rect ToFzRect(RectF rect);
@@ -2,6 +2,7 @@
 License: GPLv3 */
 
 #include "utils/BaseUtil.h"
+#include "utils/Dict.h"
 #include "utils/DirIter.h"
 #include "utils/FileUtil.h"
 #include "utils/ThreadUtil.h"
@@ -47,17 +48,168 @@ constexpr int kFileHistoryMaxFrequent = 1000;
 
 FileHistory gFileHistory;
 
+/* Index of file states by path and by file name.
+
+Users can have thousands of history entries and we look them up on every
+open and when checking for thumbnails, so instead of scanning all states
+we look them up in a dictionary keyed by path and one keyed by file name.
+Keys ignore ascii case, like str::EqI(). Different states can share a file
+name (and, in theory, a path) so each key maps to a list of states, kept in
+the order they're in states. States without a path are not indexed.
+*/
+
+struct FileStateIndex {
+    // path or file name => index in lists
+    dict::MapStrToInt* byPath = nullptr;
+    dict::MapStrToInt* byName = nullptr;
+    Vec<Vec<FileState*>*> lists;
+
+    ~FileStateIndex() {
+        delete byPath;
+        delete byName;
+        DeleteVecMembers(lists);
+    }
+};
+
+static void IndexReset(FileStateIndex* idx) {
+    delete idx->byPath;
+    delete idx->byName;
+    DeleteVecMembers(idx->lists);
+    idx->byPath = new dict::MapStrToInt(1024, true);
+    idx->byName = new dict::MapStrToInt(1024, true);
+}
+
+static Vec<FileState*>* IndexGetList(const FileStateIndex* idx, dict::MapStrToInt* d, const char* key) {
+    int i;
+    if (!d->Get(key, &i)) {
+        return nullptr;
+    }
+    return idx->lists.at(i);
+}
+
+static Vec<FileState*>* IndexGetOrCreateList(FileStateIndex* idx, dict::MapStrToInt* d, const char* key) {
+    int i = idx->lists.Size();
+    int existing;
+    if (!d->Insert(key, i, &existing)) {
+        return idx->lists.at(existing);
+    }
+    auto res = new Vec<FileState*>();
+    idx->lists.Append(res);
+    return res;
+}
+
+// position of fs among the states of l, following the order of states.
+// Only walks states up to fs and only if there are other states with that key
+static int IndexListPos(Vec<FileState*>* l, Vec<FileState*>* states, FileState* fs) {
+    int pos = 0;
+    if (l->size() == 0) {
+        return pos;
+    }
+    for (FileState* el : *states) {
+        if (el == fs) {
+            break;
+        }
+        if (l->Contains(el)) {
+            pos++;
+        }
+    }
+    return pos;
+}
+
+enum class IndexPos {
+    First,
+    Last,
+    // where fs is in states
+    InOrder,
+};
+
+static void IndexAdd(FileStateIndex* idx, Vec<FileState*>* states, FileState* fs, IndexPos where) {
+    if (!fs->filePath) {
+        return;
+    }
+    Vec<FileState*>* lists[2] = {
+        IndexGetOrCreateList(idx, idx->byPath, fs->filePath),
+        IndexGetOrCreateList(idx, idx->byName, path::GetBaseNameTemp(fs->filePath)),
+    };
+    for (Vec<FileState*>* l : lists) {
+        if (where == IndexPos::First) {
+            l->InsertAt(0, fs);
+        } else if (where == IndexPos::Last) {
+            l->Append(fs);
+        } else {
+            l->InsertAt(IndexListPos(l, states, fs), fs);
+        }
+    }
+}
+
+static bool IndexRemove(FileStateIndex* idx, FileState* fs) {
+    if (!fs->filePath) {
+        return false;
+    }
+    Vec<FileState*>* l = IndexGetList(idx, idx->byPath, fs->filePath);
+    bool removed = l && l->Remove(fs) >= 0;
+    l = IndexGetList(idx, idx->byName, path::GetBaseNameTemp(fs->filePath));
+    if (l) {
+        l->Remove(fs);
+    }
+    return removed;
+}
+
+static void IndexRebuild(FileStateIndex* idx, Vec<FileState*>* states) {
+    IndexReset(idx);
+    if (!states) {
+        return;
+    }
+    for (FileState* fs : *states) {
+        IndexAdd(idx, states, fs, IndexPos::Last);
+    }
+}
+
+// returns the matching state that is last in states, like the linear scan
+// this replaced
+static FileState* IndexFindLast(const FileStateIndex* idx, dict::MapStrToInt* d, const char* key) {
+    Vec<FileState*>* l = IndexGetList(idx, d, key);
+    if (!l || l->size() == 0) {
+        return nullptr;
+    }
+    return l->Last();
+}
+
+FileHistory::~FileHistory() {
+    delete index;
+}
+
 void FileHistory::Append(FileState* fs) const {
     ReportIf(!fs->filePath);
     states->Append(fs);
+    IndexAdd(index, states, fs, IndexPos::Last);
 }
 
 void FileHistory::Remove(FileState* fs) const {
-    states->Remove(fs);
+    if (states->Remove(fs) >= 0) {
+        IndexRemove(index, fs);
+    }
 }
 
 void FileHistory::UpdateStatesSource(Vec<FileState*>* states) {
     this->states = states;
+    if (!index) {
+        index = new FileStateIndex();
+    }
+    IndexRebuild(index, states);
+}
+
+bool FileHistory::RemoveFromIndex(FileState* fs) const {
+    if (!index) {
+        return false;
+    }
+    return IndexRemove(index, fs);
+}
+
+void FileHistory::AddToIndex(FileState* fs) const {
+    if (index) {
+        IndexAdd(index, states, fs, IndexPos::InOrder);
+    }
 }
 
 void FileHistory::Clear(bool keepFavorites) const {
@@ -74,6 +226,7 @@ void FileHistory::Clear(bool keepFavorites) const {
         }
     }
     *states = keep;
+    IndexRebuild(index, states);
 }
 
 FileState* FileHistory::Get(size_t index) const {
@@ -84,46 +237,30 @@ FileState* FileHistory::Get(size_t index) const {
 }
 
 FileState* FileHistory::FindByPath(const char* filePath) const {
-    int idxExact = -1;
-    int n = states->Size();
-    for (int i = 0; i < n; i++) {
-        FileState* fs = states->at(i);
-        if (str::EqI(fs->filePath, filePath)) {
-            idxExact = i;
-        }
-    }
-    if (idxExact == -1) {
+    if (!filePath) {
         return nullptr;
     }
-    return states->at(idxExact);
+    return IndexFindLast(index, index->byPath, filePath);
 }
 
 // returns an exact match by path or match by just file name
 // TODO: audit the uses of FindByName and maybe convert to FindByPath
 FileState* FileHistory::FindByName(const char* filePath, size_t* idxOut) const {
-    int idxExact = -1;
-    int idxFileNameMatch = -1;
-    TempStr fileName = path::GetBaseNameTemp(filePath);
-    int n = states->Size();
-    for (int i = 0; i < n; i++) {
-        FileState* fs = states->at(i);
-        if (str::EqI(fs->filePath, filePath)) {
-            idxExact = i;
-        } else if (str::EqI(path::GetBaseNameTemp(fs->filePath), fileName)) {
-            idxFileNameMatch = i;
-        }
+    if (!filePath) {
+        return nullptr;
     }
-    int idFound = idxExact;
-    if (idFound == -1) {
-        idFound = idxFileNameMatch;
+    FileState* fs = IndexFindLast(index, index->byPath, filePath);
+    if (!fs) {
+        TempStr fileName = path::GetBaseNameTemp(filePath);
+        fs = IndexFindLast(index, index->byName, fileName);
     }
-    if (idFound == -1) {
+    if (!fs) {
         return nullptr;
     }
     if (idxOut) {
-        *idxOut = (size_t)idFound;
+        *idxOut = (size_t)states->Find(fs);
     }
-    return states->at(idFound);
+    return fs;
 }
 
 FileState* FileHistory::MarkFileLoaded(const char* filePath) const {
@@ -132,14 +269,17 @@ FileState* FileHistory::MarkFileLoaded(const char* filePath) const {
     // then reuse it. That way we don't have duplicates and
     // the file moves to the front of the list
     FileState* fs = FindByPath(filePath);
-    if (!fs) {
+    bool isNew = !fs;
+    if (isNew) {
         fs = NewFileState(filePath);
         fs->useDefaultState = true;
     } else {
         states->Remove(fs);
+        IndexRemove(index, fs);
         fs->isMissing = false;
     }
     states->InsertAt(0, fs);
+    IndexAdd(index, states, fs, IndexPos::First);
     fs->openCount++;
     return fs;
 }
@@ -159,10 +299,13 @@ bool FileHistory::MarkFileInexistent(const char* filePath, bool hide) const {
     int idx = states->Find(state);
     if (idx < newIdx && state != states->Last()) {
         states->Remove(state);
+        IndexRemove(index, state);
         if (states->size() <= (size_t)newIdx) {
             states->Append(state);
+            IndexAdd(index, states, state, IndexPos::Last);
         } else {
             states->InsertAt(newIdx, state);
+            IndexAdd(index, states, state, IndexPos::InOrder);
         }
     }
     // also delete the thumbnail and move the link towards the
@@ -273,6 +416,7 @@ void FileHistory::Purge(bool alwaysUseDefaultState) const {
         } else {
             continue;
         }
+        IndexRemove(index, state);
         DeleteFileState(state);
     }
 }
@@ -301,57 +445,23 @@ char* PopRecentlyClosedDocument() {
 
 // --- thumbnail cache delete
 
-static bool shouldDeleteThumbnail = false;
-
-// TODO: https://github.com/sumatrapdfreader/sumatrapdf/issues/4286
-// Not sure why the behavior started changing after I re-wrote StrVec
-// is the issue that files are marked as isMissing in FileExistenceCheckerThread?
-// is it because we don't return enough itms if GetFrequencyOrder()? Is it a bug
-// in StrVec::Remove()?
-// either way, I just disabled deleting of stale thumbnail because it seems fishy
-// Should probably change the logic to: remove thumbnails for files marked as missing
-
-// removes thumbnails that don't belong to any frequently used item in file history
+// we used to only keep thumbnails of frequently used documents but deleting
+// stale thumbnails was disabled because of
+// https://github.com/sumatrapdfreader/sumatrapdf/issues/4286
+// Now we keep thumbnails of all documents in history and drop the rest.
+// It's safe because thumbnails are looked up by path so a missing file
+// keeps its thumbnail as long as it's in history
 void CleanUpThumbnailCache() {
-    const FileHistory& fileHistory = gFileHistory;
-    TempStr thumbsDir = GetThumbnailCacheDirTemp();
-
     StrVec filePaths;
-    DirIter di{thumbsDir};
-    for (DirIterEntry* de : di) {
-        if (path::Match(de->filePath, "*.png")) {
-            filePaths.Append(de->filePath);
-        }
-    }
-    if (filePaths.IsEmpty()) {
+    if (!gFileHistory.states) {
         return;
     }
-
-    bool ok;
-    // remove files that should not be deleted
-    Vec<FileState*> list;
-    fileHistory.GetFrequencyOrder(list);
-    int n = 0;
-    for (auto& fs : list) {
-        if (n++ > kFileHistoryMaxFrequent * 2) {
-            break;
-        }
-        TempStr path = GetThumbnailPathTemp(fs->filePath);
-        if (!path) {
-            continue;
-        }
-        ok = filePaths.Remove(path);
-        if (!ok) {
-            logf("CleanUpThumbnailCache: failed to remove '%s'\n", path);
-        }
-    }
-
-    for (char* path : filePaths) {
-        if (shouldDeleteThumbnail) {
-            logf("CleanUpThumbnailCache: deleting '%s'\n", path);
-            file::Delete(path);
+    for (FileState* fs : *gFileHistory.states) {
+        if (fs->filePath) {
+            filePaths.Append(fs->filePath);
         }
     }
+    CompactThumbnailCache(filePaths);
 }
 
 // --- file existence check
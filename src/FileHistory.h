@@ -6,12 +6,17 @@
 //  to be remembered and not individual view settings per document)
 #define kFileHistoryMaxRecent 10
 
+struct FileStateIndex;
+
 struct FileHistory {
     // owned by gGlobalPrefs->fileStates
     Vec<FileState*>* states = nullptr;
+    // states indexed by path and by file name (ignoring case),
+    // kept in sync by the methods below
+    FileStateIndex* index = nullptr;
 
     FileHistory() = default;
-    ~FileHistory() = default;
+    ~FileHistory();
 
     void Clear(bool keepFavorites) const;
     void Append(FileState* state) const;
@@ -25,6 +30,10 @@ struct FileHistory {
     void GetRecentlyOpenedOrder(Vec<FileState*>& list) const;
     void Purge(bool alwaysUseDefaultState = false) const;
     void UpdateStatesSource(Vec<FileState*>* states);
+
+    // for changing the path of a state that might be in history
+    bool RemoveFromIndex(FileState* state) const;
+    void AddToIndex(FileState* state) const;
 };
 
 extern FileHistory gFileHistory;
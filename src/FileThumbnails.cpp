@@ -5,101 +5,753 @@
 #include "utils/CryptoUtil.h"
 #include "utils/FileUtil.h"
 #include "utils/DirIter.h"
-#include "utils/GdiPlusUtil.h"
+#include "utils/ScopedWin.h"
+#include "utils/ThreadUtil.h"
+#include "utils/UITask.h"
 #include "utils/WinUtil.h"
 
 #include "Settings.h"
 #include "DocController.h"
+#include "EngineBase.h"
+#include "EngineAll.h"
 #include "FzImgReader.h"
 #include "FileHistory.h"
 
 #include "AppTools.h"
 #include "FileThumbnails.h"
 
+#include <zlib.h>
+
 #include "utils/Log.h"
 
-char* GetThumbnailPathTemp(const char* filePath) {
-    // create a fingerprint of a (normalized) path for the file name
-    // I'd have liked to also include the file's last modification time
-    // in the fingerprint (much quicker than hashing the entire file's
-    // content), but that's too expensive for files on slow drives
-    u8 digest[16]{};
-    // TODO: why is this happening? Seen in crash reports e.g. 35043
-    if (!filePath) {
+/* Thumbnail cache.
+
+All thumbnails live in a single file (thumbnails.dat) in the cache directory
+instead of a .png file per document. The file is a header followed by
+append-only records. A record is keyed by a hash of the (normalized) document
+path and the document's modification time and has the time the thumbnail was
+created and raw 32bpp pixels, compressed with zlib if that makes them smaller.
+The last record for a path wins and a record with empty size marks a removed
+thumbnail. A thumbnail of a document that has changed since is not used.
+
+We keep an index of path hash => record offset in memory so HasThumbnail()
+doesn't have to decode anything. The index is built by reading record headers
+once and after that we only read records appended since (by us or another
+instance of SumatraPDF). The file is read through a memory mapping.
+
+Multiple processes can use the file at the same time: readers take a shared
+and writers an exclusive lock on a byte range past the end of the file.
+A record's magic is written last so if we crash while writing, the partial
+record is at the end of the file and the next writer truncates it.
+
+Superseded and removed records are dropped by writing the records that are
+still needed to a new file and replacing the old one with it. That happens at
+startup and when more than half of a big enough file is superseded records.
+The old file is marked as replaced so that other processes that opened it
+before it was replaced open the new one.
+
+Thumbnails from older versions (<md5 of path>.png) are moved into the file
+the first time they're needed.
+*/
+
+constexpr u32 kThumbsMagic = 0x53425448;      // "HTBS"
+constexpr u32 kThumbRecordMagic = 0x44525448; // "HTRD"
+constexpr u32 kThumbsVersion = 2;
+constexpr u32 kThumbFlagCompressed = 0x1;
+// in ThumbsHeader.flags of a file that has been replaced by a compacted copy
+constexpr u32 kThumbsFlagReplaced = 0x1;
+// compact during a session when more than half of a file this big is superseded records
+constexpr i64 kThumbsMinSizeToCompact = 4 * 1024 * 1024;
+
+// all LockFileEx() calls lock this byte, which is never part of the file
+constexpr DWORD kThumbsLockOffsetHigh = 0x7fffffff;
+
+struct ThumbsHeader {
+    u32 magic;
+    u32 version;
+    // changes when the file is re-written, invalidates offsets in the index
+    u32 generation;
+    u32 flags;
+};
+
+struct ThumbRecord {
+    u32 magic;
+    u32 flags;
+    u64 pathHash;
+    // of the document when the thumbnail was created
+    FILETIME fileModified;
+    FILETIME created;
+    // 0 x 0 for removed thumbnails
+    i32 dx;
+    i32 dy;
+    // size of data following the record
+    u32 dataSize;
+    u32 reserved;
+};
+
+static_assert(sizeof(ThumbsHeader) == 16);
+static_assert(sizeof(ThumbRecord) == 48);
+
+struct ThumbIndexEntry {
+    u64 pathHash;
+    i64 offset;
+    // including ThumbRecord
+    i64 size;
+    FILETIME fileModified;
+    FILETIME created;
+    bool isRemoved;
+};
+
+struct ThumbStore {
+    CRITICAL_SECTION cs;
+    // sorted by pathHash
+    Vec<ThumbIndexEntry> index;
+    u32 generation = 0;
+    // the index covers records up to this offset
+    i64 indexedSize = 0;
+    // size and time of the file when we last looked at it. If they didn't
+    // change, the index is up to date and we don't have to open the file
+    i64 lastSize = -1;
+    FILETIME lastModified{};
+    // -1 if we haven't checked for thumbnails from previous versions yet
+    int nLegacyThumbs = -1;
+
+    ThumbStore() { InitializeCriticalSection(&cs); }
+};
+
+static ThumbStore* gThumbStore = new ThumbStore();
+
+TempStr GetThumbnailCacheDirTemp() {
+    TempStr thumbsDir = GetPathInAppDataDirTemp("sumatrapdfcache");
+    return thumbsDir;
+}
+
+static TempStr GetThumbsFilePathTemp() {
+    TempStr thumbsDir = GetThumbnailCacheDirTemp();
+    if (!thumbsDir) {
         return nullptr;
     }
+    return path::JoinTemp(thumbsDir, "thumbnails.dat");
+}
+
+static TempStr NormalizeThumbPathTemp(const char* filePath) {
     TempStr path = str::DupTemp(filePath);
     if (path::HasVariableDriveLetter(path)) {
         // ignore the drive letter, if it might change
         path[0] = '?';
     }
+    return path;
+}
+
+// create a fingerprint of a (normalized) path
+static u64 ThumbPathHash(const char* filePath) {
+    TempStr path = NormalizeThumbPathTemp(filePath);
+    u8 digest[16]{};
     CalcMD5Digest((u8*)path, str::Leni(path), digest);
-    AutoFreeStr fingerPrint = str::MemToHex(digest, dimof(digest));
+    u64 res;
+    memcpy(&res, digest, sizeof(res));
+    return res;
+}
 
+// thumbnails used to be saved as <md5 of path>.png
+static TempStr GetLegacyThumbnailPathTemp(const char* filePath) {
+    TempStr path = NormalizeThumbPathTemp(filePath);
+    u8 digest[16]{};
+    CalcMD5Digest((u8*)path, str::Leni(path), digest);
+    AutoFreeStr fingerPrint = str::MemToHex(digest, dimof(digest));
     TempStr thumbsDir = GetThumbnailCacheDirTemp();
     if (!thumbsDir) {
         return nullptr;
     }
+    return path::JoinTemp(thumbsDir, str::JoinTemp(fingerPrint, ".png"));
+}
 
-    TempStr res = path::JoinTemp(thumbsDir, str::JoinTemp(fingerPrint, ".png"));
-    return res;
+static bool ReadAt(HANDLE h, i64 off, void* d, u32 n) {
+    OVERLAPPED ov{};
+    ov.Offset = (DWORD)off;
+    ov.OffsetHigh = (DWORD)(off >> 32);
+    DWORD nRead = 0;
+    return ReadFile(h, d, n, &nRead, &ov) && nRead == n;
 }
 
-TempStr GetThumbnailCacheDirTemp() {
-    TempStr thumbsDir = GetPathInAppDataDirTemp("sumatrapdfcache");
-    return thumbsDir;
+static bool WriteAt(HANDLE h, i64 off, const void* d, u32 n) {
+    OVERLAPPED ov{};
+    ov.Offset = (DWORD)off;
+    ov.OffsetHigh = (DWORD)(off >> 32);
+    DWORD nWritten = 0;
+    return WriteFile(h, d, n, &nWritten, &ov) && nWritten == n;
+}
+
+static bool TruncateAt(HANDLE h, i64 off) {
+    LARGE_INTEGER pos;
+    pos.QuadPart = off;
+    return SetFilePointerEx(h, pos, nullptr, FILE_BEGIN) && SetEndOfFile(h);
+}
+
+static HANDLE OpenThumbsFile(bool forWrite) {
+    TempStr path = GetThumbsFilePathTemp();
+    if (!path) {
+        return INVALID_HANDLE_VALUE;
+    }
+    if (forWrite && !dir::CreateForFile(path)) {
+        logf("OpenThumbsFile: dir::CreateForFile('%s') failed\n", path);
+        return INVALID_HANDLE_VALUE;
+    }
+    DWORD access = GENERIC_READ | (forWrite ? GENERIC_WRITE : 0);
+    // FILE_SHARE_DELETE so that compaction can replace the file
+    DWORD share = FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE;
+    DWORD disp = forWrite ? OPEN_ALWAYS : OPEN_EXISTING;
+    return CreateFileW(ToWStrTemp(path), access, share, nullptr, disp, FILE_ATTRIBUTE_NORMAL, nullptr);
+}
+
+// the cache file, opened and locked. Readers take a shared lock, writers
+// an exclusive one
+struct ThumbsFile {
+    HANDLE h = INVALID_HANDLE_VALUE;
+    bool locked = false;
+
+    ~ThumbsFile() { Close(); }
+    bool Open(bool forWrite);
+    void Close();
+};
+
+void ThumbsFile::Close() {
+    if (locked) {
+        OVERLAPPED ov{};
+        ov.OffsetHigh = kThumbsLockOffsetHigh;
+        UnlockFileEx(h, 0, 1, 0, &ov);
+        locked = false;
+    }
+    if (h != INVALID_HANDLE_VALUE) {
+        CloseHandle(h);
+        h = INVALID_HANDLE_VALUE;
+    }
+}
+
+bool ThumbsFile::Open(bool forWrite) {
+    // if another process has replaced the file while we were waiting
+    // for the lock, we have to open the new one
+    for (int i = 0; i < 3; i++) {
+        Close();
+        h = OpenThumbsFile(forWrite);
+        if (h == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        OVERLAPPED ov{};
+        ov.OffsetHigh = kThumbsLockOffsetHigh;
+        DWORD flags = forWrite ? LOCKFILE_EXCLUSIVE_LOCK : 0;
+        locked = LockFileEx(h, flags, 0, 1, 0, &ov);
+        if (!locked) {
+            return false;
+        }
+        ThumbsHeader hdr{};
+        bool replaced = ReadAt(h, 0, &hdr, sizeof(hdr)) && hdr.magic == kThumbsMagic &&
+                        (hdr.flags & kThumbsFlagReplaced) != 0;
+        if (!replaced) {
+            return true;
+        }
+    }
+    Close();
+    return false;
+}
+
+// read-only mapping of the whole file, only valid while the file is locked
+// and must be closed before the file can be truncated
+struct ThumbsFileView {
+    HANDLE hMap = nullptr;
+    const u8* data = nullptr;
+    i64 size = 0;
+
+    explicit ThumbsFileView(HANDLE h) {
+        i64 fileSize = file::GetSize(h);
+        // empty files can't be mapped
+        if (fileSize <= 0 || (u64)fileSize > (u64)(size_t)-1) {
+            return;
+        }
+        hMap = CreateFileMappingW(h, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (hMap) {
+            data = (const u8*)MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
+        }
+        if (data) {
+            size = fileSize;
+        }
+    }
+    ~ThumbsFileView() {
+        if (data) {
+            UnmapViewOfFile(data);
+        }
+        if (hMap) {
+            CloseHandle(hMap);
+        }
+    }
+};
+
+static int FindIndexEntry(ThumbStore* store, u64 pathHash, bool* found) {
+    Vec<ThumbIndexEntry>& index = store->index;
+    int lo = 0;
+    int hi = (int)index.size();
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (index[mid].pathHash < pathHash) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *found = lo < (int)index.size() && index[lo].pathHash == pathHash;
+    return lo;
+}
+
+static void UpdateIndex(ThumbStore* store, const ThumbRecord& rec, i64 offset) {
+    i64 size = (i64)sizeof(rec) + rec.dataSize;
+    bool isRemoved = rec.dx <= 0 || rec.dy <= 0;
+    ThumbIndexEntry e{rec.pathHash, offset, size, rec.fileModified, rec.created, isRemoved};
+    bool found;
+    int idx = FindIndexEntry(store, rec.pathHash, &found);
+    if (found) {
+        store->index[idx] = e;
+    } else {
+        store->index.InsertAt(idx, e);
+    }
+}
+
+static void ResetIndex(ThumbStore* store, u32 generation) {
+    store->index.Reset();
+    store->generation = generation;
+    store->indexedSize = 0;
+}
+
+// header and records that are still needed
+static i64 LiveThumbsSize(ThumbStore* store) {
+    i64 size = sizeof(ThumbsHeader);
+    for (const ThumbIndexEntry& e : store->index) {
+        if (!e.isRemoved) {
+            size += e.size;
+        }
+    }
+    return size;
+}
+
+// brings the index up to date with the file, must hold a file lock
+// returns the offset of the end of the last valid record, -1 if
+// the file doesn't have a valid header or -2 if we can't read it
+static i64 CatchUpIndex(ThumbStore* store, HANDLE h) {
+    ThumbsFileView view(h);
+    if (!view.data && file::GetSize(h) > 0) {
+        return -2;
+    }
+    ThumbsHeader hdr{};
+    bool ok = view.size >= (i64)sizeof(hdr);
+    if (ok) {
+        memcpy(&hdr, view.data, sizeof(hdr));
+    }
+    if (!ok || hdr.magic != kThumbsMagic || hdr.version != kThumbsVersion) {
+        ResetIndex(store, 0);
+        return -1;
+    }
+    if (hdr.generation != store->generation || view.size < store->indexedSize) {
+        ResetIndex(store, hdr.generation);
+    }
+    i64 off = std::max(store->indexedSize, (i64)sizeof(hdr));
+    while (off + (i64)sizeof(ThumbRecord) <= view.size) {
+        ThumbRecord rec;
+        memcpy(&rec, view.data + off, sizeof(rec));
+        if (rec.magic != kThumbRecordMagic) {
+            break;
+        }
+        i64 end = off + (i64)sizeof(rec) + rec.dataSize;
+        if (end > view.size) {
+            break;
+        }
+        UpdateIndex(store, rec, off);
+        off = end;
+    }
+    store->indexedSize = off;
+    return off;
+}
+
+// cheap check (no need to open the file) if someone changed the file since
+// we've last seen it
+static bool ThumbsFileChanged(ThumbStore* store) {
+    TempStr path = GetThumbsFilePathTemp();
+    WIN32_FILE_ATTRIBUTE_DATA fa{};
+    if (!path || !GetFileAttributesExW(ToWStrTemp(path), GetFileExInfoStandard, &fa)) {
+        if (store->lastSize != 0) {
+            ResetIndex(store, 0);
+        }
+        store->lastSize = 0;
+        return false;
+    }
+    i64 size = ((i64)fa.nFileSizeHigh << 32) | fa.nFileSizeLow;
+    FILETIME modified = fa.ftLastWriteTime;
+    bool changed = size != store->lastSize || CompareFileTime(&modified, &store->lastModified) != 0;
+    store->lastSize = size;
+    store->lastModified = modified;
+    return changed;
+}
+
+static void RefreshIndex(ThumbStore* store) {
+    if (!ThumbsFileChanged(store)) {
+        return;
+    }
+    ThumbsFile f;
+    if (!f.Open(false)) {
+        store->lastSize = -1;
+        return;
+    }
+    CatchUpIndex(store, f.h);
+}
+
+// writes the records that are still needed (only of documents in keep, if given)
+// to a new file and replaces the cache file with it. That way an interrupted
+// compaction leaves the old file intact. Must hold an exclusive lock on h and
+// the index must be up to date
+static bool CompactThumbsFile(ThumbStore* store, HANDLE h, const Vec<u64>* keep) {
+    ThumbsFileView view(h);
+    if (!view.data) {
+        return false;
+    }
+
+    // live records, in the order they're in the file
+    Vec<ThumbIndexEntry> live;
+    for (const ThumbIndexEntry& e : store->index) {
+        if (e.isRemoved) {
+            continue;
+        }
+        if (keep && !std::binary_search(keep->begin(), keep->end(), e.pathHash)) {
+            continue;
+        }
+        live.Append(e);
+    }
+    std::sort(live.begin(), live.end(),
+              [](const ThumbIndexEntry& a, const ThumbIndexEntry& b) { return a.offset < b.offset; });
+
+    TempStr path = GetThumbsFilePathTemp();
+    TempStr tmpPath = str::JoinTemp(path, ".tmp");
+    HANDLE hTmp = CreateFileW(ToWStrTemp(tmpPath), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL,
+                              nullptr);
+    if (hTmp == INVALID_HANDLE_VALUE) {
+        logf("CompactThumbsFile: failed to create '%s'\n", tmpPath);
+        return false;
+    }
+    u32 generation = store->generation + 1;
+    ThumbsHeader hdr{kThumbsMagic, kThumbsVersion, generation, 0};
+    bool ok = WriteAt(hTmp, 0, &hdr, sizeof(hdr));
+    i64 dst = sizeof(hdr);
+    for (const ThumbIndexEntry& e : live) {
+        // records were validated against the file size when indexing
+        ok = ok && e.offset + e.size <= view.size && WriteAt(hTmp, dst, view.data + e.offset, (u32)e.size);
+        if (!ok) {
+            break;
+        }
+        dst += e.size;
+    }
+    CloseHandle(hTmp);
+    ok = ok && MoveFileExW(ToWStrTemp(tmpPath), ToWStrTemp(path), MOVEFILE_REPLACE_EXISTING);
+    if (!ok) {
+        logf("CompactThumbsFile: failed to replace '%s'\n", path);
+        file::Delete(tmpPath);
+        return false;
+    }
+
+    // other processes might have opened the old file and be waiting for the lock
+    ThumbsHeader oldHdr;
+    memcpy(&oldHdr, view.data, sizeof(oldHdr));
+    oldHdr.flags |= kThumbsFlagReplaced;
+    WriteAt(h, 0, &oldHdr, sizeof(oldHdr));
+
+    ResetIndex(store, generation);
+    dst = sizeof(hdr);
+    for (const ThumbIndexEntry& e : live) {
+        ThumbRecord rec;
+        memcpy(&rec, view.data + e.offset, sizeof(rec));
+        UpdateIndex(store, rec, dst);
+        dst += e.size;
+    }
+    store->indexedSize = dst;
+    store->lastSize = -1;
+    logf("CompactThumbsFile: %d thumbnails, %d => %d bytes\n", live.Size(), (int)view.size, (int)dst);
+    return true;
+}
+
+static bool AppendThumbRecord(ThumbStore* store, ThumbRecord& rec, const u8* data) {
+    ThumbsFile f;
+    if (!f.Open(true)) {
+        return false;
+    }
+    HANDLE h = f.h;
+    i64 end = CatchUpIndex(store, h);
+    if (end == -2) {
+        return false;
+    }
+    if (end < 0) {
+        // new file (or one we don't understand)
+        ThumbsHeader hdr{kThumbsMagic, kThumbsVersion, (u32)GetTickCount() ^ GetCurrentProcessId(), 0};
+        if (!TruncateAt(h, 0) || !WriteAt(h, 0, &hdr, sizeof(hdr))) {
+            return false;
+        }
+        ResetIndex(store, hdr.generation);
+        end = sizeof(hdr);
+    } else if (end < file::GetSize(h)) {
+        // a partially written record from a crashed writer
+        logf("AppendThumbRecord: truncating invalid data at %d\n", (int)end);
+        TruncateAt(h, end);
+    }
+
+    // the magic is written last to mark the record as complete
+    rec.magic = 0;
+    bool ok = WriteAt(h, end, &rec, sizeof(rec));
+    ok = ok && (rec.dataSize == 0 || WriteAt(h, end + sizeof(rec), data, rec.dataSize));
+    rec.magic = kThumbRecordMagic;
+    ok = ok && WriteAt(h, end, &rec.magic, sizeof(rec.magic));
+    if (!ok) {
+        TruncateAt(h, end);
+        return false;
+    }
+    UpdateIndex(store, rec, end);
+    store->indexedSize = end + (i64)sizeof(rec) + rec.dataSize;
+    // we've seen this write so no need to re-check the file
+    store->lastSize = store->indexedSize;
+    FILETIME modified{};
+    GetFileTime(h, nullptr, nullptr, &modified);
+    store->lastModified = modified;
+
+    // every saved thumbnail supersedes the previous one of the document,
+    // don't let the file grow until the next startup
+    i64 size = store->indexedSize;
+    if (size > kThumbsMinSizeToCompact && size - LiveThumbsSize(store) > size / 2) {
+        CompactThumbsFile(store, h, nullptr);
+    }
+    return true;
+}
+
+static bool WriteThumbnail(ThumbStore* store, const char* filePath, HBITMAP hbmp, Size size, FILETIME created) {
+    size_t rawSize = (size_t)size.dx * 4 * size.dy;
+    u8* pixels = AllocArray<u8>(rawSize);
+    BITMAPINFO bmi{};
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = size.dx;
+    bmi.bmiHeader.biHeight = -size.dy;
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+    HDC hdc = GetDC(nullptr);
+    int nLines = GetDIBits(hdc, hbmp, 0, size.dy, pixels, &bmi, DIB_RGB_COLORS);
+    ReleaseDC(nullptr, hdc);
+    if (nLines != size.dy) {
+        free(pixels);
+        return false;
+    }
+
+    ThumbRecord rec{};
+    rec.pathHash = ThumbPathHash(filePath);
+    rec.fileModified = file::GetModificationTime(filePath);
+    rec.created = created;
+    rec.dx = size.dx;
+    rec.dy = size.dy;
+    const u8* data = pixels;
+    rec.dataSize = (u32)rawSize;
+    // thumbnails of documents compress well and level 1 is fast enough
+    // to not be noticeable
+    uLongf compressedSize = compressBound((uLong)rawSize);
+    u8* compressed = AllocArray<u8>(compressedSize);
+    int res = compress2(compressed, &compressedSize, pixels, (uLong)rawSize, 1);
+    if (res == Z_OK && compressedSize < rawSize) {
+        rec.flags |= kThumbFlagCompressed;
+        data = compressed;
+        rec.dataSize = (u32)compressedSize;
+    }
+
+    bool ok = AppendThumbRecord(store, rec, data);
+    free(compressed);
+    free(pixels);
+    return ok;
+}
+
+static void WriteThumbnailRemoved(ThumbStore* store, const char* filePath) {
+    RefreshIndex(store);
+    bool found;
+    u64 pathHash = ThumbPathHash(filePath);
+    int idx = FindIndexEntry(store, pathHash, &found);
+    if (!found || store->index[idx].isRemoved) {
+        return;
+    }
+    ThumbRecord rec{};
+    rec.pathHash = pathHash;
+    GetSystemTimeAsFileTime(&rec.created);
+    AppendThumbRecord(store, rec, nullptr);
+}
+
+static RenderedBitmap* ReadThumbnail(ThumbStore* store, const ThumbIndexEntry& e) {
+    ThumbsFile f;
+    if (!f.Open(false)) {
+        return nullptr;
+    }
+    ThumbsFileView view(f.h);
+    ThumbRecord rec{};
+    bool ok = e.offset + (i64)sizeof(rec) <= view.size;
+    if (ok) {
+        memcpy(&rec, view.data + e.offset, sizeof(rec));
+    }
+    ok = ok && rec.magic == kThumbRecordMagic && rec.pathHash == e.pathHash;
+    ok = ok && rec.dx > 0 && rec.dy > 0 && rec.dx <= 4 * kThumbnailDx && rec.dy <= 4 * kThumbnailDy;
+    // dataSize comes from the file, don't trust it. Data is only saved
+    // compressed if that's smaller so it can't exceed rawSize
+    uLongf rawSize = ok ? (uLongf)rec.dx * 4 * rec.dy : 0;
+    i64 maxDataSize = view.size - e.offset - (i64)sizeof(rec);
+    ok = ok && rec.dataSize <= rawSize && (i64)rec.dataSize <= maxDataSize;
+    if (!ok) {
+        // the file has changed under us, re-build the index on next access
+        store->lastSize = -1;
+        ResetIndex(store, 0);
+        return nullptr;
+    }
+    const u8* data = view.data + e.offset + sizeof(rec);
+
+    Size size(rec.dx, rec.dy);
+    HBITMAP hbmp = CreateMemoryBitmap(size);
+    DIBSECTION ds{};
+    if (!hbmp || !GetObject(hbmp, sizeof(ds), &ds) || !ds.dsBm.bmBits) {
+        DeleteObject(hbmp);
+        return nullptr;
+    }
+    u8* bits = (u8*)ds.dsBm.bmBits;
+    if (rec.flags & kThumbFlagCompressed) {
+        uLongf size2 = rawSize;
+        ok = uncompress(bits, &size2, data, rec.dataSize) == Z_OK && size2 == rawSize;
+    } else {
+        ok = rec.dataSize == rawSize;
+        if (ok) {
+            memcpy(bits, data, rawSize);
+        }
+    }
+    if (!ok) {
+        DeleteObject(hbmp);
+        return nullptr;
+    }
+    return new RenderedBitmap(hbmp, size);
+}
+
+// moves thumbnail saved by previous versions into the cache file
+static bool MigrateLegacyThumbnail(ThumbStore* store, const char* filePath) {
+    if (store->nLegacyThumbs < 0) {
+        store->nLegacyThumbs = 0;
+        TempStr thumbsDir = GetThumbnailCacheDirTemp();
+        DirIter di{thumbsDir};
+        for (DirIterEntry* de : di) {
+            if (path::Match(de->filePath, "*.png")) {
+                store->nLegacyThumbs++;
+            }
+        }
+    }
+    if (store->nLegacyThumbs == 0) {
+        return false;
+    }
+    TempStr pngPath = GetLegacyThumbnailPathTemp(filePath);
+    if (!pngPath || !file::Exists(pngPath)) {
+        return false;
+    }
+    FILETIME created = file::GetModificationTime(pngPath);
+    FILETIME fileModified = file::GetModificationTime(filePath);
+    // skip thumbnails of documents that have changed since
+    bool ok = FileTimeDiffInSecs(fileModified, created) <= 0;
+    RenderedBitmap* bmp = ok ? LoadRenderedBitmap(pngPath) : nullptr;
+    ok = bmp && !bmp->GetSize().IsEmpty();
+    if (ok) {
+        ok = WriteThumbnail(store, filePath, bmp->GetBitmap(), bmp->GetSize(), created);
+    }
+    delete bmp;
+    file::Delete(pngPath);
+    store->nLegacyThumbs--;
+    logf("MigrateLegacyThumbnail: '%s' %s\n", pngPath, ok ? "ok" : "failed");
+    return ok;
+}
+
+// returns false if there's no thumbnail for filePath or it's from before the
+// document was modified. fileModified is empty if we don't know (e.g. the
+// document is on a drive that isn't connected)
+static bool FindThumbnail(ThumbStore* store, const char* filePath, FILETIME fileModified,
+                          ThumbIndexEntry* entryOut) {
+    RefreshIndex(store);
+    bool found;
+    int idx = FindIndexEntry(store, ThumbPathHash(filePath), &found);
+    if (!found && MigrateLegacyThumbnail(store, filePath)) {
+        idx = FindIndexEntry(store, ThumbPathHash(filePath), &found);
+    }
+    if (!found || store->index[idx].isRemoved) {
+        return false;
+    }
+    const ThumbIndexEntry& e = store->index[idx];
+    bool knowModified = fileModified.dwLowDateTime != 0 || fileModified.dwHighDateTime != 0;
+    if (knowModified && CompareFileTime(&fileModified, &e.fileModified) != 0) {
+        return false;
+    }
+    *entryOut = e;
+    return true;
 }
 
 void DeleteThumbnailCacheDirectory() {
+    ThumbStore* store = gThumbStore;
+    ScopedCritSec scope(&store->cs);
     TempStr thumbsDir = GetThumbnailCacheDirTemp();
     dir::RemoveAll(thumbsDir);
+    ResetIndex(store, 0);
+    store->lastSize = -1;
+    store->nLegacyThumbs = 0;
 }
 
 void DeleteThumbnailForFile(const char* filePath) {
-    TempStr thumbPath = GetThumbnailPathTemp(filePath);
-    bool ok = file::Delete(thumbPath);
-    auto status = ok ? "ok" : "failed";
-    logf("DeleteThumbnailForFile: file::Remove('%s') %s\n", thumbPath, status);
+    // TODO: why is this happening? Seen in crash reports e.g. 35043
+    if (!filePath) {
+        return;
+    }
+    ThumbStore* store = gThumbStore;
+    ScopedCritSec scope(&store->cs);
+    WriteThumbnailRemoved(store, filePath);
+    TempStr pngPath = GetLegacyThumbnailPathTemp(filePath);
+    if (pngPath && file::Exists(pngPath)) {
+        bool ok = file::Delete(pngPath);
+        auto status = ok ? "ok" : "failed";
+        logf("DeleteThumbnailForFile: file::Remove('%s') %s\n", pngPath, status);
+    }
 }
 
 RenderedBitmap* LoadThumbnail(FileState* fs) {
     if (fs->thumbnail) {
         return fs->thumbnail;
     }
-    TempStr bmpPath = GetThumbnailPathTemp(fs->filePath);
-    if (!bmpPath) {
+    if (!fs->filePath) {
         return nullptr;
     }
-
-    RenderedBitmap* bmp = LoadRenderedBitmap(bmpPath);
-    if (!bmp || bmp->GetSize().IsEmpty()) {
-        delete bmp;
+    FILETIME fileModified = file::GetModificationTime(fs->filePath);
+    ThumbStore* store = gThumbStore;
+    ScopedCritSec scope(&store->cs);
+    ThumbIndexEntry e;
+    if (!FindThumbnail(store, fs->filePath, fileModified, &e)) {
         return nullptr;
     }
-
-    fs->thumbnail = bmp;
+    fs->thumbnail = ReadThumbnail(store, e);
     return fs->thumbnail;
 }
 
+// only looks at the index, doesn't load the thumbnail
 bool HasThumbnail(FileState* fs) {
-    // TODO: optimize, LoadThumbnail() is probably not necessary
-    if (!fs->thumbnail && !LoadThumbnail(fs)) {
-        return false;
+    if (!fs->filePath) {
+        return fs->thumbnail != nullptr;
     }
-
-    TempStr bmpPath = GetThumbnailPathTemp(fs->filePath);
-    if (!bmpPath) {
-        return true;
+    FILETIME fileModified = file::GetModificationTime(fs->filePath);
+    ThumbIndexEntry e;
+    bool hasThumb;
+    {
+        ThumbStore* store = gThumbStore;
+        ScopedCritSec scope(&store->cs);
+        hasThumb = FindThumbnail(store, fs->filePath, fileModified, &e);
     }
-    FILETIME bmpTime = file::GetModificationTime(bmpPath);
-    FILETIME fileTime = file::GetModificationTime(fs->filePath);
-    // delete the thumbnail if the file is newer than the thumbnail
-    if (FileTimeDiffInSecs(fileTime, bmpTime) > 0) {
+    if (!hasThumb) {
         delete fs->thumbnail;
         fs->thumbnail = nullptr;
     }
-
-    return fs->thumbnail != nullptr;
+    return hasThumb;
 }
 
 // takes ownership of bmp
@@ -115,39 +767,212 @@ void SetThumbnail(FileState* fs, RenderedBitmap* bmp) {
 }
 
 void SaveThumbnail(FileState* fs) {
-    if (!fs->thumbnail) {
+    RenderedBitmap* thumbnail = fs->thumbnail;
+    if (!thumbnail || !fs->filePath) {
         return;
     }
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    ThumbStore* store = gThumbStore;
+    ScopedCritSec scope(&store->cs);
+    bool ok = WriteThumbnail(store, fs->filePath, thumbnail->GetBitmap(), thumbnail->GetSize(), now);
+    if (!ok) {
+        logf("SaveThumbnail: failed for '%s'\n", fs->filePath);
+    }
+}
+
+void RemoveThumbnail(FileState* fs) {
+    if (fs->filePath) {
+        ThumbStore* store = gThumbStore;
+        ScopedCritSec scope(&store->cs);
+        WriteThumbnailRemoved(store, fs->filePath);
+    }
+    delete fs->thumbnail;
+    fs->thumbnail = nullptr;
+}
 
-    TempStr thumbnailPath = GetThumbnailPathTemp(fs->filePath);
-    if (!thumbnailPath) {
+// re-writes the cache file with only the latest thumbnails of documents in
+// keepPaths
+void CompactThumbnailCache(const StrVec& keepPaths) {
+    ThumbStore* store = gThumbStore;
+    ScopedCritSec scope(&store->cs);
+    TempStr path = GetThumbsFilePathTemp();
+    if (!path || !file::Exists(path)) {
         return;
     }
-    if (!dir::CreateForFile(thumbnailPath)) {
-        logf("SaveThumbnail: dir::CreateForFile('%s') failed, file path: '%s'\n", thumbnailPath, fs->filePath);
-        ReportIfFast(true);
+    ThumbsFile f;
+    if (!f.Open(true)) {
+        return;
+    }
+    i64 end = CatchUpIndex(store, f.h);
+    if (end < 0) {
+        return;
     }
-    ReportIfFast(!str::EndsWithI(thumbnailPath, ".png"));
 
-    RenderedBitmap* thumbnail = fs->thumbnail;
-    if (!thumbnail) {
+    Vec<u64> keep;
+    for (const char* path : keepPaths) {
+        keep.Append(ThumbPathHash(path));
+    }
+    std::sort(keep.begin(), keep.end());
+
+    i64 liveSize = sizeof(ThumbsHeader);
+    for (const ThumbIndexEntry& e : store->index) {
+        if (!e.isRemoved && std::binary_search(keep.begin(), keep.end(), e.pathHash)) {
+            liveSize += e.size;
+        }
+    }
+    if (liveSize == file::GetSize(f.h)) {
         return;
     }
-    Gdiplus::Bitmap bmp(thumbnail->GetBitmap(), nullptr);
-    CLSID tmpClsid = GetGdiPlusEncoderClsid(L"image/png");
-    TempWStr pathW = ToWStrTemp(thumbnailPath);
-    bmp.Save(pathW, &tmpClsid, nullptr);
+    CompactThumbsFile(store, f.h, &keep);
 }
 
-void RemoveThumbnail(FileState* fs) {
-    if (!HasThumbnail(fs)) {
-        return;
+// renders the top of page 1 at thumbnail size
+RenderedBitmap* RenderThumbnailFromEngine(EngineBase* engine) {
+    RectF pageRect = engine->PageMediabox(1);
+    if (pageRect.IsEmpty()) {
+        return nullptr;
     }
+    pageRect = engine->Transform(pageRect, 1, 1.0f, 0);
+    float zoom = (float)kThumbnailDx / (float)pageRect.dx;
+    if (pageRect.dy > (float)kThumbnailDy / zoom) {
+        pageRect.dy = (float)kThumbnailDy / zoom;
+    }
+    pageRect = engine->Transform(pageRect, 1, 1.0f, 0, true);
+    RenderPageArgs args(1, zoom, 0, &pageRect);
+    return engine->RenderPage(args);
+}
+
+/* Background generation of missing thumbnails.
 
-    char* bmpPath = GetThumbnailPathTemp(fs->filePath);
-    if (bmpPath) {
-        file::Delete(bmpPath);
+Thumbnails are created when a document is closed so documents in history
+that were never closed (or were opened by an older version) have no
+thumbnail on the home page. When the home page shows such documents we
+queue them and a few low priority threads open them without ui, render
+page 1 and save the thumbnail on ui thread.
+
+Each document is tried once per session. CancelThumbnailGeneration()
+drops queued work (and results of documents being rendered) so that
+it doesn't compete with loading a document. They're queued again the
+next time the home page is shown.
+*/
+
+constexpr int kMaxThumbnailThreads = 2;
+// engines load (or map) the whole file so skip huge files
+constexpr i64 kMaxThumbnailSourceSize = 256 * 1024 * 1024;
+
+struct ThumbnailQueue {
+    CRITICAL_SECTION cs;
+    // paths of documents waiting for a thumbnail, last is processed first
+    StrVec queue;
+    // paths that were generated (or failed) and shouldn't be retried
+    StrVec done;
+    int nThreads = 0;
+    // incremented by CancelThumbnailGeneration()
+    AtomicInt generation = 0;
+
+    ThumbnailQueue() { InitializeCriticalSection(&cs); }
+};
+
+static ThumbnailQueue* gThumbnailQueue = new ThumbnailQueue();
+
+struct GeneratedThumbnailData {
+    char* filePath = nullptr;
+    RenderedBitmap* bmp = nullptr;
+    int generation = 0;
+    ~GeneratedThumbnailData() { str::Free(filePath); }
+};
+
+extern void MaybeRedrawHomePage();
+
+static void GeneratedThumbnailFinish(GeneratedThumbnailData* d) {
+    ThumbnailQueue* q = gThumbnailQueue;
+    bool cancelled = d->generation != AtomicIntGet(&q->generation);
+    if (!cancelled) {
+        {
+            ScopedCritSec scope(&q->cs);
+            q->done.Append(d->filePath);
+        }
+        FileState* fs = gFileHistory.FindByPath(d->filePath);
+        if (fs && d->bmp && !fs->thumbnail) {
+            SetThumbnail(fs, d->bmp);
+            d->bmp = nullptr;
+            MaybeRedrawHomePage();
+        }
     }
-    delete fs->thumbnail;
-    fs->thumbnail = nullptr;
+    delete d->bmp;
+    delete d;
+}
+
+static RenderedBitmap* GenerateThumbnail(const char* filePath) {
+    i64 size = file::GetSize(filePath);
+    if (size <= 0 || size > kMaxThumbnailSourceSize) {
+        return nullptr;
+    }
+    // no password ui: documents that need a password are skipped
+    EngineBase* engine = CreateEngineFromFile(filePath, nullptr, true);
+    if (!engine) {
+        return nullptr;
+    }
+    RenderedBitmap* bmp = nullptr;
+    if (engine->PageCount() > 0) {
+        bmp = RenderThumbnailFromEngine(engine);
+    }
+    engine->Release();
+    return bmp;
+}
+
+static void GenerateThumbnailsThread() {
+    ThumbnailQueue* q = gThumbnailQueue;
+    // lowers both cpu and i/o priority
+    SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+    while (true) {
+        auto* d = new GeneratedThumbnailData();
+        {
+            ScopedCritSec scope(&q->cs);
+            int n = q->queue.Size();
+            if (n == 0) {
+                q->nThreads--;
+                delete d;
+                break;
+            }
+            d->filePath = str::Dup(q->queue.RemoveAt(n - 1));
+            d->generation = AtomicIntGet(&q->generation);
+        }
+        d->bmp = GenerateThumbnail(d->filePath);
+        logf("GenerateThumbnailsThread: '%s' %s\n", d->filePath, d->bmp ? "ok" : "failed");
+        auto fn = MkFunc0<GeneratedThumbnailData>(GeneratedThumbnailFinish, d);
+        uitask::Post(fn, "GeneratedThumbnailFinish");
+    }
+    SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_END);
+}
+
+// called on ui thread with documents shown on home page, in display order
+void GenerateMissingThumbnailsAsync(const Vec<FileState*>& states) {
+    ThumbnailQueue* q = gThumbnailQueue;
+    ScopedCritSec scope(&q->cs);
+    // queue is processed from the end
+    for (int i = (int)states.size() - 1; i >= 0; i--) {
+        FileState* fs = states[i];
+        const char* path = fs->filePath;
+        if (!path || fs->thumbnail || fs->isMissing) {
+            continue;
+        }
+        if (q->done.Contains(path) || q->queue.Contains(path)) {
+            continue;
+        }
+        q->queue.Append(path);
+    }
+    while (q->nThreads < kMaxThumbnailThreads && q->nThreads < q->queue.Size()) {
+        q->nThreads++;
+        auto fn = MkFunc0Void(GenerateThumbnailsThread);
+        RunAsync(fn, "GenerateThumbnails");
+    }
+}
+
+void CancelThumbnailGeneration() {
+    ThumbnailQueue* q = gThumbnailQueue;
+    ScopedCritSec scope(&q->cs);
+    q->queue.Reset();
+    AtomicIntInc(&q->generation);
 }
@@ -12,6 +12,11 @@ void SaveThumbnail(FileState* fs);
 void RemoveThumbnail(FileState* fs);
 
 TempStr GetThumbnailCacheDirTemp();
-char* GetThumbnailPathTemp(const char* filePath);
 void DeleteThumbnailForFile(const char* path);
 void DeleteThumbnailCacheDirectory();
+void CompactThumbnailCache(const StrVec& keepPaths);
+
+struct EngineBase;
+RenderedBitmap* RenderThumbnailFromEngine(EngineBase* engine);
+void GenerateMissingThumbnailsAsync(const Vec<FileState*>& states);
+void CancelThumbnailGeneration();
@@ -118,9 +118,17 @@ bool IsValidPageRange(const char* ranges) {
 
 // <s> can be:
 // * "loadonly"
+// * "threads" : render all pages with increasing number of threads
+// * "slowread" : load and render first and last page reading the file slowly
+// * "mmap" : open and load all pages with and without memory-mapping the file
+// * "decode" : decode an image file with our decoder and with GDI+ / WIC
 // * description of page ranges e.g. "1", "1-5", "2-3,6,8-10"
 bool IsBenchPagesInfo(const char* s) {
-    return str::EqI(s, "loadonly") || IsValidPageRange(s);
+    if (str::EqI(s, "loadonly") || str::EqI(s, "threads") || str::EqI(s, "slowread") || str::EqI(s, "mmap") ||
+        str::EqI(s, "decode")) {
+        return true;
+    }
+    return IsValidPageRange(s);
 }
 
 // -view [continuous][singlepage|facing|bookview]
@@ -35,7 +35,11 @@ struct Flags {
     // - name of the file to benchmark
     // - optional (nullptr if not available) string that represents which pages
     //   to benchmark. It can also be a string "loadonly" which means we'll
-    //   only benchmark loading of the catalog
+    //   only benchmark loading of the catalog or "threads" which means we'll
+    //   benchmark rendering all pages with increasing number of threads or
+    //   "slowread" which simulates reading the file from a slow network share
+    //   or "mmap" which compares reading the file memory-mapped and with fread()
+    //   or "decode" which compares decoding an image with our decoder and GDI+
     StrVec pathsToBenchmark;
     bool exitWhenDone = false;
     bool printDialog = false;
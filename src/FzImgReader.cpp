@@ -14,6 +14,10 @@ extern "C" {
 #include "utils/WinUtil.h"
 #include "utils/GdiPlusUtil.h"
 #include "utils/FileUtil.h"
+#include "utils/GuessFileType.h"
+#include "utils/DecodedImage.h"
+#include "utils/WebpReader.h"
+#include "utils/AvifReader.h"
 
 #include "FzImgReader.h"
 
@@ -55,183 +59,83 @@ void fz_drop_context_windows(fz_context* ctx) {
     delete c;
 }
 
-static Gdiplus::Bitmap* ImageFromJpegData(fz_context* ctx, const u8* data, int len) {
-    int w = 0, h = 0, xres = 0, yres = 0;
-    fz_colorspace* cs = nullptr;
-    fz_stream* stm = nullptr;
-    uint8_t orient = 0;
-
-    fz_var(cs);
-    fz_var(stm);
-    fz_var(orient);
-
-    fz_try(ctx) {
-        fz_load_jpeg_info(ctx, data, len, &w, &h, &xres, &yres, &cs, &orient);
-        stm = fz_open_memory(ctx, data, len);
-        stm = fz_open_dctd(ctx, stm, -1, 1, 0, nullptr);
-    }
-    fz_catch(ctx) {
-        fz_drop_colorspace(ctx, cs);
-        cs = nullptr;
-        fz_report_error(ctx);
-    }
-
-#ifndef PixelFormat32bppCMYK
-#define PixelFormat32bppCMYK (15 | (32 << 8) | PixelFormatGDI)
-#endif
-    Gdiplus::PixelFormat fmt = fz_device_rgb(ctx) == cs    ? PixelFormat24bppRGB
-                               : fz_device_gray(ctx) == cs ? PixelFormat24bppRGB
-                               : fz_device_cmyk(ctx) == cs ? PixelFormat32bppCMYK
-                                                           : PixelFormatUndefined;
-    if (PixelFormatUndefined == fmt || w <= 0 || h <= 0 || !cs) {
-        fz_drop_stream(ctx, stm);
-        fz_drop_colorspace(ctx, cs);
-        return nullptr;
-    }
-
-    Gdiplus::Bitmap bmp(w, h, fmt);
-    bmp.SetResolution(xres, yres);
-
-    Gdiplus::Rect bmpRect(0, 0, w, h);
-    Gdiplus::BitmapData bmpData;
-    Gdiplus::Status ok = bmp.LockBits(&bmpRect, Gdiplus::ImageLockModeWrite, fmt, &bmpData);
-    if (ok != Gdiplus::Ok) {
-        fz_drop_stream(ctx, stm);
-        fz_drop_colorspace(ctx, cs);
-        return nullptr;
-    }
-
-    fz_var(bmp);
-    fz_var(bmpRect);
-
-    fz_try(ctx) {
-        for (int y = 0; y < h; y++) {
-            u8* line = (u8*)bmpData.Scan0 + y * bmpData.Stride;
-            for (int x = 0; x < w; x++) {
-                int read = (int)fz_read(ctx, stm, line, cs->n);
-                if (read != cs->n) {
-                    fz_throw(ctx, FZ_ERROR_GENERIC, "insufficient data for image");
-                }
-                if (3 == cs->n) { // RGB -> BGR
-                    std::swap(line[0], line[2]);
-                    line += 3;
-                } else if (1 == cs->n) { // gray -> BGR
-                    line[1] = line[2] = line[0];
-                    line += 3;
-                } else if (4 == cs->n) { // CMYK color inversion
-                    for (int k = 0; k < 4; k++) {
-                        line[k] = 255 - line[k];
-                    }
-                    line += 4;
-                }
-            }
-        }
-    }
-    fz_always(ctx) {
-        bmp.UnlockBits(&bmpData);
-        fz_drop_stream(ctx, stm);
-        fz_drop_colorspace(ctx, cs);
-    }
-    fz_catch(ctx) {
-        fz_report_error(ctx);
-        return nullptr;
-    }
-
-    return bmp.Clone(0, 0, w, h, fmt);
-}
-
-// had to create a copy of fz_convert_pixmap to ensure we always get the alpha
-static fz_pixmap* fz_convert_pixmap2(fz_context* ctx, fz_pixmap* pix, fz_colorspace* ds, fz_colorspace* prf,
-                                     fz_default_colorspaces* default_cs, fz_color_params color_params, int keep_alpha) {
-    fz_pixmap* cvt;
-
-    if (!ds && !keep_alpha) {
-        fz_throw(ctx, FZ_ERROR_GENERIC, "cannot both throw away and keep alpha");
-    }
-
-    cvt = fz_new_pixmap(ctx, ds, pix->w, pix->h, pix->seps, keep_alpha);
-
-    cvt->xres = pix->xres;
-    cvt->yres = pix->yres;
-    cvt->x = pix->x;
-    cvt->y = pix->y;
-    if (pix->flags & FZ_PIXMAP_FLAG_INTERPOLATE) {
-        cvt->flags |= FZ_PIXMAP_FLAG_INTERPOLATE;
-    } else {
-        cvt->flags &= ~FZ_PIXMAP_FLAG_INTERPOLATE;
-    }
-
-    fz_try(ctx) {
-        fz_convert_pixmap_samples(ctx, pix, cvt, prf, default_cs, color_params, 1);
-    }
-    fz_catch(ctx) {
-        fz_drop_pixmap(ctx, cvt);
-        fz_rethrow(ctx);
-    }
-
-    return cvt;
+// fast path for the common pixel layouts, returns false if mupdf has to do the conversion
+static bool ConvertPixmapToBgra(fz_context* ctx, fz_pixmap* pix, DecodedImage* img) {
+    fz_colorspace* cs = pix->colorspace;
+    if (!cs || pix->s != 0) {
+        return false;
+    }
+    int n = pix->n;
+    bool isRgb = fz_colorspace_is_rgb(ctx, cs);
+    bool isGray = fz_colorspace_is_gray(ctx, cs);
+    void (*convert)(const u8*, u8*, int) = nullptr;
+    if (isRgb && n == 3 && !pix->alpha) {
+        convert = pixconv::RgbToBgra;
+    } else if (isRgb && n == 4 && pix->alpha) {
+        convert = pixconv::RgbaToBgra;
+    } else if (isGray && n == 1 && !pix->alpha) {
+        convert = pixconv::GrayToBgra;
+    }
+    if (!convert) {
+        return false;
+    }
+    for (int y = 0; y < pix->h; y++) {
+        const u8* src = pix->samples + (size_t)y * (size_t)pix->stride;
+        convert(src, img->Row(y), pix->w);
+    }
+    return true;
 }
 
-static Gdiplus::Bitmap* ImageFromJp2Data(fz_context* ctx, const u8* data, int len) {
+// decodes any image format supported by mupdf (jpeg, png, gif, bmp, tiff, jpx, jxr, pnm, psd, jbig2)
+static DecodedImage* FzDecodeImage(fz_context* ctx, const u8* data, size_t len) {
+    fz_buffer* buf = nullptr;
+    fz_image* image = nullptr;
     fz_pixmap* pix = nullptr;
-    fz_pixmap* pix_argb = nullptr;
+    fz_pixmap* dst = nullptr;
+    DecodedImage* img = nullptr;
 
+    fz_var(buf);
+    fz_var(image);
     fz_var(pix);
-    fz_var(pix_argb);
-
-    fz_try(ctx) {
-        pix = fz_load_jpx(ctx, data, len, nullptr);
-    }
-    fz_catch(ctx) {
-        fz_report_error(ctx);
-        pix = nullptr;
-    }
-    if (!pix) {
-        return nullptr;
-    }
-
-    int w = pix->w, h = pix->h;
-    Gdiplus::PixelFormat pixelFormat = PixelFormat32bppARGB;
-    Gdiplus::Bitmap bmp(w, h, pixelFormat);
-    bmp.SetResolution(pix->xres, pix->yres);
-
-    Gdiplus::Rect bmpRect(0, 0, w, h);
-    Gdiplus::BitmapData bmpData;
-    Gdiplus::Status ok = bmp.LockBits(&bmpRect, Gdiplus::ImageLockModeWrite, pixelFormat, &bmpData);
-    if (ok != Gdiplus::Ok) {
-        fz_drop_pixmap(ctx, pix);
-        return nullptr;
-    }
-
-    fz_var(bmp);
-    fz_var(bmpRect);
+    fz_var(dst);
+    fz_var(img);
 
     fz_try(ctx) {
-        fz_colorspace* csdest = fz_device_bgr(ctx);
-        fz_color_params colparms = fz_default_color_params;
-        fz_colorspace* prf = nullptr;
-        int alpha = 1;
-        // TODO: could be optimized by creating a bitmap with bmpData.Scan0 as data
-        // Or creating Bitmap after a fact with pix_argb->samples
-        pix_argb = fz_convert_pixmap2(ctx, pix, csdest, prf, nullptr, colparms, alpha);
-        u8* bmpPixels = (u8*)bmpData.Scan0;
-        size_t dataSize = pix_argb->stride * h;
-        memcpy(bmpPixels, pix_argb->samples, dataSize);
+        // mupdf patches jpeg headers in place so it can't share caller's data
+        buf = fz_new_buffer_from_copied_data(ctx, data, len);
+        image = fz_new_image_from_buffer(ctx, buf);
+        pix = fz_get_pixmap_from_image(ctx, image, nullptr, nullptr, nullptr, nullptr);
+        img = new DecodedImage();
+        if (!img->Allocate(pix->w, pix->h)) {
+            fz_throw(ctx, FZ_ERROR_GENERIC, "failed to allocate %dx%d image", pix->w, pix->h);
+        }
+        img->dpiX = pix->xres;
+        img->dpiY = pix->yres;
+        img->hasAlpha = pix->alpha != 0;
+        // mupdf pixmaps with alpha are always premultiplied
+        img->isPremultiplied = img->hasAlpha;
+        if (!ConvertPixmapToBgra(ctx, pix, img)) {
+            // draw directly into our buffer, no need for an intermediate pixmap
+            dst = fz_new_pixmap_with_data(ctx, fz_device_bgr(ctx), img->dx, img->dy, nullptr, 1, img->stride,
+                                          img->pixels);
+            fz_convert_pixmap_samples(ctx, pix, dst, nullptr, nullptr, fz_default_color_params, 1);
+        }
     }
     fz_always(ctx) {
-        bmp.UnlockBits(&bmpData);
+        fz_drop_pixmap(ctx, dst);
         fz_drop_pixmap(ctx, pix);
-        fz_drop_pixmap(ctx, pix_argb);
+        fz_drop_image(ctx, image);
+        fz_drop_buffer(ctx, buf);
     }
     fz_catch(ctx) {
         fz_report_error(ctx);
+        delete img;
         return nullptr;
     }
-
-    return bmp.Clone(0, 0, w, h, pixelFormat);
+    return img;
 }
 
-static Gdiplus::Bitmap* FzImageFromData(const ByteSlice& d) {
+static DecodedImage* FzDecodeImageFromData(const ByteSlice& d) {
     const u8* data = (const u8*)d.data();
     size_t len = d.size();
     if (len > INT_MAX || len < 12) {
@@ -242,17 +146,28 @@ static Gdiplus::Bitmap* FzImageFromData(const ByteSlice& d) {
     if (!ctx) {
         return nullptr;
     }
+    DecodedImage* res = FzDecodeImage(ctx, data, len);
+    fz_drop_context_windows(ctx);
+    return res;
+}
 
-    Gdiplus::Bitmap* result = nullptr;
-    if (str::StartsWith(data, "\xFF\xD8")) {
-        result = ImageFromJpegData(ctx, data, (int)len);
-    } else if (memeq(data, "\0\0\0\x0CjP  \x0D\x0A\x87\x0A", 12)) {
-        result = ImageFromJp2Data(ctx, data, (int)len);
+// decodes image data to a platform-neutral BGRA buffer without using GDI+ or WIC
+DecodedImage* DecodeImageFromData(const ByteSlice& d) {
+    Kind kind = GuessFileTypeFromContent(d);
+    if (kind == kindFileWebp) {
+        return webp::DecodeImage(d);
     }
+    if (kind == kindFileAvif || kind == kindFileHeic) {
+        return AvifDecodeImage(d);
+    }
+    return FzDecodeImageFromData(d);
+}
 
-    fz_drop_context_windows(ctx);
-
-    return result;
+static Gdiplus::Bitmap* FzImageFromData(const ByteSlice& d) {
+    DecodedImage* img = FzDecodeImageFromData(d);
+    Gdiplus::Bitmap* bmp = BitmapFromDecodedImage(img);
+    delete img;
+    return bmp;
 }
 
 Gdiplus::Bitmap* BitmapFromData(const ByteSlice& bmpData) {
@@ -263,6 +178,22 @@ Gdiplus::Bitmap* BitmapFromData(const ByteSlice& bmpData) {
     return FzImageFromData(bmpData);
 }
 
+// for engines that only show the first frame and don't read image metadata
+// (comic book archives, folders of images). Decodes without GDI+ and only
+// falls back to GDI+ / WIC for formats we can't decode ourselves (e.g. tga)
+Gdiplus::Bitmap* BitmapFromDataDecoded(const ByteSlice& bmpData) {
+    Kind kind = GuessFileTypeFromContent(bmpData);
+    if (kind != kindFileTga) {
+        DecodedImage* img = DecodeImageFromData(bmpData);
+        Gdiplus::Bitmap* bmp = BitmapFromDecodedImage(img);
+        delete img;
+        if (bmp) {
+            return bmp;
+        }
+    }
+    return BitmapFromDataWin(bmpData);
+}
+
 RenderedBitmap* LoadRenderedBitmap(const char* path) {
     if (!path) {
         return nullptr;
@@ -8,5 +8,9 @@ struct fz_context;
 fz_context* fz_new_context_windows(size_t maxStore = kFzStoreUnlimited);
 void fz_drop_context_windows(fz_context* ctx);
 
+struct DecodedImage;
+DecodedImage* DecodeImageFromData(const ByteSlice&);
+
 Gdiplus::Bitmap* BitmapFromData(const ByteSlice&);
+Gdiplus::Bitmap* BitmapFromDataDecoded(const ByteSlice&);
 RenderedBitmap* LoadRenderedBitmap(const char* path);
@@ -11,6 +11,7 @@
 #include "Settings.h"
 
 #include "GlobalPrefs.h"
+#include "FileHistory.h"
 
 #include "utils/Log.h"
 
@@ -144,7 +145,12 @@ void SetFileStatePath(FileState* fs, const char* path) {
     if (fs->filePath && str::EqI(fs->filePath, path)) {
         return;
     }
+    // history finds states by path
+    bool inHistory = gFileHistory.RemoveFromIndex(fs);
     str::ReplaceWithCopy(&fs->filePath, path);
+    if (inHistory) {
+        gFileHistory.AddToIndex(fs);
+    }
 }
 
 void SetFileStatePath(FileState* fs, const WCHAR* path) {
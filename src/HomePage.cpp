@@ -890,6 +890,8 @@ void LayoutHomePage(HomePageLayout& l) {
     l.thumbsVisibleDy = thumbsVisibleDy;
 
     Point ptOff(thumbsStartX, thumbsTopY - scrollY);
+    // visible documents without a thumbnail
+    Vec<FileState*> noThumbs;
 
     for (int row = 0; row < thumbsRows; row++) {
         for (int col = 0; col < thumbsCols; col++) {
@@ -916,6 +918,8 @@ void LayoutHomePage(HomePageLayout& l) {
                     rcPage.y += kThumbnailDy - rcPage.dy;
                 }
                 thumb.szThumb = szThumb;
+            } else if (rcPage.y < thumbsBottomY && rcPage.y + rcPage.dy > thumbsTopY) {
+                noThumbs.Append(fs);
             }
             thumb.rcPage = rcPage;
             int iconSpace = DpiScale(hdc, 20);
@@ -930,6 +934,11 @@ void LayoutHomePage(HomePageLayout& l) {
         }
     }
 
+    // thumbnails are only created if we can save them
+    if (noThumbs.Size() > 0 && HasPermission(Perm::SavePreferences)) {
+        GenerateMissingThumbnailsAsync(noThumbs);
+    }
+
     // layout promotion at the bottom (gPromoteSelected already picked)
     if (gShowPromotion && gGlobalPrefs->showPromo && gPromoteSelected) {
         Promote* p = gPromoteSelected;
@@ -2,6 +2,8 @@
    License: Simplified BSD (see COPYING.BSD) */
 
 #include "utils/BaseUtil.h"
+#include "utils/ScopedWin.h"
+#include "utils/DecodedImage.h"
 #include "utils/GdiPlusUtil.h"
 #include "utils/HtmlParserLookup.h"
 #include "utils/CssParser.h"
@@ -1393,6 +1395,166 @@ Vec<HtmlPage*>* HtmlFormatter::FormatAllPages(bool skipEmptyPages) {
     return pages;
 }
 
+// Decoded ebook images are shared by all documents and kept in a cache bounded
+// by total pixel size, so that drawing a page doesn't decode its images again.
+// Entries are looked up by a hash of the compressed data (and not its address)
+// so that they can outlive the document they came from. The hash is only used
+// to find candidates, a match is verified by comparing the compressed data.
+constexpr size_t kMaxCachedImagesSize = 64 * 1024 * 1024;
+
+struct CachedImage {
+    u32 hash = 0;
+    // copy of the compressed data
+    ByteSlice data;
+    DecodedImage img;
+    // one for being in the cache and one for every user
+    int refs = 0;
+
+    CachedImage() = default;
+    ~CachedImage() { data.Free(); }
+
+    size_t CacheSize() const { return img.DataSize() + data.size(); }
+};
+
+struct CachedImages {
+    CRITICAL_SECTION cs;
+    // most recently used first
+    Vec<CachedImage*> images;
+    size_t totalSize = 0;
+
+    CachedImages() { InitializeCriticalSection(&cs); }
+};
+
+static CachedImages* GetCachedImages() {
+    static CachedImages* gCachedImages = new CachedImages();
+    return gCachedImages;
+}
+
+static bool DecodeImageData(const ByteSlice& data, DecodedImage* img) {
+    Bitmap* bmp = BitmapFromData(data);
+    if (!bmp) {
+        return false;
+    }
+    AutoDelete delBmp(bmp);
+    int dx = (int)bmp->GetWidth();
+    int dy = (int)bmp->GetHeight();
+    if (!img->Allocate(dx, dy)) {
+        return false;
+    }
+    // GDI+ draws pre-multiplied alpha much faster than straight alpha
+    img->hasAlpha = Gdiplus::IsAlphaPixelFormat(bmp->GetPixelFormat());
+    img->isPremultiplied = img->hasAlpha;
+    Gdiplus::PixelFormat fmt = img->hasAlpha ? PixelFormat32bppPARGB : PixelFormat32bppRGB;
+    // let GDI+ convert directly into our buffer
+    Gdiplus::Rect bmpRect(0, 0, dx, dy);
+    BitmapData bmpData{};
+    bmpData.Width = (UINT)dx;
+    bmpData.Height = (UINT)dy;
+    bmpData.Stride = img->stride;
+    bmpData.PixelFormat = fmt;
+    bmpData.Scan0 = img->pixels;
+    UINT flags = Gdiplus::ImageLockModeRead | Gdiplus::ImageLockModeUserInputBuf;
+    if (bmp->LockBits(&bmpRect, flags, fmt, &bmpData) != Ok) {
+        return false;
+    }
+    bmp->UnlockBits(&bmpData);
+    return true;
+}
+
+static void ReleaseCachedImageLocked(CachedImage* ci) {
+    ci->refs--;
+    ReportIf(ci->refs < 0);
+    if (ci->refs == 0) {
+        delete ci;
+    }
+}
+
+static void ReleaseCachedImage(CachedImage* ci) {
+    auto cache = GetCachedImages();
+    ScopedCritSec scope(&cache->cs);
+    ReleaseCachedImageLocked(ci);
+}
+
+// always keeps the most recently used image, even if it's over the limit
+static void EvictCachedImagesLocked(CachedImages* cache) {
+    while (cache->totalSize > kMaxCachedImagesSize && cache->images.size() > 1) {
+        CachedImage* ci = cache->images.Pop();
+        cache->totalSize -= ci->CacheSize();
+        ReleaseCachedImageLocked(ci);
+    }
+}
+
+static CachedImage* FindCachedImageLocked(CachedImages* cache, u32 hash, const ByteSlice& data) {
+    auto& images = cache->images;
+    int n = images.Size();
+    for (int i = 0; i < n; i++) {
+        CachedImage* ci = images.at(i);
+        if (ci->hash != hash || ci->data.size() != data.size()) {
+            continue;
+        }
+        if (!memeq(ci->data.data(), data.data(), data.size())) {
+            continue;
+        }
+        if (i > 0) {
+            images.RemoveAt((size_t)i);
+            images.InsertAt(0, ci);
+        }
+        ci->refs++;
+        return ci;
+    }
+    return nullptr;
+}
+
+// caller must call ReleaseCachedImage() on the result
+static CachedImage* GetCachedImage(const ByteSlice& data) {
+    auto cache = GetCachedImages();
+    u32 hash = MurmurHash2(data.data(), data.size());
+    {
+        ScopedCritSec scope(&cache->cs);
+        CachedImage* ci = FindCachedImageLocked(cache, hash, data);
+        if (ci) {
+            return ci;
+        }
+    }
+
+    // decode without holding the lock so that other threads can draw
+    auto ci = new CachedImage();
+    ci->hash = hash;
+    ci->data = data.Clone();
+    if (!DecodeImageData(data, &ci->img)) {
+        delete ci;
+        return nullptr;
+    }
+
+    ScopedCritSec scope(&cache->cs);
+    // another thread might have decoded the same image in the meantime
+    CachedImage* existing = FindCachedImageLocked(cache, hash, data);
+    if (existing) {
+        delete ci;
+        return existing;
+    }
+    ci->refs = 2;
+    cache->images.InsertAt(0, ci);
+    cache->totalSize += ci->CacheSize();
+    EvictCachedImagesLocked(cache);
+    return ci;
+}
+
+static void DrawHtmlImage(Graphics* g, const ByteSlice& data, RectF bbox) {
+    CachedImage* ci = GetCachedImage(data);
+    if (!ci) {
+        return;
+    }
+    DecodedImage* img = &ci->img;
+    Gdiplus::PixelFormat fmt = img->hasAlpha ? PixelFormat32bppPARGB : PixelFormat32bppRGB;
+    // doesn't copy the pixels. A separate Bitmap per draw because GDI+ objects
+    // can't be used from multiple threads at the same time
+    Bitmap bmp(img->dx, img->dy, img->stride, fmt, img->pixels);
+    Status status = g->DrawImage(&bmp, ToGdipRectF(bbox), 0, 0, (float)img->dx, (float)img->dy, UnitPixel);
+    ReportIf(status != Ok && status != Win32Error);
+    ReleaseCachedImage(ci);
+}
+
 // TODO: draw link in the appropriate format (blue text, underlined, should show hand cursor when
 // mouse is over a link. There's a slight complication here: we only get explicit information about
 // strings, not about the whitespace and we should underline the whitespace as well. Also the text
@@ -1450,15 +1612,7 @@ void DrawHtmlPage(Graphics* g, mui::ITextRender* textDraw, Vec<DrawInstr>* drawI
             status = g->DrawLine(&linePen, p1, p2);
             ReportIf(status != Ok);
         } else if (DrawInstrType::Image == i.type) {
-            // TODO: cache the bitmap somewhere (?)
-            Bitmap* bmp = BitmapFromData(i.GetImage());
-            if (bmp) {
-                status = g->DrawImage(bmp, ToGdipRectF(bbox), 0, 0, (float)bmp->GetWidth(), (float)bmp->GetHeight(),
-                                      UnitPixel);
-                // GDI+ sometimes seems to succeed in loading an image because it lazily decodes it
-                ReportIf(status != Ok && status != Win32Error);
-            }
-            delete bmp;
+            DrawHtmlImage(g, i.GetImage(), bbox);
         } else if (DrawInstrType::LinkStart == i.type) {
             // TODO: set text color to blue
             float y = floorf(bbox.y + bbox.dy + 0.5f);
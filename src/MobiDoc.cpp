@@ -462,6 +462,7 @@ static bool IsValidCompression(int comprType) {
 MobiDoc::MobiDoc(const char* filePath) {
     docTocIndex = kInvalidSize;
     fileName = str::Dup(filePath);
+    InitializeCriticalSection(&imagesAccess);
 }
 
 MobiDoc::~MobiDoc() {
@@ -470,6 +471,7 @@ MobiDoc::~MobiDoc() {
     delete huffDic;
     delete doc;
     delete pdbReader;
+    DeleteCriticalSection(&imagesAccess);
 }
 
 bool MobiDoc::ParseHeader() {
@@ -612,7 +614,6 @@ bool MobiDoc::ParseHeader() {
         DecodeExthHeader(firstRecData + offset, recSize - offset);
     }
 
-    LoadImages();
     return true;
 }
 
@@ -737,43 +738,45 @@ bool MobiDoc::LoadImage(size_t imageNo) {
     return true;
 }
 
-void MobiDoc::LoadImages() {
-    if (0 == imagesCount) {
-        return;
+// images are only located when the formatter asks for them. We still have
+// to look at records in order because an eof record ends the image list
+ByteSlice* MobiDoc::ScanImagesUpTo(size_t imageNo) {
+    if (imageNo >= imagesCount) {
+        return nullptr;
     }
-    images = AllocArray<ByteSlice>(imagesCount);
-
-    for (size_t i = 0; i < imagesCount; i++) {
-        if (!LoadImage(i)) {
-            return;
+    ScopedCritSec scope(&imagesAccess);
+    if (!images) {
+        images = AllocArray<ByteSlice>(imagesCount);
+    }
+    while (imagesScanned <= imageNo && !imagesEofSeen) {
+        if (!LoadImage(imagesScanned)) {
+            imagesEofSeen = true;
+            break;
         }
+        imagesScanned++;
+    }
+    if (imageNo >= imagesScanned || images[imageNo].empty()) {
+        return nullptr;
     }
+    return &images[imageNo];
 }
 
 // imgRecIndex corresponds to recindex attribute of <img> tag
 // as far as I can tell, this means: it starts at 1
 // returns nullptr if there is no image (e.g. it's not a format we
 // recognize)
-ByteSlice* MobiDoc::GetImage(size_t imgRecIndex) const {
-    if ((imgRecIndex > imagesCount) || (imgRecIndex < 1)) {
-        return nullptr;
-    }
-    --imgRecIndex;
-    if (images[imgRecIndex].empty()) {
+ByteSlice* MobiDoc::GetImage(size_t imgRecIndex) {
+    if (imgRecIndex < 1) {
         return nullptr;
     }
-    return &images[imgRecIndex];
+    return ScanImagesUpTo(imgRecIndex - 1);
 }
 
 ByteSlice* MobiDoc::GetCoverImage() {
     if (!coverImageRec || coverImageRec < imageFirstRec) {
         return nullptr;
     }
-    size_t imageNo = coverImageRec - imageFirstRec;
-    if (imageNo >= imagesCount || images[imageNo].empty()) {
-        return nullptr;
-    }
-    return &images[imageNo];
+    return ScanImagesUpTo(coverImageRec - imageFirstRec);
 }
 
 // each record can have extra data at the end, which we must discard
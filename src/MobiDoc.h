@@ -21,7 +21,13 @@ struct MobiDoc {
     size_t imageFirstRec = 0; // 0 if no images
     size_t coverImageRec = 0; // 0 if no cover image
 
+    // image records are located and validated lazily, on first access.
+    // images[0..imagesScanned) are valid, the rest are not yet looked at
     ByteSlice* images = nullptr;
+    size_t imagesScanned = 0;
+    bool imagesEofSeen = false;
+    // images are requested from both the layout and the ui thread
+    CRITICAL_SECTION imagesAccess;
 
     HuffDicDecompressor* huffDic = nullptr;
 
@@ -31,8 +37,8 @@ struct MobiDoc {
 
     bool ParseHeader();
     bool LoadDocRecordIntoBuffer(size_t recNo, str::Str& strOut);
-    void LoadImages();
     bool LoadImage(size_t imageNo);
+    ByteSlice* ScanImagesUpTo(size_t imageNo);
     bool LoadForPdbReader(PdbReader* pdbReader);
     bool DecodeExthHeader(const u8* data, size_t dataLen);
 
@@ -45,7 +51,7 @@ struct MobiDoc {
 
     ByteSlice GetHtmlData() const;
     ByteSlice* GetCoverImage();
-    ByteSlice* GetImage(size_t imgRecIndex) const;
+    ByteSlice* GetImage(size_t imgRecIndex);
     const char* GetFileName() const { return fileName; }
     TempStr GetPropertyTemp(const char* name);
     PdbDocType GetDocType() const { return docType; }
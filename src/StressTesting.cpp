@@ -4,11 +4,14 @@
 #include "utils/BaseUtil.h"
 #include "utils/DirIter.h"
 #include "utils/FileUtil.h"
+#include "utils/GdiPlusUtil.h"
 #include "utils/GuessFileType.h"
 #include "utils/HtmlParserLookup.h"
 #include "utils/Timer.h"
 #include "utils/WinUtil.h"
 #include "utils/StrQueue.h"
+#include "utils/ThreadUtil.h"
+#include "utils/DecodedImage.h"
 
 #include "wingui/UIModels.h"
 
@@ -17,6 +20,7 @@
 #include "DocController.h"
 #include "EngineBase.h"
 #include "EngineAll.h"
+#include "FzImgReader.h"
 #include "GlobalPrefs.h"
 #include "ChmModel.h"
 #include "DisplayModel.h"
@@ -93,6 +97,159 @@ static void BenchLoadRender(EngineBase* engine, int pagenum) {
     logf("pagerender %3d: %.2f ms\n", pagenum, timeMs);
 }
 
+struct BenchRenderThreadsData {
+    EngineBase* engine = nullptr;
+    int nPages = 0;
+    AtomicInt nextPage = 0;
+    AtomicInt nFailed = 0;
+};
+
+static void BenchRenderPagesThread(BenchRenderThreadsData* d) {
+    while (true) {
+        int pageNo = AtomicIntInc(&d->nextPage);
+        if (pageNo > d->nPages) {
+            return;
+        }
+        RenderPageArgs args(pageNo, 1.0, 0);
+        RenderedBitmap* rendered = d->engine->RenderPage(args);
+        if (!rendered) {
+            AtomicIntInc(&d->nFailed);
+        }
+        delete rendered;
+    }
+}
+
+// renders all pages with 1, 2, 4 ... threads to see how well rendering
+// of a single document scales
+static void BenchRenderThreads(EngineBase* engine) {
+    int nPages = engine->PageCount();
+    // load all pages first so that we only measure rendering
+    for (int i = 1; i <= nPages; i++) {
+        engine->BenchLoadPage(i);
+    }
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    int maxThreads = std::max((int)si.dwNumberOfProcessors, 16);
+    double singleMs = 0;
+    for (int nThreads = 1; nThreads <= maxThreads; nThreads *= 2) {
+        BenchRenderThreadsData d;
+        d.engine = engine;
+        d.nPages = nPages;
+        auto t = TimeGet();
+        Vec<HANDLE> threads;
+        for (int i = 1; i < nThreads; i++) {
+            HANDLE h = StartThread(MkFunc0(BenchRenderPagesThread, &d), "BenchRenderThread");
+            if (h) {
+                threads.Append(h);
+            }
+        }
+        BenchRenderPagesThread(&d);
+        for (HANDLE h : threads) {
+            WaitForSingleObject(h, INFINITE);
+            CloseHandle(h);
+        }
+        double timeMs = TimeSinceInMs(t);
+        if (nThreads == 1) {
+            singleMs = timeMs;
+        }
+        int nFailed = AtomicIntGet(&d.nFailed);
+        logf("render threads %2d: %.2f ms, %.2f pages/sec, speedup: %.2fx, failed: %d\n", nThreads, timeMs,
+             (double)nPages * 1000.0 / timeMs, singleMs / timeMs, nFailed);
+    }
+}
+
+// best effort: opening a file for non-cached I/O makes the cache manager
+// flush and purge what it has cached for it (unless it's mapped elsewhere)
+static void PurgeFileCache(const char* path) {
+    WCHAR* pathW = ToWStrTemp(path);
+    DWORD share = FILE_SHARE_READ | FILE_SHARE_WRITE;
+    DWORD flags = FILE_FLAG_NO_BUFFERING;
+    HANDLE h = CreateFileW(pathW, GENERIC_READ, share, nullptr, OPEN_EXISTING, flags, nullptr);
+    if (h != INVALID_HANDLE_VALUE) {
+        CloseHandle(h);
+    }
+}
+
+// opens the document and loads all pages in reverse order (to seek all
+// over the file) with cold and warm cache, memory-mapped and with fread()
+// only files that are too big to be read into memory are memory-mapped
+static void BenchMappedFile(const char* path) {
+    logf("file size: %s\n", str::FormatFileSizeTemp(file::GetSize(path)));
+    bool wasMapped = gMupdfUseMappedFiles;
+    for (int mapped = 1; mapped >= 0; mapped--) {
+        gMupdfUseMappedFiles = (mapped == 1);
+        const char* how = mapped ? "mapped" : "fread ";
+        for (int warm = 0; warm <= 1; warm++) {
+            if (!warm) {
+                PurgeFileCache(path);
+            }
+            auto t = TimeGet();
+            EngineBase* engine = CreateEngineFromFile(path, nullptr, true);
+            if (!engine) {
+                logf("Error: failed to load %s\n", path);
+                break;
+            }
+            double openMs = TimeSinceInMs(t);
+            int nPages = engine->PageCount();
+            t = TimeGet();
+            for (int i = nPages; i >= 1; i--) {
+                engine->BenchLoadPage(i);
+            }
+            double pagesMs = TimeSinceInMs(t);
+            logf("%s %s: open %.2f ms, load %d pages %.2f ms\n", how, warm ? "warm" : "cold", openMs, nPages,
+                 pagesMs);
+            SafeEngineRelease(&engine);
+        }
+    }
+    gMupdfUseMappedFiles = wasMapped;
+}
+
+// times the full decode of an image to a Gdiplus::Bitmap (the way EngineCbx
+// and EngineImageDir load pages) with DecodeImageFromData() and with GDI+ / WIC
+static void BenchImageDecode(const char* path) {
+    ByteSlice data = file::ReadFile(path);
+    if (!data) {
+        logf("Error: failed to load %s\n", path);
+        return;
+    }
+    logf("file size: %s\n", str::FormatFileSizeTemp(data.size()));
+    constexpr int kIterations = 8;
+    for (int win = 0; win <= 1; win++) {
+        const char* how = win ? "gdi+/wic" : "decoder ";
+        double minMs = 0;
+        double totalMs = 0;
+        int dx = 0;
+        int dy = 0;
+        int n = 0;
+        for (; n < kIterations; n++) {
+            auto t = TimeGet();
+            Gdiplus::Bitmap* bmp;
+            if (win) {
+                bmp = BitmapFromDataWin(data);
+            } else {
+                DecodedImage* img = DecodeImageFromData(data);
+                bmp = BitmapFromDecodedImage(img);
+                delete img;
+            }
+            double ms = TimeSinceInMs(t);
+            if (!bmp) {
+                break;
+            }
+            dx = (int)bmp->GetWidth();
+            dy = (int)bmp->GetHeight();
+            delete bmp;
+            minMs = (n == 0 || ms < minMs) ? ms : minMs;
+            totalMs += ms;
+        }
+        if (n == 0) {
+            logf("%s: failed to decode\n", how);
+            continue;
+        }
+        logf("%s: %dx%d, min %.2f ms, avg %.2f ms (%d runs)\n", how, dx, dy, minMs, totalMs / n, n);
+    }
+    data.Free();
+}
+
 static void BenchChmLoadOnly(const char* filePath) {
     auto total = TimeGet();
     logf("Starting: %s\n", filePath);
@@ -134,9 +291,27 @@ static void BenchFile(const char* path, const char* pagesSpec) {
     auto total = TimeGet();
     logf("Starting: %s\n", path);
 
+    if (str::EqI(pagesSpec, "mmap")) {
+        BenchMappedFile(path);
+        return;
+    }
+
+    if (str::EqI(pagesSpec, "decode")) {
+        BenchImageDecode(path);
+        return;
+    }
+
+    // how soon can we show the first page of a large file
+    // on a slow network share
+    bool slowRead = str::EqI(pagesSpec, "slowread");
+    if (slowRead) {
+        gMupdfThrottleReadKBps = 4 * 1024;
+    }
+
     auto t = TimeGet();
     EngineBase* engine = CreateEngineFromFile(path, nullptr, true);
     if (!engine) {
+        gMupdfThrottleReadKBps = 0;
         logf("Error: failed to load %s\n", path);
         return;
     }
@@ -152,6 +327,15 @@ static void BenchFile(const char* path, const char* pagesSpec) {
         }
     }
 
+    if (str::EqI(pagesSpec, "threads")) {
+        BenchRenderThreads(engine);
+    }
+
+    if (slowRead) {
+        BenchLoadRender(engine, 1);
+        BenchLoadRender(engine, pages);
+    }
+
     ReportIf(pagesSpec && !IsBenchPagesInfo(pagesSpec));
     Vec<PageRange> ranges;
     if (ParsePageRanges(pagesSpec, ranges)) {
@@ -164,7 +348,9 @@ static void BenchFile(const char* path, const char* pagesSpec) {
         }
     }
 
+    logf("mupdf store:\n%s", GetMupdfStoreStatsTemp());
     SafeEngineRelease(&engine);
+    gMupdfThrottleReadKBps = 0;
 
     logf("Finished (in %.2f ms): %s\n", TimeSinceInMs(total), path);
 }
@@ -884,20 +884,7 @@ static void CreateThumbnailFromFileThread(CreateThumbnailFromFileData* d) {
         delete d;
         return;
     }
-    RectF pageRect = engine->PageMediabox(1);
-    if (pageRect.IsEmpty()) {
-        engine->Release();
-        delete d;
-        return;
-    }
-    pageRect = engine->Transform(pageRect, 1, 1.0f, 0);
-    float zoom = (float)kThumbnailDx / (float)pageRect.dx;
-    if (pageRect.dy > (float)kThumbnailDy / zoom) {
-        pageRect.dy = (float)kThumbnailDy / zoom;
-    }
-    pageRect = engine->Transform(pageRect, 1, 1.0f, 0, true);
-    RenderPageArgs args(1, zoom, 0, &pageRect);
-    d->bmp = engine->RenderPage(args);
+    d->bmp = RenderThumbnailFromEngine(engine);
     engine->Release();
     auto fn = MkFunc0<CreateThumbnailFromFileData>(CreateThumbnailFromFileFinish, d);
     uitask::Post(fn, "SetThumbnailFromFile");
@@ -2340,6 +2327,9 @@ void StartLoadDocument(LoadArgs* argsIn) {
         CrashMe();
     }
 
+    // loading a document is more important than thumbnails for home page
+    CancelThumbnailGeneration();
+
     MainWindow* win = argsIn->win;
     bool failEarly = AdjustPathForMaybeMovedFile(argsIn);
     const char* path = argsIn->FilePath();
@@ -2420,6 +2410,8 @@ MainWindow* LoadDocument(LoadArgs* args) {
         }
     }
 
+    CancelThumbnailGeneration();
+
     MainWindow* win = args->win;
     bool failEarly = AdjustPathForMaybeMovedFile(args);
 
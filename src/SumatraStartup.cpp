@@ -779,6 +779,21 @@ void StartDeleteStaleFiles() {
     RunAsync(fn, "DeleteStaleFilesThread");
 }
 
+// independent of the thumbnail cache, removes cached page sizes and outlines
+// of large documents that are no longer in file history
+static void CleanUpDocCache() {
+    StrVec filePaths;
+    if (!gFileHistory.states) {
+        return;
+    }
+    for (FileState* fs : *gFileHistory.states) {
+        if (fs->filePath) {
+            filePaths.Append(fs->filePath);
+        }
+    }
+    CompactMupdfDocCache(filePaths);
+}
+
 static void LayoutAndFocusOnStartup(MainWindow* win) {
     if (!win || !IsWindow(win->hwndFrame)) {
         return;
@@ -2396,6 +2411,9 @@ int APIENTRY WinMain(_In_ HINSTANCE /*hInstance*/, _In_opt_ HINSTANCE, _In_ LPST
 
     DetectExternalViewers();
 
+    // from now on rendering threads etc. don't wait for log lines to be written
+    StartAsyncLogging();
+
     gRenderCache = new RenderCache();
 
     // TODO: for reasons I don't understand, this must be called before LoadSettings()
@@ -2412,6 +2430,15 @@ int APIENTRY WinMain(_In_ HINSTANCE /*hInstance*/, _In_opt_ HINSTANCE, _In_ LPST
     SetCurrentLang(flags.lang ? flags.lang : gGlobalPrefs->uiLanguage);
     FileWatcherInit();
 
+    // cache of page sizes, outline etc. of large documents, so that they
+    // re-open faster. It's in the thumbnail cache so it's removed with history
+    if (gGlobalPrefs->rememberOpenedFiles) {
+        TempStr cacheDir = GetThumbnailCacheDirTemp();
+        if (cacheDir) {
+            gMupdfDocCacheDir = str::Dup(path::JoinTemp(cacheDir, "docs"));
+        }
+    }
+
     if (flags.testRenderPage) {
         TestRenderPage(flags);
         ShutdownCommon();
@@ -2678,6 +2705,7 @@ ContinueOpenWindow:
     exitCode = RunMessageLoop();
     SafeCloseHandle(&hMutex);
     CleanUpThumbnailCache();
+    CleanUpDocCache();
 
 Exit:
     // logf("Exiting with exit code: %d\n", exitCode);
@@ -2733,6 +2761,7 @@ Exit:
 
     FileWatcherWaitForShutdown();
     delete gRenderCache;
+    FreeBitmapPool();
     SaveCallstackLogs();
     dbghelp::FreeCallstackLogs();
 
@@ -146,6 +146,10 @@ static void BenchRangeTest() {
     utassert(IsBenchPagesInfo("1-3,4,6-9,13"));
     utassert(IsBenchPagesInfo("2-"));
     utassert(IsBenchPagesInfo("loadonly"));
+    utassert(IsBenchPagesInfo("threads"));
+    utassert(IsBenchPagesInfo("slowread"));
+    utassert(IsBenchPagesInfo("mmap"));
+    utassert(IsBenchPagesInfo("decode"));
 
     utassert(!IsBenchPagesInfo(""));
     utassert(!IsBenchPagesInfo("-2"));
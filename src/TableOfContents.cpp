@@ -266,52 +266,20 @@ void ToggleTocBox(MainWindow* win) {
     }
 }
 
-struct VistorForPageNoData {
-    int pageNo = -1;
-
-    TocItem* bestMatch = nullptr;
-    int bestMatchPageNo = 0;
-    int nItems = 0;
-};
-
-void visitTree(VistorForPageNoData* d, TreeItemVisitorData* vd) {
-    auto tocItem = (TocItem*)vd->item;
-    if (!tocItem) {
-        return;
-    }
-    if (!d->bestMatch) {
-        // if nothing else matches, match the root node
-        d->bestMatch = tocItem;
-    }
-    ++d->nItems;
-    int page = tocItem->pageNo;
-    if ((page <= d->pageNo) && (page >= d->bestMatchPageNo) && (page >= 1)) {
-        d->bestMatch = tocItem;
-        d->bestMatchPageNo = page;
-        if (d->pageNo == d->bestMatchPageNo) {
-            // we can stop earlier if we found the exact match
-            vd->stopTraversal = true;
-            return;
-        }
-    }
-}
-
 // find the closest item in tree view to a given page number
 static TocItem* TreeItemForPageNo(TreeView* treeView, int pageNo) {
-    TreeModel* tm = treeView->treeModel;
-    if (!tm) {
+    // the toc tree view only ever shows a TocTree (document's or filtered)
+    TocTree* tocTree = (TocTree*)treeView->treeModel;
+    if (!tocTree) {
         return 0;
     }
-    VistorForPageNoData d;
-    d.pageNo = pageNo;
-    auto fn = MkFunc1<VistorForPageNoData, TreeItemVisitorData*>(visitTree, &d);
-    VisitTreeModelItems(tm, fn);
+    TocItem* item = tocTree->ItemForPageNo(pageNo);
     // if there's only one item, we want to unselect it so that it can
     // be selected by the user
-    if (d.nItems < 2) {
+    if (tocTree->ItemsCount() < 2) {
         return 0;
     }
-    return d.bestMatch;
+    return item;
 }
 
 // TODO: I can't use TreeItem->IsExpanded() because it's not in sync with
@@ -1159,47 +1127,255 @@ void TocTreeCharHandler(CharEvent* ev) {
 }
 #endif
 
-// Recursively build a filtered copy of the TocItem tree.
-// Includes items whose title matches the filter, plus ancestors needed to reach them.
-// Returns nullptr if nothing matches.
-static TocItem* FilterTocItemRec(TocItem* item, const char* filter) {
-    if (!item) {
-        return nullptr;
+// A view of a TocTree that only shows items whose title contains the filter
+// and the ancestors needed to reach them. Refers to the items of the original
+// tree instead of copying them.
+// Lower-cased titles and a trigram index over them are built once, so that
+// each keystroke only has to check items that can possibly match. When the
+// filter is extended, only previous matches are checked.
+struct TocFilteredTree : TocTree {
+    TocTree* orig = nullptr;
+
+    // lower-cased titles of orig->items, 0-terminated
+    str::Str titles;
+    Vec<int> titleOffsets;
+
+    // indexes into orig->items of items whose title contains a trigram
+    // with a given hash, in tree order
+    int* trigramStart = nullptr; // kTrigramBuckets + 1 entries
+    int* trigramItems = nullptr;
+
+    // current filter, lower-cased
+    str::Str filter;
+    // indexes into orig->items of items whose title matches filter
+    Vec<int> matches;
+
+    // for orig->items[i], its position in items or -1 if not visible
+    int* visibleNo = nullptr;
+    // for items[i]: number of visible children, first visible child
+    // and next visible sibling (positions in items)
+    Vec<int> childCount;
+    Vec<int> firstChild;
+    Vec<int> nextSibling;
+
+    // speeds up sequential ChildAt()
+    int currParentNo = -1;
+    int currChildIdx = -1;
+    int currChildNo = -1;
+
+    explicit TocFilteredTree(TocTree* orig);
+    ~TocFilteredTree() override;
+
+    bool SetFilter(const char* filter);
+
+    void BuildIndex() override;
+
+    int ChildCount(TreeItem) override;
+    TreeItem ChildAt(TreeItem, int index) override;
+    bool IsExpanded(TreeItem) override;
+};
+
+constexpr int kTrigramBuckets = 1 << 16;
+
+static char AsciiToLower(char c) {
+    if (c >= 'A' && c <= 'Z') {
+        return c + ('a' - 'A');
     }
-    TocItem* resultFirst = nullptr;
-    TocItem* resultLast = nullptr;
-    for (TocItem* si = item; si; si = si->next) {
-        // recursively filter children
-        TocItem* filteredChildren = FilterTocItemRec(si->child, filter);
-        bool titleMatches = si->title && str::ContainsI(si->title, filter);
-        if (!titleMatches && !filteredChildren) {
-            continue;
+    return c;
+}
+
+static int TrigramBucket(const char* s) {
+    u32 v = ((u32)(u8)s[0] << 16) | ((u32)(u8)s[1] << 8) | (u32)(u8)s[2];
+    return (int)((v * 2654435761u) >> 16) & (kTrigramBuckets - 1);
+}
+
+TocFilteredTree::TocFilteredTree(TocTree* orig) {
+    this->orig = orig;
+    this->root = orig->root;
+    if (!orig->items) {
+        orig->BuildIndex();
+    }
+    int n = orig->ItemsCount();
+
+    for (TocItem* ti : *orig->items) {
+        titleOffsets.Append((int)titles.size());
+        for (const char* s = ti->title; s && *s; s++) {
+            titles.AppendChar(AsciiToLower(*s));
+        }
+        titles.AppendChar(0);
+    }
+
+    // the same trigram can appear several times in a title but must only
+    // be recorded once, which lastItem keeps track of
+    trigramStart = AllocArray<int>(kTrigramBuckets + 1);
+    int* lastItem = AllocArray<int>(kTrigramBuckets);
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < kTrigramBuckets; i++) {
+            lastItem[i] = -1;
+        }
+        for (int i = 0; i < n; i++) {
+            const char* s = titles.Get() + titleOffsets[i];
+            for (; s[0] && s[1] && s[2]; s++) {
+                int b = TrigramBucket(s);
+                if (lastItem[b] == i) {
+                    continue;
+                }
+                lastItem[b] = i;
+                if (pass == 0) {
+                    trigramStart[b + 1]++;
+                } else {
+                    trigramItems[trigramStart[b]++] = i;
+                }
+            }
+        }
+        if (pass == 0) {
+            for (int i = 0; i < kTrigramBuckets; i++) {
+                trigramStart[i + 1] += trigramStart[i];
+            }
+            trigramItems = AllocArray<int>((size_t)trigramStart[kTrigramBuckets] + 1);
+        }
+    }
+    // the second pass advanced trigramStart[b] to the start of bucket b + 1
+    for (int i = kTrigramBuckets; i > 0; i--) {
+        trigramStart[i] = trigramStart[i - 1];
+    }
+    trigramStart[0] = 0;
+    free(lastItem);
+
+    visibleNo = AllocArray<int>(n);
+    for (int i = 0; i < n; i++) {
+        visibleNo[i] = -1;
+    }
+}
+
+TocFilteredTree::~TocFilteredTree() {
+    free(trigramStart);
+    free(trigramItems);
+    free(visibleNo);
+    // items belong to the original tree
+    root = nullptr;
+}
+
+// returns false if nothing matches
+bool TocFilteredTree::SetFilter(const char* newFilter) {
+    str::Str lower;
+    for (const char* s = newFilter; *s; s++) {
+        lower.AppendChar(AsciiToLower(*s));
+    }
+    const char* f = lower.Get();
+    size_t fLen = lower.size();
+
+    // previous matches are a superset of the new ones if the new filter
+    // contains the old one
+    bool narrowing = filter.size() > 0 && str::Find(f, filter.Get());
+
+    // check the smallest set of items that can contain a match: all items,
+    // previous matches or items with one of the filter's trigrams
+    bool checkAll = !narrowing;
+    const int* candidates = matches.LendData();
+    int nCandidates = (int)matches.size();
+    for (size_t i = 0; i + 3 <= fLen; i++) {
+        int b = TrigramBucket(f + i);
+        int nInBucket = trigramStart[b + 1] - trigramStart[b];
+        if (checkAll || nInBucket < nCandidates) {
+            checkAll = false;
+            candidates = trigramItems + trigramStart[b];
+            nCandidates = nInBucket;
+        }
+    }
+    if (checkAll) {
+        nCandidates = orig->ItemsCount();
+    }
+
+    Vec<int> newMatches;
+    for (int i = 0; i < nCandidates; i++) {
+        int itemNo = checkAll ? i : candidates[i];
+        if (str::Find(titles.Get() + titleOffsets[itemNo], f)) {
+            newMatches.Append(itemNo);
+        }
+    }
+    matches = newMatches;
+    filter.Reset();
+    filter.Append(f);
+    BuildIndex();
+    return items->size() > 0;
+}
+
+// items are the matches and their ancestors
+void TocFilteredTree::BuildIndex() {
+    if (!items) {
+        items = new Vec<TocItem*>();
+    }
+    for (TocItem* ti : *items) {
+        visibleNo[ti->treeIdx] = -1;
+    }
+    items->Reset();
+
+    Vec<TocItem*>* all = orig->items;
+    Vec<int> visible;
+    for (int itemNo : matches) {
+        // stop at the first ancestor already made visible by a previous match
+        for (TocItem* ti = all->at(itemNo); ti && visibleNo[ti->treeIdx] < 0; ti = ti->parent) {
+            visibleNo[ti->treeIdx] = 0;
+            visible.Append(ti->treeIdx);
         }
-        // create a copy of this item
-        auto* copy = new TocItem();
-        copy->title = str::Dup(si->title);
-        copy->pageNo = si->pageNo;
-        copy->id = si->id;
-        copy->fontFlags = si->fontFlags;
-        copy->color = si->color;
-        copy->dest = si->dest;
-        copy->destNotOwned = true;
-        copy->isOpenDefault = true;
-        copy->isOpenToggled = false;
-        copy->child = filteredChildren;
-        // set parent pointers on children
-        for (TocItem* c = copy->child; c; c = c->next) {
-            c->parent = copy;
+    }
+    std::sort(visible.begin(), visible.end());
+
+    int n = (int)visible.size();
+    childCount.Reset();
+    firstChild.Reset();
+    nextSibling.Reset();
+    Vec<int> lastChild;
+    for (int i = 0; i < n; i++) {
+        TocItem* ti = all->at(visible[i]);
+        visibleNo[ti->treeIdx] = i;
+        items->Append(ti);
+        childCount.Append(0);
+        firstChild.Append(-1);
+        nextSibling.Append(-1);
+        lastChild.Append(-1);
+        // in tree order the parent always comes before its children
+        if (!ti->parent || visibleNo[ti->parent->treeIdx] < 0) {
+            continue;
         }
-        if (!resultFirst) {
-            resultFirst = copy;
-            resultLast = copy;
+        int parentNo = visibleNo[ti->parent->treeIdx];
+        if (lastChild[parentNo] < 0) {
+            firstChild[parentNo] = i;
         } else {
-            resultLast->next = copy;
-            resultLast = copy;
+            nextSibling[lastChild[parentNo]] = i;
         }
+        lastChild[parentNo] = i;
+        childCount[parentNo]++;
+    }
+    currParentNo = -1;
+    BuildPageIndex();
+}
+
+int TocFilteredTree::ChildCount(TreeItem ti) {
+    int itemNo = visibleNo[((TocItem*)ti)->treeIdx];
+    return childCount[itemNo];
+}
+
+TreeItem TocFilteredTree::ChildAt(TreeItem ti, int idx) {
+    int parentNo = visibleNo[((TocItem*)ti)->treeIdx];
+    if (parentNo != currParentNo || idx != currChildIdx + 1) {
+        currParentNo = parentNo;
+        currChildIdx = 0;
+        currChildNo = firstChild[parentNo];
+        while (currChildIdx < idx) {
+            currChildNo = nextSibling[currChildNo];
+            currChildIdx++;
+        }
+    } else {
+        currChildNo = nextSibling[currChildNo];
+        currChildIdx = idx;
     }
-    return resultFirst;
+    return (TreeItem)items->at(currChildNo);
+}
+
+bool TocFilteredTree::IsExpanded(TreeItem ti) {
+    return ChildCount(ti) > 0;
 }
 
 static void ApplyTocFilter(MainWindow* win, const char* filter) {
@@ -1210,27 +1386,34 @@ static void ApplyTocFilter(MainWindow* win, const char* filter) {
     if (!tab || !tab->currToc) {
         return;
     }
-    // free previous filtered tree
-    delete win->tocFilteredTree;
-    win->tocFilteredTree = nullptr;
-
     TreeView* treeView = win->tocTreeView;
     TocTree* origTree = tab->currToc;
 
     if (!filter || str::Len(filter) == 0) {
-        // restore original tree
+        // restore original tree, keep the filtered tree for its title index
+        auto* filteredTree = (TocFilteredTree*)win->tocFilteredTree;
+        if (filteredTree) {
+            filteredTree->filter.Reset();
+            filteredTree->matches.Reset();
+        }
         SetInitialExpandState(origTree->root, tab->tocState);
         treeView->SetTreeModel(origTree);
         return;
     }
 
-    TocItem* filteredRoot = FilterTocItemRec(origTree->root, filter);
-    if (!filteredRoot) {
+    auto* filteredTree = (TocFilteredTree*)win->tocFilteredTree;
+    if (filteredTree && filteredTree->orig != origTree) {
+        delete filteredTree;
+        filteredTree = nullptr;
+    }
+    if (!filteredTree) {
+        filteredTree = new TocFilteredTree(origTree);
+        win->tocFilteredTree = filteredTree;
+    }
+    if (!filteredTree->SetFilter(filter)) {
         treeView->Clear();
         return;
     }
-    auto* filteredTree = new TocTree(filteredRoot);
-    win->tocFilteredTree = filteredTree;
     treeView->SetTreeModel(filteredTree);
 }
 
@@ -23,6 +23,8 @@
 #include "wingui/UIModels.h"
 
 #include "Settings.h"
+#include "GlobalPrefs.h"
+#include "FileHistory.h"
 #include "DocProperties.h"
 #include "DocController.h"
 #include "EngineBase.h"
@@ -53,6 +55,8 @@ static int Usage() {
     printf("  -save-images - will save images extracted from mobi files\n");
     printf("  -zip-create - creates a sample zip file that needs to be manually checked that it worked\n");
     printf("  -bench-md5 - compare Window's md5 vs. our code\n");
+    printf("  -test-file-history - check FileHistory lookups\n");
+    printf("  -bench-file-history - time FileHistory lookups with 50k entries\n");
     system("pause");
     return 1;
 }
@@ -191,6 +195,123 @@ void ZipCreateTest() {
     }
 }
 
+// the lookup FileHistory used before it had an index
+static FileState* FindByPathLinear(Vec<FileState*>* states, const char* filePath) {
+    FileState* res = nullptr;
+    for (FileState* fs : *states) {
+        if (str::EqI(fs->filePath, filePath)) {
+            res = fs;
+        }
+    }
+    return res;
+}
+
+static int gFileHistoryErrors = 0;
+
+static void CheckFileHistory(bool ok, const char* what) {
+    if (!ok) {
+        printf("FileHistoryTest: %s failed\n", what);
+        gFileHistoryErrors++;
+    }
+}
+
+static void FileHistoryTest() {
+    Vec<FileState*> states;
+    // settings can have states without FilePath
+    states.Append(NewFileState(nullptr));
+    states.Append(NewFileState("C:\\Docs\\a.pdf"));
+    states.Append(NewFileState("D:\\Other\\A.pdf"));
+    states.Append(NewFileState(nullptr));
+    FileHistory history;
+    history.UpdateStatesSource(&states);
+    FileState* a = states[1];
+    FileState* a2 = states[2];
+
+    CheckFileHistory(history.FindByPath("c:\\docs\\A.PDF") == a, "FindByPath ignoring case");
+    CheckFileHistory(!history.FindByPath("C:\\Docs\\b.pdf"), "FindByPath missing");
+    size_t idx = 0;
+    // the last match in history wins
+    CheckFileHistory(history.FindByName("E:\\a.pdf", &idx) == a2 && idx == 2, "FindByName");
+
+    FileState* fs = history.MarkFileLoaded("E:\\a.pdf");
+    CheckFileHistory(states[0] == fs && history.FindByPath("E:\\a.pdf") == fs, "MarkFileLoaded new");
+    CheckFileHistory(history.FindByName("F:\\a.pdf", &idx) == a2 && idx == 3, "FindByName after MarkFileLoaded");
+    history.MarkFileLoaded("D:\\Other\\A.pdf");
+    CheckFileHistory(states[0] == a2 && history.FindByName("F:\\a.pdf", nullptr) == a, "MarkFileLoaded existing");
+    history.MarkFileInexistent("D:\\Other\\A.pdf", true);
+    CheckFileHistory(states.Last() == a2 && history.FindByName("F:\\a.pdf", nullptr) == a2, "MarkFileInexistent");
+
+    // what SetFileStatePath() does for gFileHistory
+    history.RemoveFromIndex(a);
+    str::ReplaceWithCopy(&a->filePath, "C:\\Docs\\b.pdf");
+    history.AddToIndex(a);
+    CheckFileHistory(!history.FindByPath("C:\\Docs\\a.pdf"), "old path after rename");
+    CheckFileHistory(history.FindByPath("C:\\Docs\\B.pdf") == a, "new path after rename");
+
+    history.Remove(a2);
+    DeleteFileState(a2);
+    CheckFileHistory(!history.FindByPath("D:\\Other\\A.pdf"), "Remove");
+    history.Purge();
+    history.Clear(false);
+    CheckFileHistory(states.size() == 0 && !history.FindByName("E:\\a.pdf", nullptr), "Clear");
+    printf("FileHistoryTest: %d errors\n", gFileHistoryErrors);
+}
+
+static void BenchFileHistory() {
+    constexpr int kEntries = 50000;
+    // the linear scan is slow, only time a sample
+    constexpr int kLinearQueries = 1000;
+
+    Vec<FileState*> states;
+    FileHistory history;
+    history.UpdateStatesSource(&states);
+    StrVec paths;
+    for (int i = 0; i < kEntries; i++) {
+        // every 10th file shares a name with a file in another directory
+        int nameNo = (i % 10 == 0) ? i / 2 : i;
+        TempStr path = str::FormatTemp("C:\\Users\\me\\Books\\dir%d\\Book %d.pdf", i % 97, nameNo);
+        history.Append(NewFileState(path));
+        paths.Append(path);
+    }
+    printf("FileHistory with %d entries\n", kEntries);
+
+    auto t = TimeGet();
+    int nFound = 0;
+    for (int i = 0; i < kLinearQueries; i++) {
+        nFound += FindByPathLinear(&states, paths[i * (kEntries / kLinearQueries)]) ? 1 : 0;
+    }
+    double dur = TimeSinceInMs(t);
+    printf("  linear FindByPath: %8.2f us per lookup (found %d)\n", dur * 1000.0 / kLinearQueries, nFound);
+
+    t = TimeGet();
+    nFound = 0;
+    for (int i = 0; i < kEntries; i++) {
+        nFound += history.FindByPath(paths[i]) ? 1 : 0;
+    }
+    dur = TimeSinceInMs(t);
+    printf("  FindByPath:        %8.2f us per lookup (found %d)\n", dur * 1000.0 / kEntries, nFound);
+
+    t = TimeGet();
+    nFound = 0;
+    for (int i = 0; i < kEntries; i++) {
+        TempStr path = str::FormatTemp("D:\\Moved\\Book %d.pdf", i);
+        nFound += history.FindByName(path, nullptr) ? 1 : 0;
+    }
+    dur = TimeSinceInMs(t);
+    printf("  FindByName:        %8.2f us per lookup (found %d)\n", dur * 1000.0 / kEntries, nFound);
+
+    t = TimeGet();
+    nFound = 0;
+    for (int i = 0; i < kEntries; i++) {
+        TempStr path = str::FormatTemp("C:\\Other\\Missing %d.pdf", i);
+        nFound += history.FindByPath(path) ? 1 : 0;
+    }
+    dur = TimeSinceInMs(t);
+    printf("  FindByPath miss:   %8.2f us per lookup\n", dur * 1000.0 / kEntries);
+
+    history.Clear(false);
+}
+
 int TesterMain() {
     RedirectIOToConsole();
 
@@ -229,6 +350,12 @@ int TesterMain() {
         } else if (str::Eq(arg, "-zip-create")) {
             ZipCreateTest();
             ++i;
+        } else if (str::Eq(arg, "-test-file-history")) {
+            FileHistoryTest();
+            ++i;
+        } else if (str::Eq(arg, "-bench-file-history")) {
+            BenchFileHistory();
+            ++i;
         } else {
             // unknown argument
             return Usage();
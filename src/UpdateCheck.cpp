@@ -7,6 +7,7 @@
 #include "utils/SquareTreeParser.h"
 #include "utils/HttpUtil.h"
 #include "utils/WinUtil.h"
+#include "utils/CpuUtil.h"
 #include "utils/FileUtil.h"
 
 #include "wingui/Layout.h"
@@ -10,12 +10,15 @@ extern void BaseUtils_UnitTests();
 // in src/UnitTests.cpp
 extern void SumatraPDF_UnitTests();
 
+extern void Base64Test();
 extern void BaseUtilTest();
 extern void ByteOrderTests();
 extern void CryptoUtilTest();
 extern void CssParser_UnitTests();
+extern void DecodedImageTest();
 extern void DictTest();
 extern void FileUtilTest();
+extern void FuzzyMatchTest();
 extern void HtmlPrettyPrintTest();
 extern void HtmlPullParser_UnitTests();
 extern void JsonTest();
@@ -30,6 +33,13 @@ extern void WinUtilTest();
 extern void StrFormatTest();
 extern void StrVecTest();
 
+// benchmarks, only run with -bench
+extern void Base64Bench();
+extern void DecodedImageBench();
+extern void DictBench();
+extern void SettingsUtilBench();
+extern void StrVecBench();
+
 void GetPrintersInfo(struct str::Str&) {
     /* stub: do nothing */
 }
@@ -38,16 +48,33 @@ void MaybeDelayedWarningNotification(const char*, ...) {
     // a stub to make this compile
 }
 
-int main(int, char**) {
-    printf("Running unit tests\n");
+static void RunBenchmarks() {
+    printf("Running benchmarks\n");
+    Base64Bench();
+    DecodedImageBench();
+    DictBench();
+    SettingsUtilBench();
+    StrVecBench();
+}
 
+int main(int argc, char** argv) {
     InitDynCalls();
+    if (argc > 1 && str::Eq(argv[1], "-bench")) {
+        RunBenchmarks();
+        DestroyTempAllocator();
+        return 0;
+    }
+
+    printf("Running unit tests\n");
+    Base64Test();
     BaseUtilTest();
     ByteOrderTests();
     CryptoUtilTest();
     CssParser_UnitTests();
+    DecodedImageTest();
     DictTest();
     FileUtilTest();
+    FuzzyMatchTest();
     HtmlPrettyPrintTest();
     HtmlPullParser_UnitTests();
     JsonTest();
@@ -2,6 +2,8 @@
    License: Simplified BSD (see COPYING.BSD) */
 
 #include "utils/BaseUtil.h"
+#include "utils/DecodedImage.h"
+#include "utils/GdiPlusUtil.h"
 #include "utils/AvifReader.h"
 
 #ifndef NO_AVIF
@@ -34,12 +36,11 @@ Exit:
     return res;
 }
 
-Gdiplus::Bitmap* AvifImageFromData(const ByteSlice& d) {
-    Gdiplus::Bitmap* bmp = nullptr;
+DecodedImage* AvifDecodeImage(const ByteSlice& d) {
+    DecodedImage* res = nullptr;
     struct heif_image_handle* hdl = nullptr;
     struct heif_image* img = nullptr;
     int dx, dy, srcStride;
-    // int hasAlpha;
     const u8* data = nullptr;
     heif_chroma chroma;
     heif_colorspace cs;
@@ -59,10 +60,8 @@ Gdiplus::Bitmap* AvifImageFromData(const ByteSlice& d) {
     dx = heif_image_handle_get_width(hdl);
     dy = heif_image_handle_get_height(hdl);
 
-    // hasAlpha = heif_image_handle_has_alpha_channel(hdl);
-    // chroma = hasAlpha ? heif_chroma_interleaved_RGBA : heif_chroma_interleaved_RGB;
     chroma = heif_chroma_interleaved_RGB;
-    cs = heif_colorspace_RGB; // TODO: can I do it or do I have to match alpha?
+    cs = heif_colorspace_RGB;
     err = heif_decode_image(hdl, &img, cs, chroma, nullptr);
 
     if (err.code != heif_error_Ok) {
@@ -74,32 +73,15 @@ Gdiplus::Bitmap* AvifImageFromData(const ByteSlice& d) {
         goto Exit;
     }
 
-    bmp = new Gdiplus::Bitmap(dx, dy, PixelFormat32bppRGB);
-    {
-        Gdiplus::Rect bmpRect(0, 0, dx, dy);
-        Gdiplus::BitmapData bmpData;
-        Gdiplus::Status ok = bmp->LockBits(&bmpRect, Gdiplus::ImageLockModeWrite, PixelFormat32bppRGB, &bmpData);
-        if (ok != Gdiplus::Ok) {
-            return nullptr;
-        }
-        int dstStride = bmpData.Stride;
-        u8* src = (u8*)data;
-        u8* dst = (u8*)bmpData.Scan0;
-        for (int i = 0; i < dy; i++) {
-            u8* srcTmp = src;
-            u8* dstTmp = dst;
-            // TODO: memcpy?
-            for (int j = 0; j < dx; j++) {
-                *dst++ = src[2];
-                *dst++ = src[1];
-                *dst++ = src[0];
-                dst++;
-                src += 3;
-            }
-            src = srcTmp + srcStride;
-            dst = dstTmp + dstStride;
-        }
-        bmp->UnlockBits(&bmpData);
+    res = new DecodedImage();
+    if (!res->Allocate(dx, dy)) {
+        delete res;
+        res = nullptr;
+        goto Exit;
+    }
+    for (int y = 0; y < dy; y++) {
+        const u8* src = data + (size_t)y * (size_t)srcStride;
+        pixconv::RgbToBgra(src, res->Row(y), dx);
     }
 
 Exit:
@@ -112,12 +94,22 @@ Exit:
     if (ctx) {
         heif_context_free(ctx);
     }
+    return res;
+}
+
+Gdiplus::Bitmap* AvifImageFromData(const ByteSlice& d) {
+    DecodedImage* img = AvifDecodeImage(d);
+    Gdiplus::Bitmap* bmp = BitmapFromDecodedImage(img);
+    delete img;
     return bmp;
 }
 #else
 Size AvifSizeFromData(const ByteSlice&) {
     return {};
 }
+DecodedImage* AvifDecodeImage(const ByteSlice&) {
+    return nullptr;
+}
 Gdiplus::Bitmap* AvifImageFromData(const ByteSlice&) {
     return nullptr;
 }
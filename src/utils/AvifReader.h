@@ -1,9 +1,12 @@
 /* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
    License: Simplified BSD (see COPYING.BSD) */
 
+struct DecodedImage;
+
 #ifndef NO_AVIF
 
 Size AvifSizeFromData(const ByteSlice&);
+DecodedImage* AvifDecodeImage(const ByteSlice&);
 Gdiplus::Bitmap* AvifImageFromData(const ByteSlice&);
 
-#endif
\ No newline at end of file
+#endif
\ No newline at end of file
@@ -0,0 +1,254 @@
+/* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
+   License: Simplified BSD (see COPYING.BSD) */
+
+#include "utils/BaseUtil.h"
+#include "utils/CpuUtil.h"
+
+#include "utils/Base64.h"
+
+#if IS_INTEL_64 || IS_INTEL_32
+#define BASE64_HAS_SSE 1
+#include <immintrin.h>
+#else
+#define BASE64_HAS_SSE 0
+#endif
+
+#if COMPILER_MSVC
+#define TARGET_SSSE3
+#define TARGET_AVX2
+#else
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace base64 {
+
+constexpr u8 kInvalid = 0xff;
+
+// simd code writes whole registers, so the result can be written up to
+// this many bytes past the decoded data
+constexpr size_t kOutSlack = 32;
+
+struct DecodeTable {
+    u8 v[256];
+};
+
+// built at compile time so that there's nothing to initialize at runtime
+static constexpr DecodeTable MakeDecodeTable() {
+    DecodeTable t{};
+    for (int i = 0; i < 256; i++) {
+        t.v[i] = kInvalid;
+    }
+    const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    for (int i = 0; i < 64; i++) {
+        t.v[(u8)alphabet[i]] = (u8)i;
+    }
+    return t;
+}
+
+static constexpr DecodeTable gDecodeTable = MakeDecodeTable();
+
+// decodes as many groups of 4 characters as possible from the start of s
+// returns number of characters consumed, always a multiple of 4
+using DecodeBlocksFn = size_t (*)(const u8* s, const u8* end, u8* dst);
+
+static ByteSlice DecodeWith(const ByteSlice& data, DecodeBlocksFn decodeBlocks) {
+    size_t sLen = data.size();
+    const u8* s = data.data();
+    const u8* end = s + sLen;
+    u8* result = AllocArray<u8>(sLen / 4 * 3 + 3 + kOutSlack);
+    u8* curr = result;
+    u8 c = 0;
+    int step = 0;
+    while (s < end && *s != '=') {
+        // simd code only handles whole groups of 4 characters so it can
+        // only take over when we're at a group boundary
+        if (decodeBlocks && (step % 4) == 0) {
+            size_t nDone = decodeBlocks(s, end, curr);
+            if (nDone > 0) {
+                s += nDone;
+                curr += nDone / 4 * 3;
+                continue;
+            }
+        }
+        u8 n = gDecodeTable.v[*s];
+        if (kInvalid == n) {
+            if (str::IsWs((char)*s)) {
+                s++;
+                continue;
+            }
+            free(result);
+            return {};
+        }
+        switch (step++ % 4) {
+            case 0:
+                c = n;
+                break;
+            case 1:
+                *curr++ = (c << 2) | (n >> 4);
+                c = n & 0xF;
+                break;
+            case 2:
+                *curr++ = (c << 4) | (n >> 2);
+                c = n & 0x3;
+                break;
+            case 3:
+                *curr++ = (c << 6) | (n >> 0);
+                break;
+        }
+        s++;
+    }
+    size_t size = curr - result;
+    return {result, size};
+}
+
+ByteSlice DecodeScalar(const ByteSlice& data) {
+    return DecodeWith(data, nullptr);
+}
+
+#if BASE64_HAS_SSE
+
+static u32 CountTrailingZeros(u32 v) {
+#if COMPILER_MSVC
+    unsigned long idx;
+    _BitScanForward(&idx, v);
+    return (u32)idx;
+#else
+    return (u32)__builtin_ctz(v);
+#endif
+}
+
+// characters are mapped to their 6-bit values by adding a per-range offset:
+// 'A'-'Z' => -65, 'a'-'z' => -71, '0'-'9' => +4, '+' => +19, '/' => +16
+// returns a bitmask with a bit set for every character outside of the alphabet
+static u32 TranslateSse2(__m128i v, __m128i* vals) {
+    __m128i mAZ = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('Z' + 1), v));
+    __m128i maz = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('a' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), v));
+    __m128i m09 = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), v));
+    __m128i mPlus = _mm_cmpeq_epi8(v, _mm_set1_epi8('+'));
+    __m128i mSlash = _mm_cmpeq_epi8(v, _mm_set1_epi8('/'));
+
+    __m128i shift = _mm_and_si128(mAZ, _mm_set1_epi8(-65));
+    shift = _mm_or_si128(shift, _mm_and_si128(maz, _mm_set1_epi8(-71)));
+    shift = _mm_or_si128(shift, _mm_and_si128(m09, _mm_set1_epi8(4)));
+    shift = _mm_or_si128(shift, _mm_and_si128(mPlus, _mm_set1_epi8(19)));
+    shift = _mm_or_si128(shift, _mm_and_si128(mSlash, _mm_set1_epi8(16)));
+    *vals = _mm_add_epi8(v, shift);
+
+    __m128i valid = _mm_or_si128(_mm_or_si128(mAZ, maz), _mm_or_si128(m09, _mm_or_si128(mPlus, mSlash)));
+    return ~(u32)_mm_movemask_epi8(valid) & 0xffff;
+}
+
+// packs 16 6-bit values into 12 bytes (at the start of the result)
+TARGET_SSSE3 static __m128i PackSsse3(__m128i vals) {
+    // a, b, c, d => (a << 6) | b, (c << 6) | d => (ab << 12) | cd
+    __m128i ab = _mm_maddubs_epi16(vals, _mm_set1_epi32(0x01400140));
+    __m128i abcd = _mm_madd_epi16(ab, _mm_set1_epi32(0x00011000));
+    const __m128i shuf = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    return _mm_shuffle_epi8(abcd, shuf);
+}
+
+// 16 characters per iteration
+TARGET_SSSE3 static size_t DecodeBlocksSsse3(const u8* s, const u8* end, u8* dst) {
+    const u8* start = s;
+    while (end - s >= 16) {
+        __m128i vals;
+        u32 invalid = TranslateSse2(_mm_loadu_si128((const __m128i*)s), &vals);
+        _mm_storeu_si128((__m128i*)dst, PackSsse3(vals));
+        if (invalid != 0) {
+            // keep the groups before the first whitespace / '=' / bad char
+            s += CountTrailingZeros(invalid) / 4 * 4;
+            break;
+        }
+        s += 16;
+        dst += 12;
+    }
+    return (size_t)(s - start);
+}
+
+TARGET_AVX2 static u32 TranslateAvx2(__m256i v, __m256i* vals) {
+    __m256i mAZ = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)),
+                                   _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));
+    __m256i maz = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('a' - 1)),
+                                   _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), v));
+    __m256i m09 = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+                                   _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+    __m256i mPlus = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('+'));
+    __m256i mSlash = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('/'));
+
+    __m256i shift = _mm256_and_si256(mAZ, _mm256_set1_epi8(-65));
+    shift = _mm256_or_si256(shift, _mm256_and_si256(maz, _mm256_set1_epi8(-71)));
+    shift = _mm256_or_si256(shift, _mm256_and_si256(m09, _mm256_set1_epi8(4)));
+    shift = _mm256_or_si256(shift, _mm256_and_si256(mPlus, _mm256_set1_epi8(19)));
+    shift = _mm256_or_si256(shift, _mm256_and_si256(mSlash, _mm256_set1_epi8(16)));
+    *vals = _mm256_add_epi8(v, shift);
+
+    __m256i valid =
+        _mm256_or_si256(_mm256_or_si256(mAZ, maz), _mm256_or_si256(m09, _mm256_or_si256(mPlus, mSlash)));
+    return ~(u32)_mm256_movemask_epi8(valid);
+}
+
+// packs 32 6-bit values into 24 bytes (at the start of the result)
+TARGET_AVX2 static __m256i PackAvx2(__m256i vals) {
+    __m256i ab = _mm256_maddubs_epi16(vals, _mm256_set1_epi32(0x01400140));
+    __m256i abcd = _mm256_madd_epi16(ab, _mm256_set1_epi32(0x00011000));
+    const __m256i shuf = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1, 2, 1, 0, 6, 5, 4,
+                                          10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    __m256i packed = _mm256_shuffle_epi8(abcd, shuf);
+    // each 128-bit lane has 12 bytes at its start, move them next to each other
+    return _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+}
+
+// 32 characters per iteration, the rest is handled by ssse3 version
+TARGET_AVX2 static size_t DecodeBlocksAvx2(const u8* s, const u8* end, u8* dst) {
+    const u8* start = s;
+    while (end - s >= 32) {
+        __m256i vals;
+        u32 invalid = TranslateAvx2(_mm256_loadu_si256((const __m256i*)s), &vals);
+        _mm256_storeu_si256((__m256i*)dst, PackAvx2(vals));
+        if (invalid != 0) {
+            s += CountTrailingZeros(invalid) / 4 * 4;
+            return (size_t)(s - start);
+        }
+        s += 32;
+        dst += 24;
+    }
+    s += DecodeBlocksSsse3(s, end, dst);
+    return (size_t)(s - start);
+}
+
+ByteSlice Decode(const ByteSlice& data) {
+    u32 cpu = CpuFeatures();
+    if (cpu & kCpuAVX2) {
+        return DecodeWith(data, DecodeBlocksAvx2);
+    }
+    if (cpu & kCpuSSSE3) {
+        return DecodeWith(data, DecodeBlocksSsse3);
+    }
+    return DecodeWith(data, nullptr);
+}
+
+const char* SimdKind() {
+    u32 cpu = CpuFeatures();
+    if (cpu & kCpuAVX2) {
+        return "avx2";
+    }
+    if (cpu & kCpuSSSE3) {
+        return "ssse3";
+    }
+    return "none";
+}
+
+#else
+
+ByteSlice Decode(const ByteSlice& data) {
+    return DecodeWith(data, nullptr);
+}
+
+const char* SimdKind() {
+    return "none";
+}
+
+#endif
+
+} // namespace base64
@@ -0,0 +1,19 @@
+/* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
+   License: Simplified BSD (see COPYING.BSD) */
+
+// decoding of base64 (RFC 4648, standard alphabet) as found in FB2 <binary>
+// elements and data: URIs. Uses SSSE3 / AVX2 if the cpu supports it.
+namespace base64 {
+
+// whitespace is skipped and decoding stops at the first '='
+// returns empty ByteSlice if data has characters outside of base64 alphabet
+// caller must free the result
+ByteSlice Decode(const ByteSlice& data);
+
+// plain C version, exposed for testing and benchmarking
+ByteSlice DecodeScalar(const ByteSlice& data);
+
+// "avx2", "ssse3" or "none"
+const char* SimdKind();
+
+} // namespace base64
@@ -0,0 +1,125 @@
+/* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
+   License: Simplified BSD (see COPYING.BSD) */
+
+#include "utils/BaseUtil.h"
+#include "utils/CpuUtil.h"
+
+#include <bitset>
+#include <intrin.h>
+
+u32 CpuID() {
+#if IS_ARM_64
+    // https://learn.microsoft.com/en-us/windows/win32/api/processthreadsapi/nf-processthreadsapi-isprocessorfeaturepresent
+    u32 res = 0;
+    if (IsProcessorFeaturePresent(PF_ARM_NEON_INSTRUCTIONS_AVAILABLE)) {
+        res |= kCpuNEON;
+    }
+    if (IsProcessorFeaturePresent(PF_ARM_V8_CRYPTO_INSTRUCTIONS_AVAILABLE)) {
+        res |= kCpuArmCrypto;
+    }
+    if (IsProcessorFeaturePresent(PF_ARM_V81_ATOMIC_INSTRUCTIONS_AVAILABLE)) {
+        res |= kCpuArmAtomics;
+    }
+    if (IsProcessorFeaturePresent(PF_ARM_V82_DP_INSTRUCTIONS_AVAILABLE)) {
+        res |= kCpuArmDotProd;
+    }
+    return res;
+#else
+    // https://learn.microsoft.com/en-us/cpp/intrinsics/cpuid-cpuidex?view=msvc-170
+    std::bitset<32> f_1_ECX_;
+    std::bitset<32> f_1_EDX_;
+    std::bitset<32> f_7_EBX_;
+    std::bitset<32> f_7_ECX_;
+
+    u32 res = 0;
+    int cpuInfo[4]{};
+    __cpuid(cpuInfo, 0);
+    int nIds = cpuInfo[0];
+    if (nIds >= 1) {
+        __cpuid(cpuInfo, 1);
+        f_1_ECX_ = cpuInfo[2];
+        f_1_EDX_ = cpuInfo[3];
+    }
+    if (nIds >= 7) {
+        __cpuid(cpuInfo, 7);
+        f_7_EBX_ = cpuInfo[1];
+        f_7_ECX_ = cpuInfo[2];
+    }
+
+    if (f_1_EDX_[23]) {
+        res = res | kCpuMMX;
+    }
+    if (f_1_EDX_[25]) {
+        res = res | kCpuSSE;
+    }
+    if (f_1_EDX_[26]) {
+        res = res | kCpuSSE2;
+    }
+    if (f_1_ECX_[0]) {
+        res = res | kCpuSSE3;
+    }
+    if (f_1_ECX_[9]) {
+        res = res | kCpuSSE3 | kCpuSSSE3;
+    }
+    if (f_1_ECX_[19]) {
+        res = res | kCpuSSE41;
+    }
+    if (f_1_ECX_[20]) {
+        res = res | kCpuSSE42;
+    }
+    // avx instructions also need the os to save ymm registers on context switch
+    // (OSXSAVE and xmm/ymm state enabled in XCR0), otherwise they raise #UD
+    bool osSavesYmm = false;
+    if (f_1_ECX_[27]) {
+        u64 xcr0 = _xgetbv(0);
+        osSavesYmm = (xcr0 & 6) == 6;
+    }
+    if (f_1_ECX_[28] && osSavesYmm) {
+        res = res | kCpuAVX;
+    }
+    if (f_7_EBX_[5] && osSavesYmm) {
+        res = res | kCpuAVX2;
+    }
+    return res;
+#endif
+}
+
+const char* LatestSupportedSIMD() {
+    u32 id = CpuID();
+    // x86/x64
+    if (id & kCpuAVX2) {
+        return "avx2";
+    }
+    if (id & kCpuAVX) {
+        return "avx";
+    }
+    if (id & kCpuSSE42) {
+        return "sse42";
+    }
+    if (id & kCpuSSE41) {
+        return "sse41";
+    }
+    if (id & kCpuSSE3) {
+        return "sse3";
+    }
+    if (id & kCpuSSE2) {
+        return "sse2";
+    }
+    if (id & kCpuSSE) {
+        return "sse";
+    }
+    // ARM
+    if (id & kCpuArmDotProd) {
+        return "dotprod";
+    }
+    if (id & kCpuNEON) {
+        return "neon";
+    }
+    return "none";
+}
+
+u32 CpuFeatures() {
+    // initialization of function-level statics is thread-safe
+    static const u32 features = CpuID();
+    return features;
+}
@@ -0,0 +1,25 @@
+/* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
+   License: Simplified BSD (see COPYING.BSD) */
+
+// detection of simd instruction sets supported by the cpu
+
+// x86/x64
+constexpr u32 kCpuMMX = 1 << 1;
+constexpr u32 kCpuSSE = 1 << 2;
+constexpr u32 kCpuSSE2 = 1 << 2;
+constexpr u32 kCpuSSE3 = 1 << 3;
+constexpr u32 kCpuSSE41 = 1 << 4;
+constexpr u32 kCpuSSE42 = 1 << 5;
+constexpr u32 kCpuAVX = 1 << 6;
+constexpr u32 kCpuAVX2 = 1 << 7;
+// ARM
+constexpr u32 kCpuNEON = 1 << 8;
+constexpr u32 kCpuArmCrypto = 1 << 9;
+constexpr u32 kCpuArmAtomics = 1 << 10;
+constexpr u32 kCpuArmDotProd = 1 << 11;
+constexpr u32 kCpuSSSE3 = 1 << 12;
+
+u32 CpuID();
+// same as CpuID() but only queries the cpu once, safe to call from any thread
+u32 CpuFeatures();
+const char* LatestSupportedSIMD();
@@ -0,0 +1,209 @@
+/* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
+   License: Simplified BSD (see COPYING.BSD) */
+
+#include "utils/BaseUtil.h"
+#include "utils/CpuUtil.h"
+
+#include "utils/DecodedImage.h"
+
+#if IS_INTEL_64 || IS_INTEL_32
+#define PIXCONV_HAS_SSE 1
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#else
+#define PIXCONV_HAS_SSE 0
+#endif
+
+#if COMPILER_MSVC
+#define TARGET_SSSE3
+#else
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#endif
+
+DecodedImage::~DecodedImage() {
+    free(pixels);
+}
+
+bool DecodedImage::Allocate(int dxArg, int dyArg) {
+    free(pixels);
+    pixels = nullptr;
+    dx = 0;
+    dy = 0;
+    stride = 0;
+    if (dxArg <= 0 || dyArg <= 0) {
+        return false;
+    }
+    size_t rowSize = (size_t)dxArg * 4;
+    if (rowSize > INT_MAX) {
+        return false;
+    }
+    size_t size = rowSize;
+    if (!mulSafe(&size, (size_t)dyArg)) {
+        return false;
+    }
+    pixels = (u8*)malloc(size);
+    if (!pixels) {
+        return false;
+    }
+    dx = dxArg;
+    dy = dyArg;
+    stride = (int)rowSize;
+    return true;
+}
+
+u8* DecodedImage::Row(int y) const {
+    return pixels + (size_t)y * (size_t)stride;
+}
+
+size_t DecodedImage::DataSize() const {
+    return (size_t)stride * (size_t)dy;
+}
+
+namespace pixconv {
+
+void RgbToBgraScalar(const u8* src, u8* dst, int nPixels) {
+    for (int i = 0; i < nPixels; i++) {
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = src[0];
+        dst[3] = 0xff;
+        src += 3;
+        dst += 4;
+    }
+}
+
+// safe to call with src == dst
+void RgbaToBgraScalar(const u8* src, u8* dst, int nPixels) {
+    for (int i = 0; i < nPixels; i++) {
+        u8 r = src[0];
+        u8 g = src[1];
+        u8 b = src[2];
+        u8 a = src[3];
+        dst[0] = b;
+        dst[1] = g;
+        dst[2] = r;
+        dst[3] = a;
+        src += 4;
+        dst += 4;
+    }
+}
+
+void GrayToBgraScalar(const u8* src, u8* dst, int nPixels) {
+    for (int i = 0; i < nPixels; i++) {
+        u8 v = src[i];
+        dst[0] = v;
+        dst[1] = v;
+        dst[2] = v;
+        dst[3] = 0xff;
+        dst += 4;
+    }
+}
+
+#if PIXCONV_HAS_SSE
+
+static bool HasSsse3() {
+    return (CpuFeatures() & kCpuSSSE3) != 0;
+}
+
+// 16 pixels (48 bytes of RGB) per iteration
+TARGET_SSSE3 static int RgbToBgraSsse3(const u8* src, u8* dst, int nPixels) {
+    const __m128i shuf = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+    const __m128i alpha = _mm_set1_epi32((int)0xff000000);
+    int i = 0;
+    for (; i + 16 <= nPixels; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + 0));
+        __m128i b = _mm_loadu_si128((const __m128i*)(src + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*)(src + 32));
+        __m128i p0 = _mm_shuffle_epi8(a, shuf);
+        __m128i p1 = _mm_shuffle_epi8(_mm_alignr_epi8(b, a, 12), shuf);
+        __m128i p2 = _mm_shuffle_epi8(_mm_alignr_epi8(c, b, 8), shuf);
+        __m128i p3 = _mm_shuffle_epi8(_mm_srli_si128(c, 4), shuf);
+        _mm_storeu_si128((__m128i*)(dst + 0), _mm_or_si128(p0, alpha));
+        _mm_storeu_si128((__m128i*)(dst + 16), _mm_or_si128(p1, alpha));
+        _mm_storeu_si128((__m128i*)(dst + 32), _mm_or_si128(p2, alpha));
+        _mm_storeu_si128((__m128i*)(dst + 48), _mm_or_si128(p3, alpha));
+        src += 48;
+        dst += 64;
+    }
+    return i;
+}
+
+// 4 pixels per iteration
+TARGET_SSSE3 static int RgbaToBgraSsse3(const u8* src, u8* dst, int nPixels) {
+    const __m128i shuf = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    int i = 0;
+    for (; i + 4 <= nPixels; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)src);
+        _mm_storeu_si128((__m128i*)dst, _mm_shuffle_epi8(v, shuf));
+        src += 16;
+        dst += 16;
+    }
+    return i;
+}
+
+// 16 pixels per iteration, only needs SSE2
+static int GrayToBgraSse2(const u8* src, u8* dst, int nPixels) {
+    const __m128i ff = _mm_set1_epi8((char)0xff);
+    int i = 0;
+    for (; i + 16 <= nPixels; i += 16) {
+        __m128i g = _mm_loadu_si128((const __m128i*)src);
+        __m128i ggLo = _mm_unpacklo_epi8(g, g);
+        __m128i ggHi = _mm_unpackhi_epi8(g, g);
+        __m128i gaLo = _mm_unpacklo_epi8(g, ff);
+        __m128i gaHi = _mm_unpackhi_epi8(g, ff);
+        _mm_storeu_si128((__m128i*)(dst + 0), _mm_unpacklo_epi16(ggLo, gaLo));
+        _mm_storeu_si128((__m128i*)(dst + 16), _mm_unpackhi_epi16(ggLo, gaLo));
+        _mm_storeu_si128((__m128i*)(dst + 32), _mm_unpacklo_epi16(ggHi, gaHi));
+        _mm_storeu_si128((__m128i*)(dst + 48), _mm_unpackhi_epi16(ggHi, gaHi));
+        src += 16;
+        dst += 64;
+    }
+    return i;
+}
+
+bool HasSimd() {
+    return HasSsse3();
+}
+
+void RgbToBgra(const u8* src, u8* dst, int nPixels) {
+    int done = 0;
+    if (HasSsse3()) {
+        done = RgbToBgraSsse3(src, dst, nPixels);
+    }
+    RgbToBgraScalar(src + (size_t)done * 3, dst + (size_t)done * 4, nPixels - done);
+}
+
+void RgbaToBgra(const u8* src, u8* dst, int nPixels) {
+    int done = 0;
+    if (HasSsse3()) {
+        done = RgbaToBgraSsse3(src, dst, nPixels);
+    }
+    RgbaToBgraScalar(src + (size_t)done * 4, dst + (size_t)done * 4, nPixels - done);
+}
+
+void GrayToBgra(const u8* src, u8* dst, int nPixels) {
+    int done = GrayToBgraSse2(src, dst, nPixels);
+    GrayToBgraScalar(src + done, dst + (size_t)done * 4, nPixels - done);
+}
+
+#else
+
+bool HasSimd() {
+    return false;
+}
+
+void RgbToBgra(const u8* src, u8* dst, int nPixels) {
+    RgbToBgraScalar(src, dst, nPixels);
+}
+
+void RgbaToBgra(const u8* src, u8* dst, int nPixels) {
+    RgbaToBgraScalar(src, dst, nPixels);
+}
+
+void GrayToBgra(const u8* src, u8* dst, int nPixels) {
+    GrayToBgraScalar(src, dst, nPixels);
+}
+
+#endif
+
+} // namespace pixconv
@@ -0,0 +1,45 @@
+/* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
+   License: Simplified BSD (see COPYING.BSD) */
+
+// Platform-neutral result of decoding an image: top-down rows of 32bpp
+// BGRA pixels (the memory layout of Windows DIBs and PixelFormat32bppARGB).
+// Decoders (webp, avif, mupdf) produce it without going through GDI+
+// so that decoding can be timed and run on any thread.
+struct DecodedImage {
+    int dx = 0;
+    int dy = 0;
+    int stride = 0;
+    u8* pixels = nullptr;
+    // resolution in dpi, 0 if not known
+    int dpiX = 0;
+    int dpiY = 0;
+    bool hasAlpha = false;
+    // true if color channels are already multiplied by alpha
+    bool isPremultiplied = false;
+
+    DecodedImage() = default;
+    DecodedImage(const DecodedImage&) = delete;
+    DecodedImage& operator=(const DecodedImage&) = delete;
+    ~DecodedImage();
+
+    bool Allocate(int dx, int dy);
+    u8* Row(int y) const;
+    size_t DataSize() const;
+};
+
+// converting rows of pixels to 32bpp BGRA. Uses SSE2 / SSSE3 if the cpu
+// supports it and falls back to plain C code otherwise.
+namespace pixconv {
+
+void RgbToBgra(const u8* src, u8* dst, int nPixels);
+void RgbaToBgra(const u8* src, u8* dst, int nPixels);
+void GrayToBgra(const u8* src, u8* dst, int nPixels);
+
+// plain C versions, exposed for testing and benchmarking
+void RgbToBgraScalar(const u8* src, u8* dst, int nPixels);
+void RgbaToBgraScalar(const u8* src, u8* dst, int nPixels);
+void GrayToBgraScalar(const u8* src, u8* dst, int nPixels);
+
+bool HasSimd();
+
+} // namespace pixconv
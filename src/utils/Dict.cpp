@@ -15,21 +15,29 @@ hash table. The actual dict class is a wrapper that provides
 a type-safe API and handles policy decisions like allocations
 (if they are necessary).
 
-Our hash table uses the same parameters as the one in redis
-(but without complexity of incremental hashing):
-- we use chaining on collisions
-- size of the hash table is power of two
+Our hash table is an open addressing table in the style of Swiss tables
+(https://abseil.io/about/design/swisstables):
+- entries are stored inline in a single array, no per-entry allocations
+- each slot has a control byte: empty, deleted or 7 bits of the hash
+- slots are grouped by 16 and we probe a group at a time, comparing
+  16 control bytes with a single SSE2 instruction. Only slots whose
+  control byte matches the hash get a full key comparison
+- size of the hash table is power of two, max load factor is 7/8
 
 TODO:
 - add iterator for keys/values
-- would hash function be faster if we got bytes one at a time
-  but only with a single pass vs. getting 4 at a time but
-  doing 2 passes (the first to calculate the length)?
 */
 
 #include "utils/BaseUtil.h"
 #include "utils/Dict.h"
 
+#if IS_INTEL_64 || IS_INTEL_32
+#define DICT_HAS_SSE2 1
+#include <emmintrin.h>
+#else
+#define DICT_HAS_SSE2 0
+#endif
+
 namespace dict {
 
 class HasherComparator {
@@ -60,151 +68,308 @@ class WStrKeyHasherComparator : public HasherComparator {
     }
 };
 
+static inline char AsciiToLower(char c) {
+    if ('A' <= c && c <= 'Z') {
+        return c + ('a' - 'A');
+    }
+    return c;
+}
+
+// keys that only differ in case of ascii letters are considered equal
+// Note: doesn't use str::EqI() because it might also fold non-ascii chars,
+// depending on the locale, and the hash must agree with the comparison
+class StrIKeyHasherComparator : public HasherComparator {
+    size_t Hash(uintptr_t key) override {
+        // FNV-1a over lower-cased chars, avoids allocating a lower-cased copy
+        const char* s = (const char*)key;
+        u32 h = 2166136261u;
+        while (*s) {
+            h ^= (u8)AsciiToLower(*s++);
+            h *= 16777619u;
+        }
+        return (size_t)h;
+    }
+    bool Equal(uintptr_t k1, uintptr_t k2) override {
+        const char* s1 = (const char*)k1;
+        const char* s2 = (const char*)k2;
+        while (*s1 && AsciiToLower(*s1) == AsciiToLower(*s2)) {
+            s1++;
+            s2++;
+        }
+        return AsciiToLower(*s1) == AsciiToLower(*s2);
+    }
+};
+
+// the key is the value of the pointer, we never dereference it
+// bad bits distribution of pointers is fixed by MixHash()
+class PtrKeyHasherComparator : public HasherComparator {
+    size_t Hash(uintptr_t key) override { return (size_t)key; }
+    bool Equal(uintptr_t k1, uintptr_t k2) override { return k1 == k2; }
+};
+
 static StrKeyHasherComparator gStrKeyHasherComparator;
+static StrIKeyHasherComparator gStrIKeyHasherComparator;
 static WStrKeyHasherComparator gWStrKeyHasherComparator;
+static PtrKeyHasherComparator gPtrKeyHasherComparator;
+
+// control byte values. For used slots it's the top 7 bits of the hash (0...127)
+constexpr u8 kCtrlEmpty = 0x80;
+constexpr u8 kCtrlDeleted = 0xfe;
+
+constexpr size_t kGroupSize = 16;
 
 struct HashTableEntry {
     uintptr_t key;
     uintptr_t val;
-    struct HashTableEntry* next;
 };
 
-// not a class so that it can be allocated with an allocator
 struct HashTable {
-    HashTableEntry** entries;
-    HashTableEntry* freeList;
+    // nSlots control bytes
+    u8* ctrl;
+    // nSlots entries, only valid when ctrl is not empty / deleted
+    HashTableEntry* slots;
 
-    size_t nEntries;
-    size_t nUsed; // total number of inserted entries
+    size_t nSlots;
+    size_t nUsed;    // total number of inserted entries
+    size_t nDeleted; // deleted slots, they still count towards load factor
 
     // for debugging
     size_t nResizes;
     size_t nCollisions;
 };
 
-static HashTable* NewHashTable(size_t size, Allocator* allocator) {
-    ReportIf(!allocator); // we'll leak otherwise
-    HashTable* h = Allocator::AllocArray<HashTable>(allocator, 1);
-    // number of hash table entries should be power of 2
-    size = RoundToPowerOf2(size);
-    // entries are not allocated with allocator since those are large blocks
-    // and we don't want to waste their memory after
-    h->entries = AllocArray<HashTableEntry*>(size);
-    h->nEntries = size;
+#if DICT_HAS_SSE2
+
+// returns a bitmask with a bit set for every control byte equal to c
+static inline u32 GroupMatch(const u8* ctrl, u8 c) {
+    __m128i g = _mm_loadu_si128((const __m128i*)ctrl);
+    return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8((char)c)));
+}
+
+// empty and deleted are the only control bytes with high bit set
+static inline u32 GroupMatchEmptyOrDeleted(const u8* ctrl) {
+    __m128i g = _mm_loadu_si128((const __m128i*)ctrl);
+    return (u32)_mm_movemask_epi8(g);
+}
+
+#else
+
+static inline u32 GroupMatch(const u8* ctrl, u8 c) {
+    u32 res = 0;
+    for (size_t i = 0; i < kGroupSize; i++) {
+        if (ctrl[i] == c) {
+            res |= (1u << i);
+        }
+    }
+    return res;
+}
+
+static inline u32 GroupMatchEmptyOrDeleted(const u8* ctrl) {
+    u32 res = 0;
+    for (size_t i = 0; i < kGroupSize; i++) {
+        if (ctrl[i] & 0x80) {
+            res |= (1u << i);
+        }
+    }
+    return res;
+}
+
+#endif
+
+static inline u32 CountTrailingZeros(u32 v) {
+#if COMPILER_MSVC
+    unsigned long idx;
+    _BitScanForward(&idx, v);
+    return (u32)idx;
+#else
+    return (u32)__builtin_ctz(v);
+#endif
+}
+
+// hashes of some keys (pointers, FNV-1a of short strings) have poorly
+// distributed bits and we use both low bits (group) and high bits (control byte)
+static inline u64 MixHash(size_t hash) {
+    // finalizer from MurmurHash3
+    u64 h = (u64)hash;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static inline u8 HashCtrl(u64 h) {
+    return (u8)(h >> 57);
+}
+
+static inline size_t HashFirstGroup(const HashTable* h, u64 hash) {
+    size_t nGroups = h->nSlots / kGroupSize;
+    return (size_t)hash & (nGroups - 1);
+}
+
+// probing visits groups g, g+1, g+3, g+6... which, for power of 2 number
+// of groups, visits every group exactly once
+static inline size_t NextGroup(const HashTable* h, size_t group, size_t probe) {
+    size_t nGroups = h->nSlots / kGroupSize;
+    return (group + probe) & (nGroups - 1);
+}
+
+// we resize when used + deleted slots reach 7/8 of all slots
+static inline size_t MaxLoad(size_t nSlots) {
+    return nSlots - nSlots / 8;
+}
+
+static void AllocSlots(HashTable* h, size_t nSlots) {
+    nSlots = RoundToPowerOf2(std::max(nSlots, kGroupSize));
+    h->ctrl = AllocArray<u8>(nSlots);
+    memset(h->ctrl, kCtrlEmpty, nSlots);
+    h->slots = AllocArray<HashTableEntry>(nSlots);
+    h->nSlots = nSlots;
+}
+
+static HashTable* NewHashTable(size_t size) {
+    HashTable* h = AllocStruct<HashTable>();
+    AllocSlots(h, size);
     return h;
 }
 
 static void DeleteHashTable(HashTable* h) {
-    free(h->entries);
-    // the rest is freed by allocator
+    free(h->ctrl);
+    free(h->slots);
+    free(h);
 }
 
-static void HashTableResize(HashTable* h, HasherComparator* hc) {
-    size_t newSize = RoundToPowerOf2(h->nEntries + 1);
-    ReportIf(newSize <= h->nEntries);
-    HashTableEntry** newEntries = AllocArray<HashTableEntry*>(newSize);
-    HashTableEntry *e, *next;
-    size_t hash, pos;
-    for (size_t i = 0; i < h->nEntries; i++) {
-        e = h->entries[i];
-        while (e) {
-            next = e->next;
-            hash = hc->Hash(e->key);
-            pos = hash % newSize;
-            e->next = newEntries[pos];
-            newEntries[pos] = e;
-            e = next;
+// returns index of an empty or deleted slot where key with this hash should be inserted
+static size_t FindInsertSlot(const HashTable* h, u64 hash) {
+    size_t group = HashFirstGroup(h, hash);
+    for (size_t probe = 1;; probe++) {
+        const u8* ctrl = h->ctrl + group * kGroupSize;
+        u32 avail = GroupMatchEmptyOrDeleted(ctrl);
+        if (avail != 0) {
+            return group * kGroupSize + CountTrailingZeros(avail);
         }
+        group = NextGroup(h, group, probe);
+        ReportIf(probe > h->nSlots / kGroupSize);
     }
-    free(h->entries);
-    h->entries = newEntries;
-    h->nEntries = newSize;
-    h->nResizes += 1;
+}
 
-    ReportIf(h->nUsed >= (h->nEntries * 3) / 2);
+// returns index of the slot with the key or -1 if not found
+static ptrdiff_t FindSlot(const HashTable* h, HasherComparator* hc, uintptr_t key, u64 hash) {
+    u8 c = HashCtrl(hash);
+    size_t group = HashFirstGroup(h, hash);
+    for (size_t probe = 1;; probe++) {
+        const u8* ctrl = h->ctrl + group * kGroupSize;
+        u32 match = GroupMatch(ctrl, c);
+        while (match != 0) {
+            size_t idx = group * kGroupSize + CountTrailingZeros(match);
+            if (hc->Equal(key, h->slots[idx].key)) {
+                return (ptrdiff_t)idx;
+            }
+            match &= match - 1;
+        }
+        // the key would have been inserted into the first empty slot in probe sequence
+        if (GroupMatch(ctrl, kCtrlEmpty) != 0) {
+            return -1;
+        }
+        group = NextGroup(h, group, probe);
+        if (probe > h->nSlots / kGroupSize) {
+            // only possible if there are no empty slots at all, which max load prevents
+            ReportIf(true);
+            return -1;
+        }
+    }
 }
 
-// micro optimization: this is called often, so we want this check inlined. Resizing logic
-// is called rarely, so doesn't need to be inlined
-static inline void HashTableResizeIfNeeded(HashTable* h, HasherComparator* hc) {
-    // per http://stackoverflow.com/questions/1603712/when-should-i-do-rehashing-of-entire-hash-table/1604428#1604428
-    // when using collision chaining, load factor can be 150%
-    if (h->nUsed < (h->nEntries * 3) / 2) {
-        return;
+static void HashTableResize(HashTable* h, HasherComparator* hc) {
+    u8* oldCtrl = h->ctrl;
+    HashTableEntry* oldSlots = h->slots;
+    size_t oldNSlots = h->nSlots;
+    // if most of the load is deleted slots, rehashing in a table of the same size is enough
+    size_t newSize = oldNSlots;
+    if (h->nUsed >= MaxLoad(oldNSlots) / 2) {
+        newSize = oldNSlots * 2;
     }
-    HashTableResize(h, hc);
-}
-
-// note: allocator must be nullptr for get, non-nullptr for create
-static HashTableEntry* GetOrCreateEntry(HashTable* h, HasherComparator* hc, uintptr_t key, Allocator* allocator,
-                                        bool& newEntry) {
-    bool shouldCreate = (allocator != nullptr);
-    size_t hash = hc->Hash(key);
-    size_t pos = hash % h->nEntries;
-    HashTableEntry* e = h->entries[pos];
-    newEntry = false;
-    while (e) {
-        if (hc->Equal(key, e->key)) {
-            return e;
+    AllocSlots(h, newSize);
+    for (size_t i = 0; i < oldNSlots; i++) {
+        if (oldCtrl[i] & 0x80) {
+            continue;
         }
-        e = e->next;
-    }
-    if (!shouldCreate) {
-        return nullptr;
+        HashTableEntry& e = oldSlots[i];
+        u64 hash = MixHash(hc->Hash(e.key));
+        size_t idx = FindInsertSlot(h, hash);
+        h->ctrl[idx] = HashCtrl(hash);
+        h->slots[idx] = e;
     }
+    free(oldCtrl);
+    free(oldSlots);
+    h->nDeleted = 0;
+    h->nResizes += 1;
+}
 
-    if (h->freeList) {
-        e = h->freeList;
-        h->freeList = h->freeList->next;
-    } else {
-        e = Allocator::AllocArray<HashTableEntry>(allocator, 1);
+// returns existing entry for the key or creates an entry (with uninitialized key / val)
+static HashTableEntry* GetOrCreateEntry(HashTable* h, HasherComparator* hc, uintptr_t key, bool& newEntry) {
+    u64 hash = MixHash(hc->Hash(key));
+    ptrdiff_t idx = FindSlot(h, hc, key, hash);
+    if (idx >= 0) {
+        newEntry = false;
+        return &h->slots[idx];
     }
-    e->next = h->entries[pos];
-    h->entries[pos] = e;
-    h->nUsed++;
-    if (e->next != nullptr) {
+    // micro optimization: check is inlined, resizing logic is called rarely
+    if (h->nUsed + h->nDeleted >= MaxLoad(h->nSlots)) {
+        HashTableResize(h, hc);
+    }
+    size_t pos = FindInsertSlot(h, hash);
+    if (h->ctrl[pos] == kCtrlDeleted) {
+        h->nDeleted--;
+    }
+    if (pos / kGroupSize != HashFirstGroup(h, hash)) {
         h->nCollisions++;
     }
+    h->ctrl[pos] = HashCtrl(hash);
+    h->nUsed++;
     newEntry = true;
-    return e;
+    return &h->slots[pos];
 }
 
-static bool RemoveEntry(HashTable* h, HasherComparator* hc, uintptr_t key, uintptr_t* removedValOut) {
-    size_t hash = hc->Hash(key);
-    size_t pos = hash % h->nEntries;
-    HashTableEntry* e = h->entries[pos];
-    while (e) {
-        if (hc->Equal(key, e->key)) {
-            break;
-        }
-        e = e->next;
+static HashTableEntry* GetEntry(HashTable* h, HasherComparator* hc, uintptr_t key) {
+    u64 hash = MixHash(hc->Hash(key));
+    ptrdiff_t idx = FindSlot(h, hc, key, hash);
+    if (idx < 0) {
+        return nullptr;
     }
-    if (!e) {
+    return &h->slots[idx];
+}
+
+static bool RemoveEntry(HashTable* h, HasherComparator* hc, uintptr_t key, uintptr_t* removedValOut) {
+    u64 hash = MixHash(hc->Hash(key));
+    ptrdiff_t idx = FindSlot(h, hc, key, hash);
+    if (idx < 0) {
         return false;
     }
-
-    // remove the the entry from the list
-    HashTableEntry* e2 = h->entries[pos];
-    if (e2 == e) {
-        h->entries[pos] = e->next;
+    // if the group has an empty slot, lookups never probe past it,
+    // so the slot can become empty. Otherwise it must be a tombstone
+    // so that lookups for keys in later groups don't stop here
+    const u8* ctrl = h->ctrl + (idx / kGroupSize) * kGroupSize;
+    if (GroupMatch(ctrl, kCtrlEmpty) != 0) {
+        h->ctrl[idx] = kCtrlEmpty;
     } else {
-        while (e2->next != e) {
-            e2 = e2->next;
-        }
-        e2->next = e->next;
+        h->ctrl[idx] = kCtrlDeleted;
+        h->nDeleted++;
     }
-    e->next = h->freeList;
-    h->freeList = e;
-    *removedValOut = e->val;
+    *removedValOut = h->slots[idx].val;
     ReportIf(0 == h->nUsed);
     h->nUsed -= 1;
     return true;
 }
 
-MapStrToInt::MapStrToInt(size_t initialSize) {
-    // we use PoolAllocator to allocate HashTableEntry entries
-    // and copies of string keys
-    h = NewHashTable(initialSize, &allocator);
+MapStrToInt::MapStrToInt(size_t initialSize, bool ignoreCase) {
+    // we use PoolAllocator to allocate copies of string keys
+    h = NewHashTable(initialSize);
+    hc = &gStrKeyHasherComparator;
+    if (ignoreCase) {
+        hc = &gStrIKeyHasherComparator;
+    }
 }
 
 MapStrToInt::~MapStrToInt() {
@@ -226,7 +391,7 @@ size_t MapStrToInt::Count() const {
 //   * sets existingKeyOut to (interned) key
 bool MapStrToInt::Insert(const char* key, int val, int* existingValOut, const char** existingKeyOut) {
     bool newEntry;
-    HashTableEntry* e = GetOrCreateEntry(h, &gStrKeyHasherComparator, (uintptr_t)key, &allocator, newEntry);
+    HashTableEntry* e = GetOrCreateEntry(h, hc, (uintptr_t)key, newEntry);
     if (!newEntry) {
         if (existingValOut) {
             *existingValOut = (int)e->val;
@@ -241,14 +406,12 @@ bool MapStrToInt::Insert(const char* key, int val, int* existingValOut, const ch
     if (existingKeyOut) {
         *existingKeyOut = (const char*)e->key;
     }
-
-    HashTableResizeIfNeeded(h, &gStrKeyHasherComparator);
     return true;
 }
 
 bool MapStrToInt::Remove(const char* key, int* removedValOut) const {
     uintptr_t removedVal;
-    bool removed = RemoveEntry(h, &gStrKeyHasherComparator, (uintptr_t)key, &removedVal);
+    bool removed = RemoveEntry(h, hc, (uintptr_t)key, &removedVal);
     if (removed && removedValOut) {
         *removedValOut = (int)removedVal;
     }
@@ -256,9 +419,52 @@ bool MapStrToInt::Remove(const char* key, int* removedValOut) const {
 }
 
 bool MapStrToInt::Get(const char* key, int* valOut) const {
-    StrKeyHasherComparator hc;
+    HashTableEntry* e = GetEntry(h, hc, (uintptr_t)key);
+    if (!e) {
+        return false;
+    }
+    *valOut = (int)e->val;
+    return true;
+}
+
+MapPtrToInt::MapPtrToInt(size_t initialSize) {
+    h = NewHashTable(initialSize);
+}
+
+MapPtrToInt::~MapPtrToInt() {
+    DeleteHashTable(h);
+}
+
+size_t MapPtrToInt::Count() const {
+    return h->nUsed;
+}
+
+// returns false and sets existingValOut if the key already exists
+bool MapPtrToInt::Insert(const void* key, int val, int* existingValOut) {
     bool newEntry;
-    HashTableEntry* e = GetOrCreateEntry(h, &hc, (uintptr_t)key, nullptr, newEntry);
+    HashTableEntry* e = GetOrCreateEntry(h, &gPtrKeyHasherComparator, (uintptr_t)key, newEntry);
+    if (!newEntry) {
+        if (existingValOut) {
+            *existingValOut = (int)e->val;
+        }
+        return false;
+    }
+    e->key = (uintptr_t)key;
+    e->val = (intptr_t)val;
+    return true;
+}
+
+bool MapPtrToInt::Remove(const void* key, int* removedValOut) const {
+    uintptr_t removedVal;
+    bool removed = RemoveEntry(h, &gPtrKeyHasherComparator, (uintptr_t)key, &removedVal);
+    if (removed && removedValOut) {
+        *removedValOut = (int)removedVal;
+    }
+    return removed;
+}
+
+bool MapPtrToInt::Get(const void* key, int* valOut) const {
+    HashTableEntry* e = GetEntry(h, &gPtrKeyHasherComparator, (uintptr_t)key);
     if (!e) {
         return false;
     }
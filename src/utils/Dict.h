@@ -4,11 +4,12 @@
 namespace dict {
 
 struct HashTable;
+class HasherComparator;
 
 // we are very generous with default initial size. It's a trade-off
 // between memory used by hash table and how often we need to resize it.
-// We allocate size*sizeof(ptr) which is 64k on 32-bit for 16k entries.
-// 64k is very little on today's machines, especially for short-lived
+// We allocate size*(2*sizeof(ptr)+1) which is 144k on 32-bit for 16k entries.
+// That is very little on today's machines, especially for short-lived
 // hash tables.
 // Should use smaller values for long-lived hash tables, especially
 // if there are many of them.
@@ -17,13 +18,15 @@ enum {
 };
 
 // a dictionary whose keys are char * strings and the values are integers
+// if ignoreCase is true, keys that only differ in case of ascii letters are the same
 // note: StrToInt would be more natural name but it's re-#define'd in <shlwapi.h>
 class MapStrToInt {
   public:
     PoolAllocator allocator;
     HashTable* h = nullptr;
+    HasherComparator* hc = nullptr;
 
-    explicit MapStrToInt(size_t initialSize = DEFAULT_HASH_TABLE_INITIAL_SIZE);
+    explicit MapStrToInt(size_t initialSize = DEFAULT_HASH_TABLE_INITIAL_SIZE, bool ignoreCase = false);
     ~MapStrToInt();
 
     size_t Count() const;
@@ -34,4 +37,21 @@ class MapStrToInt {
     bool Get(const char* key, int* valOut) const;
 };
 
+// a dictionary whose keys are pointers (compared by value, never dereferenced)
+// and the values are integers
+class MapPtrToInt {
+  public:
+    HashTable* h = nullptr;
+
+    explicit MapPtrToInt(size_t initialSize = DEFAULT_HASH_TABLE_INITIAL_SIZE);
+    ~MapPtrToInt();
+
+    size_t Count() const;
+
+    bool Insert(const void* key, int val, int* existingValOut = nullptr);
+
+    bool Remove(const void* key, int* removedValOut) const;
+    bool Get(const void* key, int* valOut) const;
+};
+
 } // namespace dict
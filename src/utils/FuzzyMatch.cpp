@@ -0,0 +1,182 @@
+/* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
+   License: Simplified BSD (see COPYING.BSD) */
+
+#include "utils/BaseUtil.h"
+
+#include "utils/FuzzyMatch.h"
+
+// scoring is the same as fzf's (algo.go)
+namespace fuzzy {
+
+constexpr int kScoreMatch = 16;
+constexpr int kScoreGapStart = -3;
+constexpr int kScoreGapExtension = -1;
+
+constexpr int kBonusBoundary = kScoreMatch / 2;
+constexpr int kBonusNonWord = kScoreMatch / 2;
+constexpr int kBonusCamel123 = kBonusBoundary + kScoreGapExtension;
+constexpr int kBonusConsecutive = -(kScoreGapStart + kScoreGapExtension);
+constexpr int kBonusFirstCharMultiplier = 2;
+constexpr int kBonusBoundaryWhite = kBonusBoundary + 2;
+constexpr int kBonusBoundaryDelimiter = kBonusBoundary + 1;
+
+enum class CharClass : u8 {
+    White,
+    NonWord,
+    Delimiter,
+    Lower,
+    Upper,
+    Letter,
+    Number,
+};
+
+static CharClass ClassOf(char c) {
+    if (c >= 'a' && c <= 'z') {
+        return CharClass::Lower;
+    }
+    if (c >= 'A' && c <= 'Z') {
+        return CharClass::Upper;
+    }
+    if (c >= '0' && c <= '9') {
+        return CharClass::Number;
+    }
+    if ((u8)c >= 0x80) {
+        // part of utf-8 sequence
+        return CharClass::Letter;
+    }
+    switch (c) {
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n':
+            return CharClass::White;
+        case '/':
+        case '\\':
+        case ',':
+        case ':':
+        case ';':
+        case '|':
+            return CharClass::Delimiter;
+    }
+    return CharClass::NonWord;
+}
+
+static bool IsWordClass(CharClass c) {
+    return c >= CharClass::Lower;
+}
+
+static int BonusFor(CharClass prev, CharClass curr) {
+    if (IsWordClass(curr)) {
+        switch (prev) {
+            case CharClass::White:
+                return kBonusBoundaryWhite;
+            case CharClass::Delimiter:
+                return kBonusBoundaryDelimiter;
+            case CharClass::NonWord:
+                return kBonusBoundary;
+            default:
+                break;
+        }
+    }
+    if ((prev == CharClass::Lower && curr == CharClass::Upper) ||
+        (prev != CharClass::Number && curr == CharClass::Number)) {
+        return kBonusCamel123;
+    }
+    if (curr == CharClass::NonWord || curr == CharClass::Delimiter) {
+        return kBonusNonWord;
+    }
+    if (curr == CharClass::White) {
+        return kBonusBoundaryWhite;
+    }
+    return 0;
+}
+
+// fzf's v1 algorithm: find the first occurrence of pattern as a subsequence,
+// then scan backwards from its end to find the shortest match ending there.
+// linear in textLen, unlike the optimal (but quadratic) v2
+bool Match(const char* text, const char* textLower, int textLen, const char* pattern, int patLen, int* scoreOut,
+           u8* posOut) {
+    *scoreOut = 0;
+    if (posOut) {
+        memset(posOut, 0, (size_t)textLen);
+    }
+    if (patLen == 0) {
+        return true;
+    }
+    int pidx = 0;
+    int end = -1;
+    for (int i = 0; i < textLen; i++) {
+        if (textLower[i] == pattern[pidx]) {
+            pidx++;
+            if (pidx == patLen) {
+                end = i + 1;
+                break;
+            }
+        }
+    }
+    if (end < 0) {
+        return false;
+    }
+    int start = end;
+    pidx = patLen - 1;
+    while (pidx >= 0) {
+        start--;
+        if (textLower[start] == pattern[pidx]) {
+            pidx--;
+        }
+    }
+
+    int score = 0;
+    int consecutive = 0;
+    int firstBonus = 0;
+    bool inGap = false;
+    CharClass prevClass = start > 0 ? ClassOf(text[start - 1]) : CharClass::White;
+    pidx = 0;
+    for (int i = start; i < end; i++) {
+        CharClass cls = ClassOf(text[i]);
+        if (textLower[i] == pattern[pidx]) {
+            score += kScoreMatch;
+            int bonus = BonusFor(prevClass, cls);
+            if (consecutive == 0) {
+                firstBonus = bonus;
+            } else {
+                // a boundary in the middle of a chunk counts for the rest of it
+                if (bonus >= kBonusBoundary && bonus > firstBonus) {
+                    firstBonus = bonus;
+                }
+                bonus = std::max(std::max(bonus, firstBonus), kBonusConsecutive);
+            }
+            score += (pidx == 0) ? bonus * kBonusFirstCharMultiplier : bonus;
+            if (posOut) {
+                posOut[i] = 1;
+            }
+            inGap = false;
+            consecutive++;
+            pidx++;
+        } else {
+            score += inGap ? kScoreGapExtension : kScoreGapStart;
+            inGap = true;
+            consecutive = 0;
+            firstBonus = 0;
+        }
+        prevClass = cls;
+    }
+    *scoreOut = score;
+    return true;
+}
+
+TempStr ToLowerTemp(const char* s, int sLen) {
+    if (sLen < 0) {
+        sLen = str::Leni(s);
+    }
+    TempStr res = str::DupTemp(s, (size_t)sLen);
+    for (int i = 0; i < sLen; i++) {
+        char c = res[i];
+        if (c >= 'A' && c <= 'Z') {
+            res[i] = c + ('a' - 'A');
+        }
+    }
+    return res;
+}
+
+} // namespace fuzzy
@@ -0,0 +1,18 @@
+/* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
+   License: Simplified BSD (see COPYING.BSD) */
+
+// fuzzy matching in the style of fzf: pattern matches text if all of its
+// characters appear in text in the same order. The score rewards matches
+// at the start of words and consecutive characters and penalizes gaps.
+namespace fuzzy {
+
+// textLower and pattern must be lower-cased with ToLowerTemp(). text is the
+// original, used to find word boundaries (including camelCase)
+// if posOut is given, it gets textLen flags set to 1 for matched characters
+bool Match(const char* text, const char* textLower, int textLen, const char* pattern, int patLen, int* scoreOut,
+           u8* posOut = nullptr);
+
+// only lower-cases ascii letters, so the result has the same length
+TempStr ToLowerTemp(const char* s, int sLen = -1);
+
+} // namespace fuzzy
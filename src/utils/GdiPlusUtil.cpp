@@ -7,6 +7,7 @@
 #include "utils/FileUtil.h"
 #include "utils/GuessFileType.h"
 #include "utils/ByteReader.h"
+#include "utils/DecodedImage.h"
 #include "utils/TgaReader.h"
 #include "utils/WebpReader.h"
 #include "utils/AvifReader.h"
@@ -377,6 +378,41 @@ static Bitmap* DecodeWithGdiplus(const ByteSlice& bmpData) {
     return bmp;
 }
 
+// copies pixels of a platform-neutral DecodedImage into a GDI+ bitmap
+Bitmap* BitmapFromDecodedImage(const DecodedImage* img) {
+    if (!img || !img->pixels) {
+        return nullptr;
+    }
+    Gdiplus::PixelFormat fmt = PixelFormat32bppRGB;
+    if (img->hasAlpha) {
+        fmt = img->isPremultiplied ? PixelFormat32bppPARGB : PixelFormat32bppARGB;
+    }
+    int dx = img->dx;
+    int dy = img->dy;
+    auto bmp = new Bitmap(dx, dy, fmt);
+    if (bmp->GetLastStatus() != Ok) {
+        delete bmp;
+        return nullptr;
+    }
+    if (img->dpiX > 0 && img->dpiY > 0) {
+        bmp->SetResolution((float)img->dpiX, (float)img->dpiY);
+    }
+    Gdiplus::Rect bmpRect(0, 0, dx, dy);
+    BitmapData bmpData;
+    Status ok = bmp->LockBits(&bmpRect, Gdiplus::ImageLockModeWrite, fmt, &bmpData);
+    if (ok != Ok) {
+        delete bmp;
+        return nullptr;
+    }
+    size_t rowSize = (size_t)dx * 4;
+    for (int y = 0; y < dy; y++) {
+        u8* dst = (u8*)bmpData.Scan0 + (ptrdiff_t)y * bmpData.Stride;
+        memcpy(dst, img->Row(y), rowSize);
+    }
+    bmp->UnlockBits(&bmpData);
+    return bmp;
+}
+
 Bitmap* BitmapFromDataWin(const ByteSlice& bmpData) {
     Bitmap* bmp = nullptr;
 
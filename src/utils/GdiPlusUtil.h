@@ -2,6 +2,7 @@
    License: Simplified BSD (see COPYING.BSD) */
 
 struct RenderedBitmap;
+struct DecodedImage;
 
 Gdiplus::RectF RectToRectF(Gdiplus::Rect r);
 
@@ -19,6 +20,7 @@ RectF MeasureText(Gdiplus::Graphics* g, Gdiplus::Font* f, const WCHAR* s, size_t
 
 void GetBaseTransform(Gdiplus::Matrix& m, Gdiplus::RectF pageRect, float zoom, int rotation);
 
+Gdiplus::Bitmap* BitmapFromDecodedImage(const DecodedImage*);
 Gdiplus::Bitmap* BitmapFromDataWin(const ByteSlice& bmpData);
 Size ImageSizeFromData(const ByteSlice&);
 Size ImageSizeFromHeader(const ByteSlice&);
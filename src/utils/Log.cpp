@@ -157,29 +157,10 @@ void logValueSize(const char* name, i64 v) {
     logToPipe(s);
 }
 
-static void log2(const char* s, bool always) {
-    bool skipLog = !always && gSkipDuplicateLines && gLogBuf && gLogBuf->Contains(s);
-
-    if (!skipLog) {
-        // in reduced logging mode, we do want to log to at least the debugger
-        if (gLogToDebugger || IsDebuggerPresent() || gReducedLogging) {
-            OutputDebugStringA(s);
-        }
-    }
-    if (gDestroyedLogging) {
-        return;
-    }
-    if (gReducedLogging) {
-        // if the pipe already connected, do log to it even if disabled
-        // we do want easy logging, just want to reduce doing stuff
-        // that can break crash handling
-        if (gLogToPipe && IsValidHandle(hLogPipe)) {
-            logToPipe(s);
-        }
-        return;
-    }
-    gLogMutex.Lock();
-
+// writes s to log buffer (for crash reports), console, log file and logview pipe
+// must be called with gLogMutex locked
+// logFile is an already opened gLogFilePath, if nullptr we open it
+static void logLocked(const char* s, size_t n, bool skipLog, FILE* logFile) {
     InterlockedIncrement(&gAllowAllocFailure);
     defer {
         InterlockedDecrement(&gAllowAllocFailure);
@@ -195,8 +176,6 @@ static void log2(const char* s, bool always) {
         }
     }
 
-    size_t n = str::Len(s);
-
     // when skipping, we skip buf (crash reports) and console
     // but write to file and logview
     if (!skipLog) {
@@ -208,7 +187,9 @@ static void log2(const char* s, bool always) {
         fflush(stdout);
     }
 
-    if (gLogFilePath) {
+    if (logFile) {
+        fwrite(s, 1, n, logFile);
+    } else if (gLogFilePath) {
         auto f = fopen(gLogFilePath, "a");
         if (f != nullptr) {
             fwrite(s, 1, n, f);
@@ -217,6 +198,650 @@ static void log2(const char* s, bool always) {
         }
     }
     logToPipe(s, n);
+}
+
+/*
+Async logging.
+
+Writing log lines to a file, console and logview pipe is slow and
+is done with gLogMutex held, which adds latency to rendering threads
+that log timings.
+
+With async logging each thread appends records to its own ring buffer,
+without taking locks, and a background thread writes them out.
+logf() doesn't format the string, only copies the format and arguments
+into a binary record, formatting is done by the background thread.
+
+Memory is bounded: at most kMaxLogRings rings of kLogRingSize bytes.
+When a ring is full the record is dropped and we log how many were dropped.
+If a thread can't get a ring (too many threads logging), it logs synchronously.
+*/
+
+constexpr u32 kLogRingSize = 64 * 1024; // must be power of 2
+constexpr int kMaxLogRings = 16;
+// records that don't fit are formatted and logged as text
+constexpr int kMaxLogBinaryRecord = 2 * 1024;
+// records bigger than this are logged synchronously
+constexpr u32 kMaxLogRecordSize = kLogRingSize / 4;
+constexpr DWORD kLogFlushIntervalMs = 20;
+
+enum class LogRecordKind : u16 {
+    Pad, // skip to the start of the ring
+    Text,
+    Binary,
+};
+
+// records are aligned to sizeof(LogRecordHeader) so that a header
+// always fits before the end of the ring
+struct LogRecordHeader {
+    u32 size; // of the whole record, including header
+    u32 seq;  // for merging records from all rings in the order they were logged
+    LogRecordKind kind;
+    u16 always;
+    u32 dataSize;
+};
+
+struct LogRing {
+    // free-running byte offsets, wrap around at 4 GB
+    // head is only written by the thread that owns the ring, tail by the flusher
+    AtomicInt head = 0;
+    AtomicInt tail = 0;
+    AtomicInt nDropped = 0;
+    AtomicInt inUse = 0;
+    u8* buf = nullptr;
+
+    // only used by the owning thread
+    u32 pendingHead = 0;
+    // only used by the flusher
+    int nDroppedReported = 0;
+};
+
+bool gLogAsync = false;
+bool gLogDeferFormatting = true;
+
+static LogRing gLogRings[kMaxLogRings];
+static AtomicInt gLogSeq = 0;
+static AtomicInt gLogFlusherStop = 0;
+static HANDLE gLogFlusherThread = nullptr;
+static HANDLE gLogFlushEvent = nullptr;
+// only one thread drains the rings at a time
+static Mutex gLogFlushMutex;
+
+// releases the ring when the thread exits, so that it can be re-used
+// records that weren't flushed yet stay in the ring
+struct LogRingOwner {
+    LogRing* ring = nullptr;
+    ~LogRingOwner() {
+        if (ring) {
+            AtomicIntSet(&ring->inUse, 0);
+        }
+    }
+};
+
+static thread_local LogRingOwner gLogRingOwner;
+
+static LogRing* GetThreadLogRing() {
+    if (gLogRingOwner.ring) {
+        return gLogRingOwner.ring;
+    }
+    for (LogRing& r : gLogRings) {
+        if (InterlockedCompareExchange(&r.inUse, 1, 0) != 0) {
+            continue;
+        }
+        if (!r.buf) {
+            // never freed because other threads might still be logging after DestroyLogging()
+            r.buf = AllocArray<u8>(kLogRingSize);
+            if (!r.buf) {
+                AtomicIntSet(&r.inUse, 0);
+                return nullptr;
+            }
+        }
+        r.pendingHead = (u32)r.head;
+        gLogRingOwner.ring = &r;
+        return &r;
+    }
+    return nullptr;
+}
+
+static u32 LogRecordSize(size_t dataSize) {
+    size_t n = sizeof(LogRecordHeader) + dataSize;
+    return (u32)RoundUp(n, sizeof(LogRecordHeader));
+}
+
+// returns header of a record of a given size or nullptr if ring is full
+// the record is not visible to the flusher until LogRingCommit()
+static LogRecordHeader* LogRingReserve(LogRing* r, u32 size, bool always) {
+    u32 head = r->pendingHead;
+    u32 tail = (u32)AtomicIntGet(&r->tail);
+    u32 pos = head & (kLogRingSize - 1);
+    u32 toEnd = kLogRingSize - pos;
+    u32 needed = (size > toEnd) ? toEnd + size : size;
+    if (kLogRingSize - (head - tail) < needed) {
+        AtomicIntInc(&r->nDropped);
+        return nullptr;
+    }
+    if (size > toEnd) {
+        auto pad = (LogRecordHeader*)(r->buf + pos);
+        pad->size = toEnd;
+        pad->kind = LogRecordKind::Pad;
+        head += toEnd;
+        pos = 0;
+    }
+    r->pendingHead = head + size;
+    auto hdr = (LogRecordHeader*)(r->buf + pos);
+    hdr->size = size;
+    hdr->seq = (u32)AtomicIntInc(&gLogSeq);
+    hdr->always = always ? 1 : 0;
+    return hdr;
+}
+
+static void LogRingCommit(LogRing* r) {
+    AtomicIntSet(&r->head, (int)r->pendingHead);
+    // the flusher wakes up periodically, only wake it up early if we're running out of space
+    u32 used = r->pendingHead - (u32)AtomicIntGet(&r->tail);
+    if (used > kLogRingSize / 2) {
+        SetEvent(gLogFlushEvent);
+    }
+}
+
+// returns false if the caller should log synchronously
+static bool logAsyncText(const char* s, bool always) {
+    LogRing* r = GetThreadLogRing();
+    if (!r) {
+        return false;
+    }
+    size_t n = str::Len(s);
+    u32 size = LogRecordSize(n + 1);
+    if (size > kMaxLogRecordSize) {
+        return false;
+    }
+    LogRecordHeader* hdr = LogRingReserve(r, size, always);
+    if (hdr) {
+        hdr->kind = LogRecordKind::Text;
+        hdr->dataSize = (u32)n;
+        memcpy(hdr + 1, s, n + 1);
+        LogRingCommit(r);
+    }
+    return true;
+}
+
+// what we need to know about a printf-style argument to copy it
+enum class LogArgType {
+    None, // %%
+    Int,
+    Int64,
+    SizeT, // also pointers
+    Double,
+    Str,
+    Unsupported, // %*d, wide strings etc.
+};
+
+// parses printf conversion specification that starts at s (after '%')
+// returns end of the specification
+static const char* parseLogDirective(const char* s, LogArgType& t) {
+    t = LogArgType::Unsupported;
+    while (*s && str::FindChar("-+ #0", *s)) {
+        s++;
+    }
+    while (str::IsDigit(*s) || *s == '.') {
+        s++;
+    }
+    // '*' (width or precision from argument) is not supported
+    bool is64 = false;
+    bool isSizeT = false;
+    bool hasLen = false;
+    if (str::StartsWith(s, "I64") || str::StartsWith(s, "ll")) {
+        is64 = true;
+        s += (*s == 'I') ? 3 : 2;
+    } else if (str::StartsWith(s, "I32")) {
+        s += 3;
+    } else if (*s == 'z' || *s == 'I' || *s == 't') {
+        isSizeT = true;
+        s++;
+    } else if (*s == 'j') {
+        is64 = true;
+        s++;
+    } else if (*s == 'h' || *s == 'l' || *s == 'w' || *s == 'L') {
+        hasLen = true;
+        s++;
+        if (*s == 'h') {
+            s++;
+        }
+    }
+    char c = *s;
+    if (!c) {
+        return s;
+    }
+    s++;
+    switch (c) {
+        case '%':
+            t = LogArgType::None;
+            break;
+        case 'd':
+        case 'i':
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+            t = is64 ? LogArgType::Int64 : (isSizeT ? LogArgType::SizeT : LogArgType::Int);
+            break;
+        case 'c':
+            // %lc is a wide char
+            if (!hasLen && !is64 && !isSizeT) {
+                t = LogArgType::Int;
+            }
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            // %Lf is a long double
+            if (!hasLen && !is64 && !isSizeT) {
+                t = LogArgType::Double;
+            }
+            break;
+        case 's':
+            // %ls, %ws are wide strings
+            if (!hasLen && !is64 && !isSizeT) {
+                t = LogArgType::Str;
+            }
+            break;
+        case 'p':
+            t = LogArgType::SizeT;
+            break;
+    }
+    return s;
+}
+
+// binary record data is a copy of format string followed by arguments:
+// Int as i32, Int64, SizeT and Double as 8 bytes, Str as u32 len + chars + '\0'
+// returns size of data or -1 if fmt has directives we don't support or the data doesn't fit
+static int encodeLogArgs(u8* d, int dSize, const char* fmt, va_list args) {
+    int fmtLen = str::Leni(fmt);
+    if (fmtLen + 1 > dSize) {
+        return -1;
+    }
+    memcpy(d, fmt, fmtLen + 1);
+    u8* curr = d + fmtLen + 1;
+    u8* end = d + dSize;
+    const char* s = fmt;
+    while ((s = str::FindChar(s, '%')) != nullptr) {
+        LogArgType t;
+        s = parseLogDirective(s + 1, t);
+        if (t == LogArgType::None) {
+            continue;
+        }
+        if (t == LogArgType::Unsupported || end - curr < 8) {
+            return -1;
+        }
+        switch (t) {
+            case LogArgType::Int: {
+                i32 v = va_arg(args, int);
+                memcpy(curr, &v, sizeof(v));
+                curr += sizeof(v);
+            } break;
+            case LogArgType::Int64: {
+                i64 v = va_arg(args, i64);
+                memcpy(curr, &v, sizeof(v));
+                curr += sizeof(v);
+            } break;
+            case LogArgType::SizeT: {
+                u64 v = (u64)va_arg(args, uintptr_t);
+                memcpy(curr, &v, sizeof(v));
+                curr += sizeof(v);
+            } break;
+            case LogArgType::Double: {
+                double v = va_arg(args, double);
+                memcpy(curr, &v, sizeof(v));
+                curr += sizeof(v);
+            } break;
+            case LogArgType::Str: {
+                const char* v = va_arg(args, const char*);
+                if (!v) {
+                    v = "(null)";
+                }
+                u32 n = (u32)str::Len(v);
+                if ((size_t)(end - curr) < sizeof(n) + n + 1) {
+                    return -1;
+                }
+                memcpy(curr, &n, sizeof(n));
+                memcpy(curr + sizeof(n), v, n + 1);
+                curr += sizeof(n) + n + 1;
+            } break;
+        }
+    }
+    return (int)(curr - d);
+}
+
+// formats into a stack buffer instead of str::Str::AppendFmt(), which uses malloc(),
+// because this is also used by the crash handler
+template <typename T>
+static void appendLogArg(str::Str& out, const char* spec, T v) {
+    char buf[512];
+    str::BufFmt(buf, dimof(buf), spec, v);
+    out.Append(buf);
+}
+
+// formats data of a binary record created by encodeLogArgs()
+static void formatLogArgs(str::Str& out, const u8* d) {
+    const char* s = (const char*)d;
+    const u8* arg = d + str::Len(s) + 1;
+    char spec[32];
+    while (*s) {
+        const char* pct = str::FindChar(s, '%');
+        if (!pct) {
+            out.Append(s);
+            break;
+        }
+        out.Append(s, pct - s);
+        LogArgType t;
+        s = parseLogDirective(pct + 1, t);
+        size_t specLen = std::min((size_t)(s - pct), dimof(spec) - 1);
+        memcpy(spec, pct, specLen);
+        spec[specLen] = 0;
+        switch (t) {
+            case LogArgType::None:
+                out.AppendChar('%');
+                break;
+            case LogArgType::Int: {
+                i32 v;
+                memcpy(&v, arg, sizeof(v));
+                arg += sizeof(v);
+                appendLogArg(out, spec, v);
+            } break;
+            case LogArgType::Int64: {
+                i64 v;
+                memcpy(&v, arg, sizeof(v));
+                arg += sizeof(v);
+                appendLogArg(out, spec, v);
+            } break;
+            case LogArgType::SizeT: {
+                u64 v;
+                memcpy(&v, arg, sizeof(v));
+                arg += sizeof(v);
+                appendLogArg(out, spec, (uintptr_t)v);
+            } break;
+            case LogArgType::Double: {
+                double v;
+                memcpy(&v, arg, sizeof(v));
+                arg += sizeof(v);
+                appendLogArg(out, spec, v);
+            } break;
+            case LogArgType::Str: {
+                u32 n;
+                memcpy(&n, arg, sizeof(n));
+                const char* v = (const char*)arg + sizeof(n);
+                if (str::Eq(spec, "%s")) {
+                    // don't truncate long strings
+                    out.Append(v, n);
+                } else {
+                    appendLogArg(out, spec, v);
+                }
+                arg += sizeof(n) + n + 1;
+            } break;
+            default:
+                // encodeLogArgs() doesn't create records with those
+                ReportIf(true);
+                return;
+        }
+    }
+}
+
+// returns false if the caller should format the string and log it as text
+static bool logAsyncFmt(const char* fmt, va_list args, bool always) {
+    if (!gLogDeferFormatting) {
+        return false;
+    }
+    LogRing* r = GetThreadLogRing();
+    if (!r) {
+        return false;
+    }
+    u8 data[kMaxLogBinaryRecord];
+    va_list args2;
+    va_copy(args2, args);
+    int n = encodeLogArgs(data, (int)sizeof(data), fmt, args2);
+    va_end(args2);
+    if (n < 0) {
+        return false;
+    }
+    LogRecordHeader* hdr = LogRingReserve(r, LogRecordSize(n), always);
+    if (hdr) {
+        hdr->kind = LogRecordKind::Binary;
+        hdr->dataSize = (u32)n;
+        memcpy(hdr + 1, data, n);
+        LogRingCommit(r);
+    }
+    return true;
+}
+
+// returns first non-pad record in the ring or nullptr if it's empty
+static LogRecordHeader* LogRingPeek(LogRing* r) {
+    // buf is set before head moves, so it's only safe to look at it if the ring is not empty
+    u32 head = (u32)AtomicIntGet(&r->head);
+    u32 tail = (u32)r->tail;
+    while (tail != head) {
+        auto hdr = (LogRecordHeader*)(r->buf + (tail & (kLogRingSize - 1)));
+        if (hdr->kind != LogRecordKind::Pad) {
+            return hdr;
+        }
+        tail += hdr->size;
+        AtomicIntSet(&r->tail, (int)tail);
+    }
+    return nullptr;
+}
+
+// writes out all records, in the order they were logged
+// must be called with gLogFlushMutex locked
+static void DrainLogRings() {
+    FILE* logFile = nullptr;
+    bool didOpenFile = false;
+    str::Str line;
+    while (true) {
+        LogRing* ring = nullptr;
+        LogRecordHeader* rec = nullptr;
+        for (LogRing& r : gLogRings) {
+            LogRecordHeader* hdr = LogRingPeek(&r);
+            if (hdr && (!rec || (i32)(hdr->seq - rec->seq) < 0)) {
+                ring = &r;
+                rec = hdr;
+            }
+        }
+        if (!rec) {
+            break;
+        }
+        const char* s = (const char*)(rec + 1);
+        size_t n = rec->dataSize;
+        if (rec->kind == LogRecordKind::Binary) {
+            line.Reset();
+            formatLogArgs(line, (const u8*)(rec + 1));
+            s = line.Get();
+            n = line.size();
+        }
+        if (!didOpenFile) {
+            // opening the file for every line is slow
+            didOpenFile = true;
+            if (gLogFilePath) {
+                logFile = fopen(gLogFilePath, "a");
+            }
+        }
+        bool skipLog = !rec->always && gSkipDuplicateLines && gLogBuf && gLogBuf->Contains(s);
+        if (!skipLog && (gLogToDebugger || IsDebuggerPresent())) {
+            OutputDebugStringA(s);
+        }
+        gLogMutex.Lock();
+        logLocked(s, n, skipLog, logFile);
+        gLogMutex.Unlock();
+        AtomicIntSet(&ring->tail, AtomicIntGet(&ring->tail) + (int)rec->size);
+    }
+
+    for (LogRing& r : gLogRings) {
+        int nDropped = AtomicIntGet(&r.nDropped);
+        if (nDropped == r.nDroppedReported) {
+            continue;
+        }
+        char s[64];
+        str::BufFmt(s, dimof(s), "log: dropped %d lines\n", nDropped - r.nDroppedReported);
+        r.nDroppedReported = nDropped;
+        gLogMutex.Lock();
+        logLocked(s, str::Len(s), false, logFile);
+        gLogMutex.Unlock();
+    }
+    if (logFile) {
+        fclose(logFile);
+    }
+}
+
+// don't wait forever, the thread holding it might be stuck
+static bool TryLockLogFlushMutex() {
+    for (int i = 0; i < 100; i++) {
+        if (TryEnterCriticalSection(&gLogFlushMutex.cs)) {
+            return true;
+        }
+        Sleep(1);
+    }
+    return false;
+}
+
+void FlushLog() {
+    if (!gLogAsync) {
+        return;
+    }
+    if (TryLockLogFlushMutex()) {
+        DrainLogRings();
+        gLogFlushMutex.Unlock();
+    }
+}
+
+// appends records that haven't been written out yet, in the order they were
+// logged, without removing them from the rings
+// must be called with gLogFlushMutex locked
+static void AppendPendingLogLines(str::Str& out) {
+    u32 tails[kMaxLogRings];
+    u32 heads[kMaxLogRings];
+    for (int i = 0; i < kMaxLogRings; i++) {
+        heads[i] = (u32)AtomicIntGet(&gLogRings[i].head);
+        tails[i] = (u32)AtomicIntGet(&gLogRings[i].tail);
+    }
+    while (true) {
+        int ringIdx = -1;
+        LogRecordHeader* rec = nullptr;
+        for (int i = 0; i < kMaxLogRings; i++) {
+            LogRecordHeader* hdr = nullptr;
+            while (tails[i] != heads[i]) {
+                hdr = (LogRecordHeader*)(gLogRings[i].buf + (tails[i] & (kLogRingSize - 1)));
+                if (hdr->kind != LogRecordKind::Pad) {
+                    break;
+                }
+                tails[i] += hdr->size;
+                hdr = nullptr;
+            }
+            if (hdr && (!rec || (i32)(hdr->seq - rec->seq) < 0)) {
+                ringIdx = i;
+                rec = hdr;
+            }
+        }
+        if (!rec) {
+            break;
+        }
+        if (rec->kind == LogRecordKind::Binary) {
+            formatLogArgs(out, (const u8*)(rec + 1));
+        } else {
+            out.Append((const char*)(rec + 1), rec->dataSize);
+        }
+        tails[ringIdx] += rec->size;
+    }
+}
+
+// for crash reports: appends the log, including lines the flusher thread hasn't
+// written out yet. Doesn't use malloc() or file i/o, which might deadlock when
+// crashing. Memory is only allocated by out, which should use its own allocator
+bool AppendLogForCrashReport(str::Str& out) {
+    if (!gLogAsync) {
+        if (!gLogBuf) {
+            return false;
+        }
+        out.Append(gLogBuf->LendData());
+        return true;
+    }
+    size_t sizeBefore = out.size();
+    // prevents the flusher thread from moving lines from the rings to gLogBuf
+    bool locked = TryLockLogFlushMutex();
+    if (gLogBuf) {
+        out.Append(gLogBuf->LendData());
+    }
+    if (locked) {
+        AppendPendingLogLines(out);
+        gLogFlushMutex.Unlock();
+    }
+    return out.size() > sizeBefore;
+}
+
+static void LogFlusherThread() {
+    while (!AtomicIntGet(&gLogFlusherStop)) {
+        WaitForSingleObject(gLogFlushEvent, kLogFlushIntervalMs);
+        FlushLog();
+    }
+}
+
+void StartAsyncLogging() {
+    if (gLogAsync) {
+        return;
+    }
+    AtomicIntSet(&gLogFlusherStop, 0);
+    if (!gLogFlushEvent) {
+        gLogFlushEvent = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+    }
+    gLogAsync = true;
+    gLogFlusherThread = StartThread(MkFunc0Void(LogFlusherThread), "LogFlusherThread");
+    if (!gLogFlusherThread) {
+        gLogAsync = false;
+    }
+}
+
+// returns false if the flusher thread didn't exit in time
+bool StopAsyncLogging() {
+    if (!gLogAsync) {
+        return true;
+    }
+    AtomicIntSet(&gLogFlusherStop, 1);
+    SetEvent(gLogFlushEvent);
+    DWORD res = WaitForSingleObject(gLogFlusherThread, 1000);
+    SafeCloseHandle(&gLogFlusherThread);
+    FlushLog();
+    gLogAsync = false;
+    return res == WAIT_OBJECT_0;
+}
+
+static void log2(const char* s, bool always) {
+    if (gLogAsync && !gReducedLogging && !gDestroyedLogging && logAsyncText(s, always)) {
+        return;
+    }
+    bool skipLog = !always && gSkipDuplicateLines && gLogBuf && gLogBuf->Contains(s);
+
+    if (!skipLog) {
+        // in reduced logging mode, we do want to log to at least the debugger
+        if (gLogToDebugger || IsDebuggerPresent() || gReducedLogging) {
+            OutputDebugStringA(s);
+        }
+    }
+    if (gDestroyedLogging) {
+        return;
+    }
+    if (gReducedLogging) {
+        // if the pipe already connected, do log to it even if disabled
+        // we do want easy logging, just want to reduce doing stuff
+        // that can break crash handling
+        if (gLogToPipe && IsValidHandle(hLogPipe)) {
+            logToPipe(s);
+        }
+        return;
+    }
+    gLogMutex.Lock();
+    logLocked(s, str::Len(s), skipLog, nullptr);
     gLogMutex.Unlock();
 }
 
@@ -238,6 +863,10 @@ void logf(const char* fmt, ...) {
 
     va_list args;
     va_start(args, fmt);
+    if (gLogAsync && !gReducedLogging && logAsyncFmt(fmt, args, false)) {
+        va_end(args);
+        return;
+    }
     AutoFreeStr s = str::FmtV(fmt, args);
     log2(s.Get(), false);
     va_end(args);
@@ -250,6 +879,10 @@ void logfa(const char* fmt, ...) {
 
     va_list args;
     va_start(args, fmt);
+    if (gLogAsync && !gReducedLogging && logAsyncFmt(fmt, args, true)) {
+        va_end(args);
+        return;
+    }
     char* s = str::FmtV(fmt, args);
     log2(s, true);
     str::Free(s);
@@ -265,6 +898,7 @@ void StartLogToFile(const char* path, bool removeIfExists) {
 }
 
 bool WriteCurrentLogToFile(const char* path) {
+    FlushLog();
     if (!gLogBuf) return false;
     ByteSlice slice = gLogBuf->AsByteSlice();
     if (slice.empty()) {
@@ -283,7 +917,12 @@ bool WriteCurrentLogToFile(const char* path) {
 }
 
 void DestroyLogging() {
+    bool flusherExited = StopAsyncLogging();
     gDestroyedLogging = true;
+    if (!flusherExited) {
+        // it still uses gLogBuf and gLogFilePath, leak them
+        return;
+    }
     gLogMutex.Lock();
     delete gLogBuf;
     gLogBuf = nullptr;
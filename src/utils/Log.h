@@ -9,7 +9,16 @@ extern bool gReducedLogging;
 extern bool gLogToPipe;
 extern const char* gLogAppName;
 extern char* gLogFilePath;
+extern bool gLogAsync;
+extern bool gLogDeferFormatting;
 void StartLogToFile(const char* path, bool removeIfExists);
+
+// log lines are written out by a background thread
+void StartAsyncLogging();
+bool StopAsyncLogging();
+// writes out pending log lines when logging async
+void FlushLog();
+bool AppendLogForCrashReport(str::Str& out);
 bool WriteCurrentLogToFile(const char* path);
 
 void log(const char* s);
@@ -2,6 +2,7 @@
    License: Simplified BSD (see COPYING.BSD) */
 
 #include "BaseUtil.h"
+#include "ThreadUtil.h"
 #include "SettingsUtil.h"
 #include "SquareTreeParser.h"
 
@@ -418,8 +419,165 @@ static void SerializeUnknownFields(str::Str& out, SquareTreeNode* node, int inde
     }
 }
 
+/* Serialized array elements are cached between calls to SerializeStruct().
+
+With thousands of FileStates, formatting every value on every save is
+noticeable while usually only a few of them have changed. For each element
+of a top-level array we remember the text it was serialized to and a hash
+of its values (which is much cheaper to calculate than formatting them).
+If the hash of an element didn't change, we re-use the text.
+
+We also skip parsing prevData (to preserve unknown fields) if it's what we
+wrote the last time and that didn't have any unknown fields.
+*/
+
+struct SerializedElement {
+    const void* strct;
+    u64 hash;
+    // the text is cache->text[offset, offset + len)
+    size_t offset;
+    size_t len;
+};
+
+struct SerializeCache {
+    str::Str text;
+    // sorted by strct
+    Vec<SerializedElement> elements;
+    bool hasUnknownFields = false;
+};
+
+struct SerializeCacheCtx {
+    SerializeCache* prev = nullptr;
+    // text is the output of SerializeStruct() and only copied at the end
+    Vec<SerializedElement> elements;
+    bool hasUnknownFields = false;
+};
+
+static SerializeCache* gSerializeCache = nullptr;
+static Mutex gSerializeCacheMutex;
+
+constexpr u64 kFnvOffset = 0xcbf29ce484222325ULL;
+constexpr u64 kFnvPrime = 0x100000001b3ULL;
+
+static void HashBytes(u64& h, const void* d, size_t n) {
+    const u8* s = (const u8*)d;
+    for (size_t i = 0; i < n; i++) {
+        h = (h ^ s[i]) * kFnvPrime;
+    }
+}
+
+static void HashStr(u64& h, const char* s) {
+    // distinguishes nullptr from ""
+    size_t n = s ? str::Len(s) + 1 : 0;
+    HashBytes(h, &n, sizeof(n));
+    HashBytes(h, s, n);
+}
+
+// hashes everything that SerializeStructRec() writes out for this struct
+static void HashStructRec(u64& h, const StructInfo* info, const u8* base) {
+    HashBytes(h, &info, sizeof(info));
+    HashBytes(h, &info->fieldCount, sizeof(info->fieldCount));
+    for (size_t i = 0; i < info->fieldCount; i++) {
+        const FieldInfo& field = info->fields[i];
+        const u8* fieldPtr = base + field.offset;
+        switch (field.type) {
+            case SettingType::Bool:
+                HashBytes(h, fieldPtr, sizeof(bool));
+                break;
+            case SettingType::Int:
+            case SettingType::Float:
+                HashBytes(h, fieldPtr, sizeof(int));
+                break;
+            case SettingType::String:
+            case SettingType::Color:
+                HashStr(h, *(const char**)fieldPtr);
+                break;
+            case SettingType::Struct:
+            case SettingType::Prerelease:
+            case SettingType::Compact:
+                HashStructRec(h, GetSubstruct(field), fieldPtr);
+                break;
+            case SettingType::Array: {
+                Vec<void*>* array = *(Vec<void*>**)fieldPtr;
+                size_t n = array ? array->size() : 0;
+                HashBytes(h, &n, sizeof(n));
+                for (size_t j = 0; j < n; j++) {
+                    HashStructRec(h, GetSubstruct(field), (const u8*)array->at(j));
+                }
+                break;
+            }
+            case SettingType::FloatArray:
+            case SettingType::IntArray: {
+                Vec<int>* array = *(Vec<int>**)fieldPtr;
+                size_t n = array ? array->size() : 0;
+                HashBytes(h, &n, sizeof(n));
+                if (n > 0) {
+                    HashBytes(h, array->LendData(), n * sizeof(int));
+                }
+                break;
+            }
+            case SettingType::ColorArray:
+            case SettingType::StringArray: {
+                Vec<char*>* array = *(Vec<char*>**)fieldPtr;
+                size_t n = array ? array->size() : 0;
+                HashBytes(h, &n, sizeof(n));
+                for (size_t j = 0; j < n; j++) {
+                    HashStr(h, array->at(j));
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+static const SerializedElement* FindSerializedElement(SerializeCache* cache, const void* strct) {
+    if (!cache) {
+        return nullptr;
+    }
+    Vec<SerializedElement>& elements = cache->elements;
+    int lo = 0;
+    int hi = (int)elements.size();
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (elements[mid].strct < strct) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < (int)elements.size() && elements[lo].strct == strct) {
+        return &elements[lo];
+    }
+    return nullptr;
+}
+
+static void SerializeStructRec(str::Str& out, const StructInfo* info, const void* data, SquareTreeNode* prevNode,
+                               int indent = 0, SerializeCacheCtx* cacheCtx = nullptr);
+
+static void SerializeArrayElement(str::Str& out, const StructInfo* info, const void* data, int indent,
+                                  SerializeCacheCtx* cacheCtx) {
+    if (!cacheCtx) {
+        SerializeStructRec(out, info, data, nullptr, indent);
+        return;
+    }
+    u64 h = kFnvOffset;
+    HashBytes(h, &indent, sizeof(indent));
+    HashStructRec(h, info, (const u8*)data);
+    size_t offset = out.size();
+    const SerializedElement* prev = FindSerializedElement(cacheCtx->prev, data);
+    if (prev && prev->hash == h) {
+        out.Append(cacheCtx->prev->text.Get() + prev->offset, prev->len);
+    } else {
+        // nested arrays are not cached
+        SerializeStructRec(out, info, data, nullptr, indent);
+    }
+    cacheCtx->elements.Append({data, h, offset, out.size() - offset});
+}
+
 static void SerializeStructRec(str::Str& out, const StructInfo* info, const void* data, SquareTreeNode* prevNode,
-                               int indent = 0) {
+                               int indent, SerializeCacheCtx* cacheCtx) {
     const u8* base = (const u8*)data;
     const char* fieldName = info->fieldNames;
     for (size_t i = 0; i < info->fieldCount; i++, fieldName += str::Len(fieldName) + 1) {
@@ -436,7 +594,7 @@ static void SerializeStructRec(str::Str& out, const StructInfo* info, const void
             out.Append(fieldName);
             out.Append(" [\r\n");
             SerializeStructRec(out, GetSubstruct(field), base + field.offset,
-                               prevNode ? prevNode->GetChild(fieldName) : nullptr, indent + 1);
+                               prevNode ? prevNode->GetChild(fieldName) : nullptr, indent + 1, cacheCtx);
             Indent(out, indent);
             out.Append("]\r\n");
         } else if (SettingType::Array == field.type) {
@@ -448,7 +606,7 @@ static void SerializeStructRec(str::Str& out, const StructInfo* info, const void
                 for (size_t j = 0; j < array->size(); j++) {
                     Indent(out, indent + 1);
                     out.Append("[\r\n");
-                    SerializeStructRec(out, GetSubstruct(field), array->at(j), nullptr, indent + 2);
+                    SerializeArrayElement(out, GetSubstruct(field), array->at(j), indent + 2, cacheCtx);
                     Indent(out, indent + 1);
                     out.Append("]\r\n");
                 }
@@ -476,20 +634,73 @@ static void SerializeStructRec(str::Str& out, const StructInfo* info, const void
         }
         MarkFieldKnown(prevNode, fieldName, field.type);
     }
+    if (cacheCtx && prevNode && prevNode->data.size() > 0) {
+        cacheCtx->hasUnknownFields = true;
+    }
     SerializeUnknownFields(out, prevNode, indent);
 }
 
+/* Looking up every field with SquareTreeNode::GetValue() / GetChild() is
+quadratic in the number of fields and that adds up for thousands of FileStates.
+
+Settings are usually in the same order as the fields (that's how we write them)
+so we keep a cursor after the items of the fields we've already looked up.
+Items before the cursor belong to other fields so if the item at the cursor
+matches, it's the first one with that key, same as GetValue() would find.
+Otherwise we fall back to GetValue() / GetChild().
+*/
+
+static bool ItemMatches(SquareTreeNode* node, size_t idx, const char* key, bool isChild) {
+    if (idx >= node->data.size()) {
+        return false;
+    }
+    SquareTreeNode::DataItem& item = node->data.at(idx);
+    return (item.child != nullptr) == isChild && str::EqI(key, item.key);
+}
+
+static const char* GetValueAtCursor(SquareTreeNode* node, const char* key, size_t cursor) {
+    if (!node) {
+        return nullptr;
+    }
+    if (ItemMatches(node, cursor, key, false)) {
+        return node->data.at(cursor).str;
+    }
+    return node->GetValue(key);
+}
+
+static SquareTreeNode* GetChildAtCursor(SquareTreeNode* node, const char* key, size_t cursor) {
+    if (!node) {
+        return nullptr;
+    }
+    if (ItemMatches(node, cursor, key, true)) {
+        return node->data.at(cursor).child;
+    }
+    return node->GetChild(key);
+}
+
+// moves the cursor past items of this field
+static void AdvanceCursor(SquareTreeNode* node, const char* key, size_t& cursor) {
+    if (!node || !*key) {
+        return;
+    }
+    while (cursor < node->data.size() && str::EqI(key, node->data.at(cursor).key)) {
+        cursor++;
+    }
+}
+
 static void* DeserializeStructRec(const StructInfo* info, SquareTreeNode* node, u8* base, bool useDefaults) {
     if (!base) {
         base = AllocArray<u8>(info->structSize);
     }
 
+    size_t cursor = 0;
     const char* fieldName = info->fieldNames;
     for (size_t i = 0; i < info->fieldCount; i++, fieldName += str::Len(fieldName) + 1) {
         const FieldInfo& field = info->fields[i];
         u8* fieldPtr = base + field.offset;
+        const char* name = fieldName;
         if (SettingType::Struct == field.type || SettingType::Prerelease == field.type) {
-            SquareTreeNode* child = node ? node->GetChild(fieldName) : nullptr;
+            SquareTreeNode* child = GetChildAtCursor(node, fieldName, cursor);
 #if !(defined(PRE_RELEASE_VER) || defined(DEBUG))
             if (SettingType::Prerelease == field.type) {
                 child = nullptr;
@@ -498,7 +709,7 @@ static void* DeserializeStructRec(const StructInfo* info, SquareTreeNode* node,
             DeserializeStructRec(GetSubstruct(field), child, fieldPtr, useDefaults);
         } else if (SettingType::Array == field.type) {
             SquareTreeNode *parent = node, *child = nullptr;
-            if (parent && (child = parent->GetChild(fieldName)) != nullptr &&
+            if (parent && (child = GetChildAtCursor(parent, fieldName, cursor)) != nullptr &&
                 (0 == child->data.size() || child->GetChild(""))) {
                 parent = child;
                 fieldName += str::Len(fieldName);
@@ -514,24 +725,64 @@ static void* DeserializeStructRec(const StructInfo* info, SquareTreeNode* node,
                 *(Vec<void*>**)fieldPtr = array;
             }
         } else if (field.type != SettingType::Comment) {
-            const char* value = node ? node->GetValue(fieldName) : nullptr;
+            const char* value = GetValueAtCursor(node, fieldName, cursor);
             if (useDefaults || value) {
                 deserializeField(field, base, value);
             }
         }
+        if (field.type != SettingType::Comment) {
+            AdvanceCursor(node, name, cursor);
+        }
     }
     return base;
 }
 
+static bool IsPrevDataFromCache(SerializeCache* cache, const char* prevData) {
+    if (!cache || cache->hasUnknownFields || !prevData) {
+        return false;
+    }
+    return str::Len(prevData) == cache->text.size() && memeq(prevData, cache->text.Get(), cache->text.size());
+}
+
 ByteSlice SerializeStruct(const StructInfo* info, const void* strct, const char* prevData) {
     str::Str out;
     out.Append(UTF8_BOM);
-    SquareTreeNode* root = ParseSquareTree(prevData);
-    SerializeStructRec(out, info, strct, root);
+    // don't wait if another thread is serializing (e.g. crash handler), just don't use the cache
+    if (!TryEnterCriticalSection(&gSerializeCacheMutex.cs)) {
+        SquareTreeNode* root = ParseSquareTree(prevData);
+        SerializeStructRec(out, info, strct, root);
+        delete root;
+        return out.StealAsByteSlice();
+    }
+    SerializeCacheCtx ctx;
+    ctx.prev = gSerializeCache;
+    SquareTreeNode* root = nullptr;
+    if (!IsPrevDataFromCache(gSerializeCache, prevData)) {
+        root = ParseSquareTree(prevData);
+    }
+    SerializeStructRec(out, info, strct, root, 0, &ctx);
     delete root;
+
+    // the output becomes the cache for the next call
+    auto cache = new SerializeCache();
+    cache->text.Append(out.Get(), out.size());
+    cache->elements = ctx.elements;
+    cache->hasUnknownFields = ctx.hasUnknownFields;
+    std::sort(cache->elements.begin(), cache->elements.end(),
+              [](const SerializedElement& a, const SerializedElement& b) { return a.strct < b.strct; });
+    delete gSerializeCache;
+    gSerializeCache = cache;
+    gSerializeCacheMutex.Unlock();
     return out.StealAsByteSlice();
 }
 
+void ResetSerializeStructCache() {
+    gSerializeCacheMutex.Lock();
+    delete gSerializeCache;
+    gSerializeCache = nullptr;
+    gSerializeCacheMutex.Unlock();
+}
+
 void* DeserializeStruct(const StructInfo* info, const char* data, void* strct) {
     SquareTreeNode* root = ParseSquareTree(data);
     auto res = DeserializeStructRec(info, root, (u8*)strct, !strct);
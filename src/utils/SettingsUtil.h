@@ -62,3 +62,5 @@ struct StructInfo {
 ByteSlice SerializeStruct(const StructInfo* info, const void* strct, const char* prevData = nullptr);
 void* DeserializeStruct(const StructInfo* info, const char* data, void* strct = nullptr);
 void FreeStruct(const StructInfo* info, void* strct);
+// SerializeStruct() re-uses text of unchanged array elements from the previous call
+void ResetSerializeStructCache();
@@ -330,11 +330,46 @@ static StrVecPage* CompactStrVecPages(StrVecPage* first, int extraSize) {
     return page;
 }
 
+static void PageDirAppend(StrVec* v, StrVecPage* page, int firstIdx) {
+    if (v->nPages == v->pageDirCap) {
+        int newCap = std::max(v->pageDirCap * 2, 16);
+        size_t cb = (size_t)newCap * sizeof(StrVecPageDirEntry);
+        v->pageDir = (StrVecPageDirEntry*)Allocator::Realloc(nullptr, v->pageDir, cb);
+        v->pageDirCap = newCap;
+    }
+    v->pageDir[v->nPages] = {page, firstIdx};
+    v->nPages++;
+}
+
+static void RebuildPageDir(StrVec* v) {
+    v->nPages = 0;
+    int idx = 0;
+    for (auto page = v->first; page; page = page->next) {
+        PageDirAppend(v, page, idx);
+        idx += page->nStrings;
+    }
+}
+
+static void FreePageDir(StrVec* v) {
+    Allocator::Free(nullptr, v->pageDir);
+    v->pageDir = nullptr;
+    v->nPages = 0;
+    v->pageDirCap = 0;
+}
+
+// after a string was inserted into or removed from page pageNo
+static void ShiftPageDir(StrVec* v, int pageNo, int delta) {
+    for (int i = pageNo + 1; i < v->nPages; i++) {
+        v->pageDir[i].firstIdx += delta;
+    }
+}
+
 static void CompactPages(StrVec* v, int extraSize) {
     auto first = CompactStrVecPages(v->first, extraSize);
     FreePages(v->first);
     v->first = first;
     ReportIf(first && (v->size != first->nStrings));
+    RebuildPageDir(v);
 }
 
 static inline void InvalidateSortIndexes(StrVec* v) {
@@ -347,6 +382,7 @@ static inline void InvalidateSortIndexes(StrVec* v) {
 void StrVec::Reset(StrVecPage* initWith) {
     InvalidateSortIndexes(this);
     FreePages(first);
+    FreePageDir(this);
     first = nullptr;
     nextPageSize = 256; // TODO: or leave it alone?
     size = 0;
@@ -355,6 +391,7 @@ void StrVec::Reset(StrVecPage* initWith) {
     }
     first = CompactStrVecPages(initWith, 0);
     size = first->nStrings;
+    RebuildPageDir(this);
 }
 
 StrVec::StrVec(int dataSize) {
@@ -428,6 +465,7 @@ static StrVecPage* AllocatePage(StrVec* v, StrVecPage* last, int nBytesNeeded) {
         ReportIf(v->first);
         v->first = page;
     }
+    PageDirAppend(v, page, v->size);
     return page;
 }
 
@@ -440,10 +478,7 @@ char* StrVec::Append(const char* s, int sLen) {
     if (s) {
         cbNeeded += (sLen + 1); // +1 for zero termination
     }
-    auto last = first;
-    while (last && last->next) {
-        last = last->next;
-    }
+    StrVecPage* last = nPages > 0 ? pageDir[nPages - 1].page : nullptr;
     if (!last || last->BytesLeft() < cbNeeded) {
         last = AllocatePage(this, last, cbNeeded);
     }
@@ -466,16 +501,34 @@ int AppendIfNotExists(StrVec* v, const char* s, int sLen) {
     return idx;
 }
 
-static std::pair<StrVecPage*, int> PageForIdx(const StrVec* v, int idx) {
-    auto page = v->first;
-    while (page) {
-        if (page->nStrings > idx) {
-            return {page, idx};
+// returns the last page whose first index is <= idx, -1 if none
+// empty pages share firstIdx with the page after them so they're never returned
+// for a valid idx
+static int PageNoForIdx(const StrVec* v, int idx) {
+    int lo = 0;
+    int hi = v->nPages;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (v->pageDir[mid].firstIdx <= idx) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
         }
-        idx -= page->nStrings;
-        page = page->next;
     }
-    return {page, 0};
+    return lo - 1;
+}
+
+static std::pair<StrVecPage*, int> PageForIdx(const StrVec* v, int idx) {
+    int pageNo = PageNoForIdx(v, idx);
+    if (pageNo < 0) {
+        return {nullptr, 0};
+    }
+    auto& e = v->pageDir[pageNo];
+    int idxInPage = idx - e.firstIdx;
+    if (idxInPage >= e.page->nStrings) {
+        return {nullptr, 0};
+    }
+    return {e.page, idxInPage};
 }
 
 // returns a string
@@ -512,12 +565,14 @@ char* StrVec::InsertAt(int idx, const char* s, int sLen) {
     }
 
     {
+        int pageNo = PageNoForIdx(this, idx);
         auto [page, idxInPage] = PageForIdx(this, idx);
         if (sLen < 0) {
             sLen = str::Leni(s);
         }
         char* res = page->InsertAt(idxInPage, s, sLen);
         if (res != kNoSpace) {
+            ShiftPageDir(this, pageNo, 1);
             size++;
             InvalidateSortIndexes(this);
             return res;
@@ -538,8 +593,10 @@ char* StrVec::InsertAt(int idx, const char* s, int sLen) {
 // remove string at idx and return it
 // return value is valid as long as StrVec is valid
 char* StrVec::RemoveAt(int idx) {
+    int pageNo = PageNoForIdx(this, idx);
     auto [page, idxInPage] = PageForIdx(this, idx);
     auto res = page->RemoveAt(idxInPage);
+    ShiftPageDir(this, pageNo, -1);
     size--;
     InvalidateSortIndexes(this);
     return res;
@@ -548,8 +605,10 @@ char* StrVec::RemoveAt(int idx) {
 // remove string at idx more quickly but will change order of string
 // return value is valid as long as StrVec is valid
 char* StrVec::RemoveAtFast(int idx) {
+    int pageNo = PageNoForIdx(this, idx);
     auto [page, idxInPage] = PageForIdx(this, idx);
     auto res = page->RemoveAtFast(idxInPage);
+    ShiftPageDir(this, pageNo, -1);
     size--;
     InvalidateSortIndexes(this);
     return res;
@@ -13,8 +13,19 @@ ByteSlice ToByteSlice(const char* s);
 
 struct StrVecPage;
 
+struct StrVecPageDirEntry {
+    StrVecPage* page;
+    // index of the first string in the page
+    int firstIdx;
+};
+
 struct StrVec {
     StrVecPage* first = nullptr;
+    // pages in list order, so that At() can binary search for the page
+    // instead of walking the list
+    StrVecPageDirEntry* pageDir = nullptr;
+    int nPages = 0;
+    int pageDirCap = 0;
     int* sortIndexes = nullptr;
     int nextPageSize = 256;
     int size = 0;
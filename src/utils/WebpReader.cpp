@@ -2,6 +2,8 @@
    License: Simplified BSD (see COPYING.BSD) */
 
 #include "utils/BaseUtil.h"
+#include "utils/DecodedImage.h"
+#include "utils/GdiPlusUtil.h"
 #include "utils/WebpReader.h"
 
 #ifndef NO_LIBWEBP
@@ -25,24 +27,31 @@ Size SizeFromData(const ByteSlice& d) {
     return size;
 }
 
-Gdiplus::Bitmap* ImageFromData(const ByteSlice& d) {
-    int w, h;
-    if (!WebPGetInfo((const u8*)d.data(), d.size(), &w, &h)) {
+DecodedImage* DecodeImage(const ByteSlice& d) {
+    WebPBitstreamFeatures features;
+    if (WebPGetFeatures((const u8*)d.data(), d.size(), &features) != VP8_STATUS_OK) {
         return nullptr;
     }
 
-    Gdiplus::Bitmap bmp(w, h, PixelFormat32bppARGB);
-    Gdiplus::Rect bmpRect(0, 0, w, h);
-    Gdiplus::BitmapData bmpData;
-    Gdiplus::Status ok = bmp.LockBits(&bmpRect, Gdiplus::ImageLockModeWrite, PixelFormat32bppARGB, &bmpData);
-    if (ok != Gdiplus::Ok) {
+    auto img = new DecodedImage();
+    if (!img->Allocate(features.width, features.height)) {
+        delete img;
         return nullptr;
     }
-    if (!WebPDecodeBGRAInto((const u8*)d.data(), d.size(), (u8*)bmpData.Scan0, bmpData.Stride * h, bmpData.Stride)) {
+    img->hasAlpha = features.has_alpha != 0;
+    u8* res = WebPDecodeBGRAInto((const u8*)d.data(), d.size(), img->pixels, img->DataSize(), img->stride);
+    if (!res) {
+        delete img;
         return nullptr;
     }
-    bmp.UnlockBits(&bmpData);
-    return bmp.Clone(0, 0, w, h, PixelFormat32bppARGB);
+    return img;
+}
+
+Gdiplus::Bitmap* ImageFromData(const ByteSlice& d) {
+    DecodedImage* img = DecodeImage(d);
+    Gdiplus::Bitmap* bmp = BitmapFromDecodedImage(img);
+    delete img;
+    return bmp;
 }
 
 } // namespace webp
@@ -55,6 +64,9 @@ bool HasSignature(const ByteSlice&) {
 Size SizeFromData(const ByteSlice&) {
     return Size();
 }
+DecodedImage* DecodeImage(const ByteSlice&) {
+    return nullptr;
+}
 Gdiplus::Bitmap* ImageFromData(const ByteSlice&) {
     return nullptr;
 }
@@ -1,10 +1,13 @@
 /* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
    License: Simplified BSD (see COPYING.BSD) */
 
+struct DecodedImage;
+
 namespace webp {
 
 bool HasSignature(const ByteSlice&);
 Size SizeFromData(const ByteSlice&);
+DecodedImage* DecodeImage(const ByteSlice&);
 Gdiplus::Bitmap* ImageFromData(const ByteSlice&);
 
 } // namespace webp
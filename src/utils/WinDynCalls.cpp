@@ -21,6 +21,7 @@ DBGHELP_API_LIST(API_DECLARATION)
 // manual definitions for functions not in API lists
 Sig_GetProcessInformation DynGetProcessInformation = nullptr;
 Sig_SetProcessMitigationPolicy DynSetProcessMitigationPolicy = nullptr;
+Sig_PrefetchVirtualMemory DynPrefetchVirtualMemory = nullptr;
 Sig_GetDpiForWindow DynGetDpiForWindow = nullptr;
 Sig_GetThreadDpiAwarenessContext DynGetThreadDpiAwarenessContext = nullptr;
 Sig_GetAwarenessFromDpiAwarenessContext DynGetAwarenessFromDpiAwarenessContext = nullptr;
@@ -49,6 +50,7 @@ void InitDynCalls() {
     KERNEL32_API_LIST(API_LOAD);
     DynGetProcessInformation = (Sig_GetProcessInformation)GetProcAddress(h, "GetProcessInformation");
     DynSetProcessMitigationPolicy = (Sig_SetProcessMitigationPolicy)GetProcAddress(h, "SetProcessMitigationPolicy");
+    DynPrefetchVirtualMemory = (Sig_PrefetchVirtualMemory)GetProcAddress(h, "PrefetchVirtualMemory");
 
     h = SafeLoadLibrary("ntdll.dll");
     ReportIf(!h);
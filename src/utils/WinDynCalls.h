@@ -79,8 +79,11 @@ KERNEL32_API_LIST(API_DECLARATION2)
 // not declared in SDK headers with _WIN32_WINNT=0x0601, define manually
 typedef BOOL(WINAPI* Sig_GetProcessInformation)(HANDLE, int, LPVOID, DWORD);
 typedef BOOL(WINAPI* Sig_SetProcessMitigationPolicy)(int, PVOID, SIZE_T);
+// Windows 8+, ranges are WIN32_MEMORY_RANGE_ENTRY
+typedef BOOL(WINAPI* Sig_PrefetchVirtualMemory)(HANDLE, ULONG_PTR, PVOID, ULONG);
 extern Sig_GetProcessInformation DynGetProcessInformation;
 extern Sig_SetProcessMitigationPolicy DynSetProcessMitigationPolicy;
+extern Sig_PrefetchVirtualMemory DynPrefetchVirtualMemory;
 
 // user32.dll
 #define USER32_API_LIST(V) \
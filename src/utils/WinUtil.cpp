@@ -7,12 +7,12 @@
 #include "utils/FileUtil.h"
 #include "utils/WinDynCalls.h"
 #include "utils/ScopedWin.h"
+#include "utils/ThreadUtil.h"
 #include "utils/WinUtil.h"
 
 #include <wintrust.h>
 #include <softpub.h>
 #include <WinCrypt.h>
-#include <bitset>
 #include <intrin.h>
 #include <mlang.h>
 #ifdef __GNUC__
@@ -53,7 +53,12 @@ RenderedBitmap::RenderedBitmap(HBITMAP hbmp, Size size, HANDLE hMap) {
     this->size = size;
 }
 
+static bool ReturnToBitmapPool(RenderedBitmap* bmp);
+
 RenderedBitmap::~RenderedBitmap() {
+    if (poolMapSize > 0 && ReturnToBitmapPool(this)) {
+        return;
+    }
     if (IsValidHandle(hbmp)) {
         DeleteObject(hbmp);
     }
@@ -2383,7 +2388,7 @@ ByteSlice SerializeBitmap(HBITMAP hbmp) {
     return {(u8*)bmpData, bmpBytes};
 }
 
-HBITMAP CreateMemoryBitmap(Size size, HANDLE* hDataMapping) {
+static HBITMAP CreateMemoryBitmapWithData(Size size, HANDLE hMap, void** data) {
     BITMAPINFO bmi{};
     bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
     bmi.bmiHeader.biWidth = size.dx;
@@ -2394,12 +2399,171 @@ HBITMAP CreateMemoryBitmap(Size size, HANDLE* hDataMapping) {
     bmi.bmiHeader.biBitCount = 32;
     bmi.bmiHeader.biSizeImage = size.dx * 4 * size.dy;
 
-    void* data = nullptr;
+    return CreateDIBSection(nullptr, &bmi, DIB_RGB_COLORS, data, hMap, 0);
+}
+
+HBITMAP CreateMemoryBitmap(Size size, HANDLE* hDataMapping) {
     if (hDataMapping && !*hDataMapping) {
-        *hDataMapping =
-            CreateFileMapping(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, bmi.bmiHeader.biSizeImage, nullptr);
+        DWORD imgSize = size.dx * 4 * size.dy;
+        *hDataMapping = CreateFileMapping(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, imgSize, nullptr);
+    }
+    void* data = nullptr;
+    return CreateMemoryBitmapWithData(size, hDataMapping ? *hDataMapping : nullptr, &data);
+}
+
+// rendering a page creates a 32-bit dib section backed by a file mapping.
+// A new mapping is expensive (the OS has to zero every page on first
+// touch) and while scrolling we create and delete lots of them, mostly
+// of only a few different sizes. Instead of freeing them we keep the
+// most recently deleted ones for re-use
+struct PooledBitmap {
+    HBITMAP hbmp = nullptr;
+    HANDLE hMap = nullptr;
+    u8* bits = nullptr;
+    Size size;
+    size_t mapSize = 0;
+};
+
+constexpr size_t kBitmapPoolMaxSize = 64 * 1024 * 1024;
+constexpr int kBitmapPoolMaxCount = 16;
+
+static Mutex gBitmapPoolMutex;
+// oldest first
+static Vec<PooledBitmap>* gBitmapPool = nullptr;
+static size_t gBitmapPoolSize = 0;
+
+// mappings are rounded up to one of 8 size classes per power of 2 so that
+// a freed one can back a bitmap of a slightly different size
+// (e.g. the last tile of a page) while wasting at most 1/8 of the memory
+static size_t BitmapPoolSizeClass(size_t size) {
+    size_t step = 64 * 1024;
+    while (step * 8 < size) {
+        step *= 2;
+    }
+    return RoundUp(size, step);
+}
+
+static void FreePooledBitmap(PooledBitmap& pb) {
+    if (pb.hbmp) {
+        DeleteObject(pb.hbmp);
+    }
+    if (pb.hMap) {
+        CloseHandle(pb.hMap);
+    }
+}
+
+// returns a top-down 32-bit BGRA bitmap, bits point to its pixels.
+// Pixels of a re-used bitmap are not cleared, the caller must overwrite all of them
+RenderedBitmap* NewPooledRenderedBitmap(Size size, u8** bits) {
+    *bits = nullptr;
+    if (size.IsEmpty()) {
+        return nullptr;
+    }
+    size_t mapSize = BitmapPoolSizeClass((size_t)size.dx * 4 * (size_t)size.dy);
+    PooledBitmap pb;
+    gBitmapPoolMutex.Lock();
+    if (gBitmapPool) {
+        // prefer the most recently freed bitmap of the same size
+        int idx = -1;
+        for (int i = gBitmapPool->Size() - 1; i >= 0; i--) {
+            PooledBitmap& el = gBitmapPool->at(i);
+            if (el.mapSize != mapSize) {
+                continue;
+            }
+            if (el.size == size) {
+                idx = i;
+                break;
+            }
+            if (idx < 0) {
+                idx = i;
+            }
+        }
+        if (idx >= 0) {
+            pb = gBitmapPool->at(idx);
+            gBitmapPool->RemoveAt(idx);
+            gBitmapPoolSize -= pb.mapSize;
+        }
+    }
+    gBitmapPoolMutex.Unlock();
+
+    if (pb.hbmp && pb.size != size) {
+        // only re-use the mapping
+        DeleteObject(pb.hbmp);
+        pb.hbmp = nullptr;
+    }
+    if (!pb.hMap) {
+        pb.hMap = CreateFileMapping(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, (DWORD)mapSize, nullptr);
+        pb.mapSize = mapSize;
+        if (!pb.hMap) {
+            return nullptr;
+        }
+    }
+    if (!pb.hbmp) {
+        void* data = nullptr;
+        pb.hbmp = CreateMemoryBitmapWithData(size, pb.hMap, &data);
+        if (!pb.hbmp) {
+            CloseHandle(pb.hMap);
+            return nullptr;
+        }
+        pb.bits = (u8*)data;
+        pb.size = size;
+    }
+    auto res = new RenderedBitmap(pb.hbmp, size, pb.hMap);
+    res->poolMapSize = pb.mapSize;
+    *bits = pb.bits;
+    return res;
+}
+
+static bool ReturnToBitmapPool(RenderedBitmap* bmp) {
+    if (bmp->poolMapSize > kBitmapPoolMaxSize / 4) {
+        return false;
+    }
+    DIBSECTION info{};
+    if (!GetObjectW(bmp->hbmp, sizeof(info), &info) || !info.dsBm.bmBits) {
+        return false;
+    }
+    // make sure gdi is done with the bitmap before it's drawn into again
+    GdiFlush();
+
+    PooledBitmap pb;
+    pb.hbmp = bmp->hbmp;
+    pb.hMap = bmp->hMap;
+    pb.bits = (u8*)info.dsBm.bmBits;
+    pb.size = bmp->size;
+    pb.mapSize = bmp->poolMapSize;
+
+    Vec<PooledBitmap> toFree;
+    gBitmapPoolMutex.Lock();
+    if (!gBitmapPool) {
+        gBitmapPool = new Vec<PooledBitmap>();
+    }
+    gBitmapPool->Append(pb);
+    gBitmapPoolSize += pb.mapSize;
+    while (gBitmapPoolSize > kBitmapPoolMaxSize || gBitmapPool->Size() > kBitmapPoolMaxCount) {
+        PooledBitmap el = gBitmapPool->at(0);
+        gBitmapPool->RemoveAt(0);
+        gBitmapPoolSize -= el.mapSize;
+        toFree.Append(el);
     }
-    return CreateDIBSection(nullptr, &bmi, DIB_RGB_COLORS, &data, hDataMapping ? *hDataMapping : nullptr, 0);
+    gBitmapPoolMutex.Unlock();
+
+    for (PooledBitmap& el : toFree) {
+        FreePooledBitmap(el);
+    }
+    return true;
+}
+
+void FreeBitmapPool() {
+    gBitmapPoolMutex.Lock();
+    if (gBitmapPool) {
+        for (PooledBitmap& el : *gBitmapPool) {
+            FreePooledBitmap(el);
+        }
+        delete gBitmapPool;
+        gBitmapPool = nullptr;
+    }
+    gBitmapPoolSize = 0;
+    gBitmapPoolMutex.Unlock();
 }
 
 // render the bitmap into the target rectangle (streching and skewing as requird)
@@ -3344,110 +3508,6 @@ void ShowTextInWindowDialog(const char* title, const char* text) {
     }
 }
 
-u32 CpuID() {
-#if IS_ARM_64
-    // https://learn.microsoft.com/en-us/windows/win32/api/processthreadsapi/nf-processthreadsapi-isprocessorfeaturepresent
-    u32 res = 0;
-    if (IsProcessorFeaturePresent(PF_ARM_NEON_INSTRUCTIONS_AVAILABLE)) {
-        res |= kCpuNEON;
-    }
-    if (IsProcessorFeaturePresent(PF_ARM_V8_CRYPTO_INSTRUCTIONS_AVAILABLE)) {
-        res |= kCpuArmCrypto;
-    }
-    if (IsProcessorFeaturePresent(PF_ARM_V81_ATOMIC_INSTRUCTIONS_AVAILABLE)) {
-        res |= kCpuArmAtomics;
-    }
-    if (IsProcessorFeaturePresent(PF_ARM_V82_DP_INSTRUCTIONS_AVAILABLE)) {
-        res |= kCpuArmDotProd;
-    }
-    return res;
-#else
-    // https://learn.microsoft.com/en-us/cpp/intrinsics/cpuid-cpuidex?view=msvc-170
-    std::bitset<32> f_1_ECX_;
-    std::bitset<32> f_1_EDX_;
-    std::bitset<32> f_7_EBX_;
-    std::bitset<32> f_7_ECX_;
-
-    u32 res = 0;
-    int cpuInfo[4]{};
-    __cpuid(cpuInfo, 0);
-    int nIds = cpuInfo[0];
-    if (nIds >= 1) {
-        __cpuid(cpuInfo, 1);
-        f_1_ECX_ = cpuInfo[2];
-        f_1_EDX_ = cpuInfo[3];
-    }
-    if (nIds >= 7) {
-        __cpuid(cpuInfo, 7);
-        f_7_EBX_ = cpuInfo[1];
-        f_7_ECX_ = cpuInfo[2];
-    }
-
-    if (f_1_EDX_[23]) {
-        res = res | kCpuMMX;
-    }
-    if (f_1_EDX_[25]) {
-        res = res | kCpuSSE;
-    }
-    if (f_1_EDX_[26]) {
-        res = res | kCpuSSE2;
-    }
-    if (f_1_ECX_[0]) {
-        res = res | kCpuSSE3;
-    }
-    if (f_1_ECX_[9]) {
-        res = res | kCpuSSE3;
-    }
-    if (f_1_ECX_[19]) {
-        res = res | kCpuSSE41;
-    }
-    if (f_1_ECX_[20]) {
-        res = res | kCpuSSE42;
-    }
-    if (f_1_ECX_[28]) {
-        res = res | kCpuAVX;
-    }
-    if (f_7_EBX_[5]) {
-        res = res | kCpuAVX2;
-    }
-    return res;
-#endif
-}
-
-const char* LatestSupportedSIMD() {
-    u32 id = CpuID();
-    // x86/x64
-    if (id & kCpuAVX2) {
-        return "avx2";
-    }
-    if (id & kCpuAVX) {
-        return "avx";
-    }
-    if (id & kCpuSSE42) {
-        return "sse42";
-    }
-    if (id & kCpuSSE41) {
-        return "sse41";
-    }
-    if (id & kCpuSSE3) {
-        return "sse3";
-    }
-    if (id & kCpuSSE2) {
-        return "sse2";
-    }
-    if (id & kCpuSSE) {
-        return "sse";
-    }
-    // ARM
-    if (id & kCpuArmDotProd) {
-        return "dotprod";
-    }
-    if (id & kCpuNEON) {
-        return "neon";
-    }
-    return "none";
-}
-
 LARGE_INTEGER TimeNow() {
     LARGE_INTEGER now;
     QueryPerformanceCounter(&now);
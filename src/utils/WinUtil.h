@@ -267,6 +267,8 @@ i64 BlittableBitmapByteSize(BlittableBitmap*);
 struct RenderedBitmap : BlittableBitmap {
     HBITMAP hbmp = nullptr;
     HANDLE hMap = nullptr;
+    // > 0 if created by NewPooledRenderedBitmap, returned to the pool when deleted
+    size_t poolMapSize = 0;
 
     RenderedBitmap(HBITMAP hbmp, Size size, HANDLE hMap = nullptr);
     ~RenderedBitmap() override;
@@ -285,6 +287,8 @@ COLORREF GetPixel(BitmapPixels* bitmap, int x, int y);
 void UpdateBitmapColors(HBITMAP hbmp, COLORREF textColor, COLORREF bgColor);
 ByteSlice SerializeBitmap(HBITMAP hbmp);
 HBITMAP CreateMemoryBitmap(Size size, HANDLE* hDataMapping = nullptr);
+RenderedBitmap* NewPooledRenderedBitmap(Size size, u8** bits);
+void FreeBitmapPool();
 bool BlitHBITMAP(HBITMAP hbmp, HDC hdc, Rect target);
 double GetProcessRunningTime();
 
@@ -367,23 +371,6 @@ int MsgBox(HWND, const char*, const char*, UINT);
 HWND ShowTextInWindow(const char* title, const char* text, HWND* hwndPtr = nullptr);
 void ShowTextInWindowDialog(const char* title, const char* text);
 
-constexpr u32 kCpuMMX = 1 << 1;
-constexpr u32 kCpuSSE = 1 << 2;
-constexpr u32 kCpuSSE2 = 1 << 2;
-constexpr u32 kCpuSSE3 = 1 << 3;
-constexpr u32 kCpuSSE41 = 1 << 4;
-constexpr u32 kCpuSSE42 = 1 << 5;
-constexpr u32 kCpuAVX = 1 << 6;
-constexpr u32 kCpuAVX2 = 1 << 7;
-// ARM
-constexpr u32 kCpuNEON = 1 << 8;
-constexpr u32 kCpuArmCrypto = 1 << 9;
-constexpr u32 kCpuArmAtomics = 1 << 10;
-constexpr u32 kCpuArmDotProd = 1 << 11;
-
-u32 CpuID();
-const char* LatestSupportedSIMD();
-
 LARGE_INTEGER TimeNow();
 double TimeDiffSecs(const LARGE_INTEGER& start, const LARGE_INTEGER& end);
 double TimeDiffMs(const LARGE_INTEGER& start, const LARGE_INTEGER& end);
@@ -0,0 +1,127 @@
+/* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
+   License: Simplified BSD (see COPYING.BSD) */
+
+#include "utils/BaseUtil.h"
+#include "utils/Base64.h"
+#include "utils/Timer.h"
+
+// must be last due to assert() over-write
+#include "utils/UtAssert.h"
+
+// encodes with line breaks every lineLen characters (if > 0)
+static char* Encode(const u8* d, size_t n, int lineLen, const char* nl) {
+    const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    str::Str s;
+    int col = 0;
+    auto appendChar = [&](char c) {
+        s.AppendChar(c);
+        if (lineLen > 0 && ++col == lineLen) {
+            s.Append(nl);
+            col = 0;
+        }
+    };
+    for (size_t i = 0; i < n; i += 3) {
+        u32 v = (u32)d[i] << 16;
+        if (i + 1 < n) {
+            v |= (u32)d[i + 1] << 8;
+        }
+        if (i + 2 < n) {
+            v |= d[i + 2];
+        }
+        appendChar(alphabet[(v >> 18) & 63]);
+        appendChar(alphabet[(v >> 12) & 63]);
+        appendChar(i + 1 < n ? alphabet[(v >> 6) & 63] : '=');
+        appendChar(i + 2 < n ? alphabet[v & 63] : '=');
+    }
+    return s.StealData();
+}
+
+static void TestDecodeStr(const char* s, const char* expected) {
+    ByteSlice res = base64::Decode(s);
+    ByteSlice res2 = base64::DecodeScalar(s);
+    if (!expected) {
+        utassert(res.empty());
+        utassert(res2.empty());
+        return;
+    }
+    size_t n = str::Len(expected);
+    utassert(res.size() == n && memeq(res.data(), expected, n));
+    utassert(res2.size() == n && memeq(res2.data(), expected, n));
+    res.Free();
+    res2.Free();
+}
+
+static void TestDecodeRandom(size_t n, int lineLen, const char* nl) {
+    u8* d = AllocArray<u8>(n + 1);
+    for (size_t i = 0; i < n; i++) {
+        d[i] = (u8)(rand() & 0xff);
+    }
+    char* enc = Encode(d, n, lineLen, nl);
+    ByteSlice res = base64::Decode(enc);
+    ByteSlice res2 = base64::DecodeScalar(enc);
+    utassert(res.size() == n && memeq(res.data(), d, n));
+    utassert(res2.size() == n && memeq(res2.data(), d, n));
+    res.Free();
+    res2.Free();
+
+    // a bad character anywhere must make the whole thing fail
+    size_t encLen = str::Len(enc);
+    if (encLen > 4) {
+        enc[encLen / 2] = '*';
+        res = base64::Decode(enc);
+        utassert(res.empty());
+    }
+    str::Free(enc);
+    free(d);
+}
+
+void Base64Test() {
+    TestDecodeStr("", "");
+    TestDecodeStr("TWFu", "Man");
+    TestDecodeStr("TWE=", "Ma");
+    TestDecodeStr("TQ==", "M");
+    TestDecodeStr(" T W\r\nF u\t", "Man");
+    TestDecodeStr("TWFu*", nullptr);
+    TestDecodeStr("TWFuIGlzIGRpc3Rpbmd1aXNoZWQsIG5vdCBvbmx5IGJ5IGhpcyByZWFzb24s",
+                  "Man is distinguished, not only by his reason,");
+    // '=' ends the data even if followed by garbage
+    TestDecodeStr("TWFuTWFuTWFuTWFuTWFu=*TWFuTWFuTWFuTWFuTWFuTWFuTWFu", "ManManManManMan");
+
+    // lengths around the simd block sizes (16 and 32 characters)
+    for (size_t n = 0; n < 100; n++) {
+        TestDecodeRandom(n, 0, "");
+    }
+    TestDecodeRandom(10000, 76, "\n");
+    TestDecodeRandom(10000, 76, "\r\n");
+    TestDecodeRandom(10000, 13, " ");
+    TestDecodeRandom(10000, 64, "\n");
+}
+
+void Base64Bench() {
+    // ~16 MB of images in an fb2 file, 76 characters per line
+    constexpr size_t kSize = 12 * 1024 * 1024;
+    u8* d = AllocArray<u8>(kSize);
+    for (size_t i = 0; i < kSize; i++) {
+        d[i] = (u8)(rand() & 0xff);
+    }
+    char* enc = Encode(d, kSize, 76, "\r\n");
+    double encMb = (double)str::Len(enc) / (1024.0 * 1024.0);
+    printf("base64 simd: %s\n", base64::SimdKind());
+
+    auto t = TimeGet();
+    ByteSlice res = base64::DecodeScalar(enc);
+    double dur = TimeSinceInMs(t);
+    utassert(res.size() == kSize);
+    printf("base64::DecodeScalar %8.2f ms %8.1f MB/s\n", dur, encMb / (dur / 1000.0));
+    res.Free();
+
+    t = TimeGet();
+    res = base64::Decode(enc);
+    dur = TimeSinceInMs(t);
+    utassert(res.size() == kSize && memeq(res.data(), d, kSize));
+    printf("base64::Decode       %8.2f ms %8.1f MB/s\n", dur, encMb / (dur / 1000.0));
+    res.Free();
+
+    str::Free(enc);
+    free(d);
+}
@@ -0,0 +1,95 @@
+/* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
+   License: Simplified BSD (see COPYING.BSD) */
+
+#include "utils/BaseUtil.h"
+#include "utils/DecodedImage.h"
+#include "utils/Timer.h"
+
+// must be last due to assert() over-write
+#include "utils/UtAssert.h"
+
+using ConvertRowFn = void (*)(const u8*, u8*, int);
+
+static void FillRandom(u8* d, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        d[i] = (u8)(rand() & 0xff);
+    }
+}
+
+// simd version must produce the same output as the plain C version for
+// every length, including ones that are not a multiple of the simd block
+static void TestConvert(ConvertRowFn fn, ConvertRowFn fnScalar, int srcBpp) {
+    constexpr int kMaxPixels = 67;
+    u8 src[kMaxPixels * 4];
+    u8 dst1[kMaxPixels * 4];
+    u8 dst2[kMaxPixels * 4];
+    for (int n = 0; n <= kMaxPixels; n++) {
+        FillRandom(src, sizeof(src));
+        memset(dst1, 0, sizeof(dst1));
+        memset(dst2, 0, sizeof(dst2));
+        fn(src, dst1, n);
+        fnScalar(src, dst2, n);
+        utassert(memeq(dst1, dst2, sizeof(dst1)));
+        // must not write past the end
+        if (n < kMaxPixels) {
+            utassert(dst1[n * 4] == 0);
+        }
+    }
+    u8 px[4] = {1, 2, 3, 4};
+    u8 out[4];
+    fnScalar(px, out, 1);
+    if (srcBpp == 1) {
+        utassert(out[0] == 1 && out[1] == 1 && out[2] == 1 && out[3] == 0xff);
+    } else if (srcBpp == 3) {
+        utassert(out[0] == 3 && out[1] == 2 && out[2] == 1 && out[3] == 0xff);
+    } else {
+        utassert(out[0] == 3 && out[1] == 2 && out[2] == 1 && out[3] == 4);
+    }
+}
+
+static void TestDecodedImageAlloc() {
+    DecodedImage img;
+    utassert(!img.Allocate(0, 10));
+    utassert(!img.pixels);
+    utassert(img.Allocate(13, 7));
+    utassert(img.stride == 13 * 4);
+    utassert(img.DataSize() == (size_t)13 * 4 * 7);
+    utassert(img.Row(1) == img.pixels + img.stride);
+}
+
+void DecodedImageTest() {
+    TestDecodedImageAlloc();
+    TestConvert(pixconv::RgbToBgra, pixconv::RgbToBgraScalar, 3);
+    TestConvert(pixconv::RgbaToBgra, pixconv::RgbaToBgraScalar, 4);
+    TestConvert(pixconv::GrayToBgra, pixconv::GrayToBgraScalar, 1);
+}
+
+static void BenchConvert(const char* name, ConvertRowFn fn, int srcBpp) {
+    // roughly a 4000x6000 comic page
+    constexpr int kDx = 4000;
+    constexpr int kDy = 6000;
+    u8* src = AllocArray<u8>((size_t)kDx * srcBpp);
+    u8* dst = AllocArray<u8>((size_t)kDx * 4);
+    FillRandom(src, (size_t)kDx * srcBpp);
+    auto t = TimeGet();
+    for (int y = 0; y < kDy; y++) {
+        fn(src, dst, kDx);
+    }
+    double dur = TimeSinceInMs(t);
+    double mpixPerSec = ((double)kDx * (double)kDy / 1e6) / (dur / 1000.0);
+    printf("%-22s %8.2f ms %10.1f Mpixels/s\n", name, dur, mpixPerSec);
+    free(src);
+    free(dst);
+}
+
+// only times the per-row pixel conversion. The decoders live outside of utils,
+// use "SumatraPDF.exe -bench <image> decode" to time the full decode
+void DecodedImageBench() {
+    printf("pixconv simd: %s (pixel conversion only, not decoding)\n", pixconv::HasSimd() ? "yes" : "no");
+    BenchConvert("RgbToBgraScalar", pixconv::RgbToBgraScalar, 3);
+    BenchConvert("RgbToBgra", pixconv::RgbToBgra, 3);
+    BenchConvert("RgbaToBgraScalar", pixconv::RgbaToBgraScalar, 4);
+    BenchConvert("RgbaToBgra", pixconv::RgbaToBgra, 4);
+    BenchConvert("GrayToBgraScalar", pixconv::GrayToBgraScalar, 1);
+    BenchConvert("GrayToBgra", pixconv::GrayToBgra, 1);
+}
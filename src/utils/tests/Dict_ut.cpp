@@ -3,6 +3,7 @@
 
 #include "utils/BaseUtil.h"
 #include "utils/Dict.h"
+#include "utils/Timer.h"
 
 // must be last due to assert() over-write
 #include "utils/UtAssert.h"
@@ -76,6 +77,259 @@ void DictTestMapStrToInt() {
     toRemove.FreeMembers();
 }
 
+static void DictTestMapStrToIntIgnoreCase() {
+    dict::MapStrToInt d(4, true);
+    int val;
+    bool ok = d.Insert("OEBPS/Text/Chapter1.xhtml", 1);
+    utassert(ok);
+    ok = d.Insert("oebps/text/chapter1.XHTML", 2, &val);
+    utassert(!ok);
+    utassert(val == 1);
+    ok = d.Get("OEBPS/TEXT/CHAPTER1.XHTML", &val);
+    utassert(ok && val == 1);
+    ok = d.Get("OEBPS/Text/Chapter1.xhtm", &val);
+    utassert(!ok);
+    ok = d.Get("OEBPS/Text/Chapter1.xhtmlx", &val);
+    utassert(!ok);
+    ok = d.Remove("oebps/TEXT/chapter1.xhtml", &val);
+    utassert(ok && val == 1);
+    utassert(0 == d.Count());
+
+    // case-sensitive map must still tell those apart
+    dict::MapStrToInt d2(4);
+    d2.Insert("Foo", 1);
+    ok = d2.Get("foo", &val);
+    utassert(!ok);
+}
+
+// many inserts and removes leave many deleted slots, which must not break lookups
+static void DictTestChurn() {
+    dict::MapStrToInt d(16);
+    bool ok;
+    int val;
+    for (int round = 0; round < 20; round++) {
+        for (int i = 0; i < 200; i++) {
+            ok = d.Insert(str::FormatTemp("key%d-%d", round, i), i);
+            utassert(ok);
+        }
+        // remove all but the last 10 of this round
+        for (int i = 0; i < 190; i++) {
+            ok = d.Remove(str::FormatTemp("key%d-%d", round, i), &val);
+            utassert(ok && val == i);
+        }
+        utassert(d.Count() == (size_t)(round + 1) * 10);
+    }
+    for (int round = 0; round < 20; round++) {
+        for (int i = 0; i < 200; i++) {
+            ok = d.Get(str::FormatTemp("key%d-%d", round, i), &val);
+            utassert(ok == (i >= 190));
+            utassert(!ok || val == i);
+        }
+    }
+}
+
+static void DictTestMapPtrToInt() {
+    dict::MapPtrToInt d(4);
+    int val;
+    bool ok = d.Get(nullptr, &val);
+    utassert(!ok);
+
+    // adjacent addresses are the worst case for a naive hash of pointer value
+    constexpr int kCount = 5000;
+    char* buf = AllocArray<char>(kCount);
+    for (int i = 0; i < kCount; i++) {
+        ok = d.Insert(buf + i, i);
+        utassert(ok);
+    }
+    ok = d.Insert(buf + 10, 3, &val);
+    utassert(!ok && val == 10);
+    utassert(d.Count() == kCount);
+    for (int i = 0; i < kCount; i += 2) {
+        ok = d.Remove(buf + i, &val);
+        utassert(ok && val == i);
+    }
+    utassert(d.Count() == kCount / 2);
+    for (int i = 0; i < kCount; i++) {
+        ok = d.Get(buf + i, &val);
+        utassert(ok == (i % 2 == 1));
+        utassert(!ok || val == i);
+    }
+    ok = d.Get(buf + kCount, &val);
+    utassert(!ok);
+    free(buf);
+}
+
 void DictTest() {
     DictTestMapStrToInt();
+    DictTestMapStrToIntIgnoreCase();
+    DictTestChurn();
+    DictTestMapPtrToInt();
+}
+
+// simulates looking up every entry by name in an archive with n entries,
+// like EPUB and comic book loading does: linear scan vs. the hashed index
+static void BenchArchiveNameLookup(int n) {
+    Vec<const char*> names;
+    Vec<const char*> queries;
+    for (int i = 0; i < n; i++) {
+        names.Append(str::FormatTemp("OEBPS/Images/Image%05d.jpeg", i));
+        queries.Append(str::FormatTemp("oebps/images/image%05d.JPEG", (i * 7919) % n));
+    }
+
+    // linear scan is too slow to do all lookups for large n
+    int nLinear = std::min(n, 2000);
+    int nFound = 0;
+    auto t = TimeGet();
+    for (int q = 0; q < nLinear; q++) {
+        const char* query = queries[q];
+        for (int i = 0; i < n; i++) {
+            if (str::EqI(names[i], query)) {
+                nFound++;
+                break;
+            }
+        }
+    }
+    double usLinear = TimeSinceInMs(t) * 1000.0 / nLinear;
+    utassert(nFound == nLinear);
+
+    t = TimeGet();
+    dict::MapStrToInt index((size_t)n, true);
+    for (int i = 0; i < n; i++) {
+        index.Insert(names[i], i);
+    }
+    double msBuild = TimeSinceInMs(t);
+    nFound = 0;
+    t = TimeGet();
+    for (int q = 0; q < n; q++) {
+        int val;
+        if (index.Get(queries[q], &val)) {
+            nFound++;
+        }
+    }
+    double usIndexed = TimeSinceInMs(t) * 1000.0 / n;
+    utassert(nFound == n);
+
+    printf("archive name lookup, %6d entries: linear %9.3f us/lookup, indexed %6.3f us/lookup (build %.2f ms)\n", n,
+           usLinear, usIndexed, msBuild);
+}
+
+// the hash table MapStrToInt used before switching to open addressing:
+// array of buckets, each a linked list of entries allocated from a pool
+struct ChainedEntry {
+    const char* key;
+    int val;
+    ChainedEntry* next;
+};
+
+struct ChainedMapStrToInt {
+    PoolAllocator allocator;
+    ChainedEntry** buckets = nullptr;
+    size_t nBuckets = 0;
+    size_t nUsed = 0;
+
+    explicit ChainedMapStrToInt(size_t size) {
+        nBuckets = RoundToPowerOf2(size);
+        buckets = AllocArray<ChainedEntry*>(nBuckets);
+    }
+    ~ChainedMapStrToInt() { free(buckets); }
+
+    void Resize() {
+        size_t newSize = nBuckets * 2;
+        ChainedEntry** newBuckets = AllocArray<ChainedEntry*>(newSize);
+        for (size_t i = 0; i < nBuckets; i++) {
+            ChainedEntry* e = buckets[i];
+            while (e) {
+                ChainedEntry* next = e->next;
+                size_t pos = MurmurHash2(e->key, str::Len(e->key)) % newSize;
+                e->next = newBuckets[pos];
+                newBuckets[pos] = e;
+                e = next;
+            }
+        }
+        free(buckets);
+        buckets = newBuckets;
+        nBuckets = newSize;
+    }
+
+    bool Insert(const char* key, int val) {
+        size_t pos = MurmurHash2(key, str::Len(key)) % nBuckets;
+        for (ChainedEntry* e = buckets[pos]; e; e = e->next) {
+            if (str::Eq(key, e->key)) {
+                return false;
+            }
+        }
+        ChainedEntry* e = Allocator::AllocArray<ChainedEntry>(&allocator, 1);
+        e->key = str::Dup(&allocator, key);
+        e->val = val;
+        e->next = buckets[pos];
+        buckets[pos] = e;
+        nUsed++;
+        if (nUsed >= (nBuckets * 3) / 2) {
+            Resize();
+        }
+        return true;
+    }
+
+    bool Get(const char* key, int* valOut) const {
+        size_t pos = MurmurHash2(key, str::Len(key)) % nBuckets;
+        for (ChainedEntry* e = buckets[pos]; e; e = e->next) {
+            if (str::Eq(key, e->key)) {
+                *valOut = e->val;
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+// keys like html tag / attribute names and file paths, half of the lookups miss
+template <typename Map>
+static void BenchMap(const char* name, const StrVec& keys, const StrVec& misses) {
+    int n = keys.Size();
+    auto t = TimeGet();
+    // start small, like most uses do, so that resizing is included
+    Map m(64);
+    for (int i = 0; i < n; i++) {
+        m.Insert(keys.At(i), i);
+    }
+    double msInsert = TimeSinceInMs(t);
+
+    constexpr int kRounds = 10;
+    int nFound = 0;
+    t = TimeGet();
+    for (int r = 0; r < kRounds; r++) {
+        for (int i = 0; i < n; i++) {
+            int val;
+            if (m.Get(keys.At((i * 7919) % n), &val)) {
+                nFound++;
+            }
+            if (m.Get(misses.At(i), &val)) {
+                nFound++;
+            }
+        }
+    }
+    double nsLookup = TimeSinceInMs(t) * 1000000.0 / (2.0 * kRounds * n);
+    utassert(nFound == kRounds * n);
+    printf("%-8s %7d keys: insert %7.2f ms, lookup %6.1f ns\n", name, n, msInsert, nsLookup);
+}
+
+static void BenchOpenAddressingVsChained(int n) {
+    StrVec keys;
+    StrVec misses;
+    for (int i = 0; i < n; i++) {
+        keys.Append(str::FormatTemp("OEBPS/Text/chapter%05d.xhtml", i));
+        misses.Append(str::FormatTemp("OEBPS/Text/chapter%05d.html", i));
+    }
+    BenchMap<ChainedMapStrToInt>("chained", keys, misses);
+    BenchMap<dict::MapStrToInt>("swiss", keys, misses);
+}
+
+void DictBench() {
+    BenchOpenAddressingVsChained(100);
+    BenchOpenAddressingVsChained(10000);
+    BenchOpenAddressingVsChained(200000);
+
+    BenchArchiveNameLookup(1000);
+    BenchArchiveNameLookup(10000);
+    BenchArchiveNameLookup(50000);
 }
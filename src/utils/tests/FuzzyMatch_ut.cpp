@@ -0,0 +1,62 @@
+/* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
+   License: Simplified BSD (see COPYING.BSD) */
+
+#include "utils/BaseUtil.h"
+#include "utils/FuzzyMatch.h"
+
+// must be last due to assert() over-write
+#include "utils/UtAssert.h"
+
+// returns score or -1000 if doesn't match
+static int Score(const char* text, const char* pattern) {
+    int textLen = str::Leni(text);
+    TempStr textLower = fuzzy::ToLowerTemp(text);
+    TempStr pat = fuzzy::ToLowerTemp(pattern);
+    int score = 0;
+    if (!fuzzy::Match(text, textLower, textLen, pat, str::Leni(pat), &score)) {
+        return -1000;
+    }
+    return score;
+}
+
+static void TestPositions(const char* text, const char* pattern, const char* expected) {
+    int textLen = str::Leni(text);
+    TempStr textLower = fuzzy::ToLowerTemp(text);
+    TempStr pat = fuzzy::ToLowerTemp(pattern);
+    u8* pos = AllocArrayTemp<u8>(textLen);
+    int score = 0;
+    bool ok = fuzzy::Match(text, textLower, textLen, pat, str::Leni(pat), &score, pos);
+    utassert(ok);
+    for (int i = 0; i < textLen; i++) {
+        utassert((pos[i] != 0) == (expected[i] == 'x'));
+    }
+}
+
+void FuzzyMatchTest() {
+    utassert(str::Eq(fuzzy::ToLowerTemp("Foo BAR.pdf"), "foo bar.pdf"));
+    utassert(str::Eq(fuzzy::ToLowerTemp("ABCDEF", 3), "abc"));
+
+    utassert(Score("anything", "") == 0);
+    utassert(Score("Open File", "of") > 0);
+    utassert(Score("Open File", "opfi") > 0);
+    utassert(Score("Open File", "fo") == -1000);
+    utassert(Score("Open File", "openx") == -1000);
+    utassert(Score("", "a") == -1000);
+
+    // consecutive characters are better than scattered ones
+    utassert(Score("Rotate Left", "rot") > Score("Rename Outline Tab", "rot"));
+    // start of a word is better than the middle
+    utassert(Score("Toggle Bookmarks", "book") > Score("Facebook", "book"));
+    // after a path separator is a word start
+    utassert(Score("c:\\docs\\report.pdf", "rep") > Score("c:\\docs\\prepare.pdf", "rep"));
+    // camelCase humps count as word starts
+    utassert(Score("FileHistory", "fh") > Score("Fresh", "fh"));
+    // shorter gaps are better
+    utassert(Score("a-b", "ab") > Score("a---b", "ab"));
+
+    // the shortest match ending at the first full match is picked,
+    // characters inside it are matched greedily
+    TestPositions("Close other tabs", "cot", "x.x....x........");
+    TestPositions("aab", "ab", ".xx");
+    TestPositions("Next Page", "np", "x....x...");
+}
@@ -3,6 +3,7 @@
 
 #include "utils/BaseUtil.h"
 #include "utils/SettingsUtil.h"
+#include "utils/Timer.h"
 
 // must be last due to assert() over-write
 #include "utils/UtAssert.h"
@@ -83,6 +84,46 @@ static const StructInfo gSutStructInfo = {sizeof(SutStruct), 17, gSutStructField
                                           "\0Utf8String\0NullUtf8String\0EscapedUtf8String\0IntArray\0StrArray\0EmptySt"
                                           "rArray\0Point\0\0SutStructItems"};
 
+// serializing with cached text of unchanged array elements must give
+// the same result as serializing everything
+static void TestSerializeCache(const char* serialized) {
+    ResetSerializeStructCache();
+    SutStruct* data = (SutStruct*)DeserializeStruct(&gSutStructInfo, serialized);
+    AutoFree s1(SerializeStruct(&gSutStructInfo, data));
+    AutoFree s2(SerializeStruct(&gSutStructInfo, data));
+    utassert(str::Eq(s1, s2));
+
+    SutStructItem* item = data->sutStructItems->at(1);
+    item->compactPoint.x = 42;
+    item->nested.colorArray->Append(str::Dup("#aabbcc"));
+    AutoFree s3(SerializeStruct(&gSutStructInfo, data));
+    utassert(!str::Eq(s1, s3));
+    ResetSerializeStructCache();
+    AutoFree s4(SerializeStruct(&gSutStructInfo, data));
+    utassert(str::Eq(s3, s4));
+
+    FreeStruct(&gSutStructItemInfo, data->sutStructItems->at(0));
+    data->sutStructItems->RemoveAt(0);
+    AutoFree s5(SerializeStruct(&gSutStructInfo, data));
+    ResetSerializeStructCache();
+    AutoFree s6(SerializeStruct(&gSutStructInfo, data));
+    utassert(str::Eq(s5, s6));
+    FreeStruct(&gSutStructInfo, data);
+}
+
+// fields are looked up in order but values must be the same as
+// with GetValue(), including for out of order and duplicate keys
+static void TestDeserializeOrder() {
+    static const char* data = "IntArray = 5\nInteger = 1\nboolean = false\nInteger = 2\nColor = #123456\n";
+    SutStruct* s = (SutStruct*)DeserializeStruct(&gSutStructInfo, data);
+    utassert(1 == s->integer);
+    utassert(!s->boolean);
+    utassert(str::Eq(s->color, "#123456"));
+    utassert(1 == s->intArray->size() && 5 == s->intArray->at(0));
+    utassert(str::Eq(s->string, "String"));
+    FreeStruct(&gSutStructInfo, s);
+}
+
 void SettingsUtilTest() {
     static const char* serialized = UTF8_BOM
         "# This file will be overwritten - modify at your own risk!\r\n\r\n\
@@ -212,4 +253,105 @@ Key = Value";
         utassert(data->boolean == ((i % 2) == 0));
         FreeStruct(&gSutStructInfo, data);
     }
+
+    TestSerializeCache(serialized);
+    TestDeserializeOrder();
+}
+
+// roughly the fields of FileState
+struct BenchState {
+    char* filePath;
+    bool isPinned;
+    bool isMissing;
+    int openCount;
+    char* decryptionKey;
+    bool useDefaultState;
+    char* displayMode;
+    Point scrollPos;
+    int pageNo;
+    int reparseIdx;
+    char* zoom;
+    int rotation;
+    int windowState;
+    Point windowPos;
+    bool showToc;
+    int sidebarDx;
+    bool displayR2L;
+    Vec<int>* tocState;
+};
+
+static const FieldInfo gBenchStateFields[] = {
+    {offsetof(BenchState, filePath), SettingType::String, 0},
+    {offsetof(BenchState, isPinned), SettingType::Bool, false},
+    {offsetof(BenchState, isMissing), SettingType::Bool, false},
+    {offsetof(BenchState, openCount), SettingType::Int, 0},
+    {offsetof(BenchState, decryptionKey), SettingType::String, 0},
+    {offsetof(BenchState, useDefaultState), SettingType::Bool, false},
+    {offsetof(BenchState, displayMode), SettingType::String, (intptr_t)"automatic"},
+    {offsetof(BenchState, scrollPos), SettingType::Compact, (intptr_t)&gSutPointIInfo},
+    {offsetof(BenchState, pageNo), SettingType::Int, 1},
+    {offsetof(BenchState, reparseIdx), SettingType::Int, 0},
+    {offsetof(BenchState, zoom), SettingType::String, (intptr_t)"fit page"},
+    {offsetof(BenchState, rotation), SettingType::Int, 0},
+    {offsetof(BenchState, windowState), SettingType::Int, 0},
+    {offsetof(BenchState, windowPos), SettingType::Compact, (intptr_t)&gSutPointIInfo},
+    {offsetof(BenchState, showToc), SettingType::Bool, true},
+    {offsetof(BenchState, sidebarDx), SettingType::Int, 0},
+    {offsetof(BenchState, displayR2L), SettingType::Bool, false},
+    {offsetof(BenchState, tocState), SettingType::IntArray, 0},
+};
+static const StructInfo gBenchStateInfo = {
+    sizeof(BenchState), 18, gBenchStateFields,
+    "FilePath\0IsPinned\0IsMissing\0OpenCount\0DecryptionKey\0UseDefaultState\0DisplayMode\0ScrollPos\0PageNo\0R"
+    "eparseIdx\0Zoom\0Rotation\0WindowState\0WindowPos\0ShowToc\0SidebarDx\0DisplayR2L\0TocState"};
+
+struct BenchPrefs {
+    bool rememberOpenedFiles;
+    Vec<BenchState*>* fileStates;
+};
+
+static const FieldInfo gBenchPrefsFields[] = {
+    {offsetof(BenchPrefs, rememberOpenedFiles), SettingType::Bool, true},
+    {offsetof(BenchPrefs, fileStates), SettingType::Array, (intptr_t)&gBenchStateInfo},
+};
+static const StructInfo gBenchPrefsInfo = {sizeof(BenchPrefs), 2, gBenchPrefsFields,
+                                           "RememberOpenedFiles\0FileStates"};
+
+void SettingsUtilBench() {
+    constexpr int kStates = 10000;
+    str::Str s;
+    s.Append("RememberOpenedFiles = true\r\nFileStates [\r\n");
+    for (int i = 0; i < kStates; i++) {
+        s.AppendFmt("\t[\r\n\t\tFilePath = C:\\Users\\me\\Documents\\books\\some book %d.pdf\r\n", i);
+        s.AppendFmt("\t\tIsPinned = false\r\n\t\tIsMissing = false\r\n\t\tOpenCount = %d\r\n", i % 50);
+        s.Append("\t\tUseDefaultState = false\r\n\t\tDisplayMode = continuous\r\n");
+        s.AppendFmt("\t\tScrollPos = 0 %d\r\n\t\tPageNo = %d\r\n\t\tReparseIdx = 0\r\n", i * 3, i % 300 + 1);
+        s.Append("\t\tZoom = fit width\r\n\t\tRotation = 0\r\n\t\tWindowState = 1\r\n");
+        s.Append("\t\tWindowPos = 100 100\r\n\t\tShowToc = true\r\n\t\tSidebarDx = 220\r\n");
+        s.Append("\t\tDisplayR2L = false\r\n\t\tTocState = 1 4 7\r\n\t]\r\n");
+    }
+    s.Append("]\r\n");
+    printf("settings with %d file states: %d KB\n", kStates, (int)(s.size() / 1024));
+
+    auto t = TimeGet();
+    BenchPrefs* prefs = (BenchPrefs*)DeserializeStruct(&gBenchPrefsInfo, s.Get());
+    printf("DeserializeStruct            %8.2f ms\n", TimeSinceInMs(t));
+    utassert(prefs->fileStates->size() == kStates);
+
+    ResetSerializeStructCache();
+    t = TimeGet();
+    ByteSlice d1 = SerializeStruct(&gBenchPrefsInfo, prefs, s.Get());
+    printf("SerializeStruct (no cache)   %8.2f ms\n", TimeSinceInMs(t));
+
+    // like closing a document: one state changes
+    prefs->fileStates->at(kStates / 2)->pageNo++;
+    t = TimeGet();
+    ByteSlice d2 = SerializeStruct(&gBenchPrefsInfo, prefs, (const char*)d1.data());
+    printf("SerializeStruct (1 changed)  %8.2f ms\n", TimeSinceInMs(t));
+    utassert(d1.size() == d2.size() && !str::Eq(d1, d2));
+
+    FreeStruct(&gBenchPrefsInfo, prefs);
+    str::Free(d1.data());
+    str::Free(d2.data());
+    ResetSerializeStructCache();
 }
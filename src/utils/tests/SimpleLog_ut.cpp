@@ -19,4 +19,26 @@ void SimpleLogTest() {
         const char* exp = "Test1\nML\nfilename.pdf : 25\n";
         utassert(str::Eq(got, exp));
     }
+
+    {
+        gLogBuf->Reset();
+        StartAsyncLogging();
+        log("Test1\n");
+        logf("%s : %d\n", "filename.pdf", 25);
+        logf("%5.2f|%-4s|%03d|%lld|%zu|%c|%x|100%%\n", 3.14159, "ab", 7, (i64)-1234567890123, (size_t)42, 'z', 255);
+        logf("%s\n", (const char*)nullptr);
+        // not supported by deferred formatting, formatted before logging
+        logf("%*d|%ls\n", 3, 5, L"wide");
+        logfa("always %d\n", 1);
+        const char* exp =
+            "Test1\nfilename.pdf : 25\n 3.14|ab  |007|-1234567890123|42|z|ff|100%\n(null)\n  5|wide\nalways 1\n";
+        // includes lines that haven't been flushed yet
+        str::Str crashLog;
+        utassert(AppendLogForCrashReport(crashLog));
+        utassert(str::Eq(crashLog.Get(), exp));
+        FlushLog();
+        char* got = gLogBuf->Get();
+        utassert(str::Eq(got, exp));
+        StopAsyncLogging();
+    }
 }
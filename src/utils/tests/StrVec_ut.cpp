@@ -2,6 +2,7 @@
 License: Simplified BSD (see COPYING.BSD) */
 
 #include "utils/BaseUtil.h"
+#include "utils/Timer.h"
 
 // must be last due to assert() over-write
 #include "utils/UtAssert.h"
@@ -745,7 +746,47 @@ static void StrVecTest8() {
     }
 }
 
+// many pages with inserts / removes in the middle must keep the page
+// directory used by At() in sync
+static void StrVecTestPageDir() {
+    constexpr int kMaxStrings = 20000;
+    int* ids = AllocArray<int>(kMaxStrings);
+    int n = 0;
+    char buf[32];
+    StrVec v;
+    for (int i = 0; i < kMaxStrings / 2; i++) {
+        snprintf(buf, sizeof(buf), "%d", i);
+        v.Append(buf);
+        ids[n++] = i;
+    }
+    utassert(v.nPages > 1);
+    for (int i = 0; i < kMaxStrings / 2; i++) {
+        int idx = rand() % (n + 1);
+        if (n > 0 && (rand() % 3) == 0) {
+            idx = idx % n;
+            v.RemoveAt(idx);
+            memmove(ids + idx, ids + idx + 1, (size_t)(n - idx - 1) * sizeof(int));
+            n--;
+            continue;
+        }
+        int id = kMaxStrings + i;
+        snprintf(buf, sizeof(buf), "%d", id);
+        v.InsertAt(idx, buf);
+        memmove(ids + idx + 1, ids + idx, (size_t)(n - idx) * sizeof(int));
+        ids[idx] = id;
+        n++;
+    }
+    utassert(v.Size() == n);
+    ValidateSize(&v);
+    for (int i = 0; i < n; i++) {
+        snprintf(buf, sizeof(buf), "%d", ids[i]);
+        utassert(str::Eq(v.At(i), buf));
+    }
+    free(ids);
+}
+
 void StrVecTest() {
+    StrVecTestPageDir();
     StrVecTest8();
     StrVecTest1();
     StrVecTest2();
@@ -755,3 +796,59 @@ void StrVecTest() {
     StrVecTest6();
     StrVecTest7();
 }
+
+static void BenchStrVec(int n) {
+    char** strs = AllocArray<char*>(n);
+    int* randIdx = AllocArray<int>(n);
+    for (int i = 0; i < n; i++) {
+        strs[i] = str::Format("c:\\books\\file-%d.pdf", (i * 7919) % n);
+        randIdx[i] = rand() % n;
+    }
+
+    StrVec v;
+    auto t = TimeGet();
+    for (int i = 0; i < n; i++) {
+        v.Append(strs[i]);
+    }
+    double durAppend = TimeSinceInMs(t);
+
+    size_t total = 0;
+    t = TimeGet();
+    for (int i = 0; i < n; i++) {
+        total += str::Len(v.At(i));
+    }
+    double durAt = TimeSinceInMs(t);
+
+    t = TimeGet();
+    for (int i = 0; i < n; i++) {
+        total += v.AtSpan(randIdx[i]).Len();
+    }
+    double durRand = TimeSinceInMs(t);
+
+    t = TimeGet();
+    SortIndex(&v);
+    double durSort = TimeSinceInMs(t);
+    t = TimeGet();
+    for (int i = 0; i < n; i++) {
+        total += str::Len(v.At(i));
+    }
+    double durSorted = TimeSinceInMs(t);
+
+    double ns = 1000000.0 / (double)n;
+    printf("StrVec %7d strings, %4d pages: Append %6.1f ns, At %6.1f ns, random AtSpan %6.1f ns, ", n, v.nPages,
+           durAppend * ns, durAt * ns, durRand * ns);
+    printf("SortIndex %8.2f ms, sorted At %6.1f ns (%d)\n", durSort, durSorted * ns, (int)(total & 1));
+
+    for (int i = 0; i < n; i++) {
+        str::Free(strs[i]);
+    }
+    free(strs);
+    free(randIdx);
+}
+
+void StrVecBench() {
+    BenchStrVec(1000);
+    BenchStrVec(10000);
+    BenchStrVec(100000);
+    BenchStrVec(1000000);
+}